@@ -337,6 +337,17 @@ int reiser4_writepages_dispatch(struct address_space *mapping,
 	return inode_file_plugin(mapping->host)->writepages(mapping, wbc);
 }
 
+ssize_t reiser4_direct_IO_dispatch(struct kiocb *iocb, struct iov_iter *iter)
+{
+	file_plugin *fplug;
+
+	fplug = inode_file_plugin(file_inode(iocb->ki_filp));
+	if (fplug->direct_IO == NULL)
+		/* fall back to buffered i/o */
+		return 0;
+	return fplug->direct_IO(iocb, iter);
+}
+
 /* Make Linus happy.
    Local variables:
    c-indentation-style: "K&R"
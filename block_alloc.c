@@ -14,6 +14,9 @@ reiser4/README */
 #include <linux/types.h>	/* for __u??  */
 #include <linux/fs.h>		/* for struct super_block  */
 #include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
 
 /* THE REISER4 DISK SPACE RESERVATION SCHEME. */
 
@@ -165,6 +168,19 @@ static void sub_from_sb_grabbed(reiser4_super_info_data * sbinfo, __u64 count)
 	sbinfo->blocks_grabbed -= count;
 }
 
+/* return grabbed blocks not owned by any context to free space */
+static void grabbed2free_nocache(reiser4_super_info_data *sbinfo, __u64 count)
+{
+	spin_lock_reiser4_super(sbinfo);
+
+	sub_from_sb_grabbed(sbinfo, count);
+	sbinfo->blocks_free += count;
+	assert("nikita-2684",
+	       reiser4_check_block_counters(reiser4_get_current_sb()));
+
+	spin_unlock_reiser4_super(sbinfo);
+}
+
 /* Decrease the counter of block reserved for flush in super block. */
 static void
 sub_from_sb_flush_reserved(reiser4_super_info_data * sbinfo, __u64 count)
@@ -249,6 +265,131 @@ int reiser4_check_block_counters(const struct super_block *super)
 	return 1;
 }
 
+/* PER-CPU CACHES OF GRABBED SPACE
+
+   Every file system operation grabs space at start and returns what it did
+   not use at the end. Doing both under the super block spin lock makes that
+   lock heavily contended on write-intensive multithreaded workloads. So
+   each cpu keeps a small cache of blocks grabbed in advance: blocks which
+   are already moved from ->blocks_free to ->blocks_grabbed but not yet
+   owned by any context. reiser4_grab() takes blocks from the local cache if
+   possible, and refills it by REISER4_GRAB_CACHE_BATCH blocks on the slow
+   path. grabbed2free() returns blocks to the local cache until it holds
+   REISER4_GRAB_CACHE_MAX blocks. Counter invariants are not affected.
+   Caches are never refilled from the reserved area, and a context which
+   grabbed from it returns blocks directly to ->blocks_free.
+
+   ENOSPC decisions remain exact: before failing, the slow path drains all
+   caches back to ->blocks_free and checks again without releasing the super
+   block lock in between. Caches are refilled only under that lock, so other
+   cpus can not take the drained blocks back before the check. Cache locks
+   nest inside the super block lock and are never held when it is taken.
+   Caches are also drained on umount, and statfs(2) counts cached blocks as
+   free. */
+
+#define REISER4_GRAB_CACHE_BATCH (64)
+#define REISER4_GRAB_CACHE_MAX (2 * REISER4_GRAB_CACHE_BATCH)
+
+int reiser4_init_grab_cache(reiser4_super_info_data *sbinfo)
+{
+	int cpu;
+
+	sbinfo->grab_cache = alloc_percpu(struct reiser4_grab_cache);
+	if (sbinfo->grab_cache == NULL)
+		return RETERR(-ENOMEM);
+	for_each_possible_cpu(cpu) {
+		struct reiser4_grab_cache *cache;
+
+		cache = per_cpu_ptr(sbinfo->grab_cache, cpu);
+		spin_lock_init(&cache->lock);
+		cache->nr = 0;
+	}
+	return 0;
+}
+
+void reiser4_done_grab_cache(reiser4_super_info_data *sbinfo)
+{
+	if (sbinfo->grab_cache == NULL)
+		return;
+	reiser4_drain_grab_cache(sbinfo);
+	free_percpu(sbinfo->grab_cache);
+	sbinfo->grab_cache = NULL;
+}
+
+/* return all cached blocks to free space. Super block lock is held */
+static void drain_grab_cache_nolock(reiser4_super_info_data *sbinfo)
+{
+	int cpu;
+	__u64 drained = 0;
+
+	assert_spin_locked(&sbinfo->guard);
+
+	for_each_possible_cpu(cpu) {
+		struct reiser4_grab_cache *cache;
+
+		cache = per_cpu_ptr(sbinfo->grab_cache, cpu);
+		spin_lock(&cache->lock);
+		drained += cache->nr;
+		cache->nr = 0;
+		spin_unlock(&cache->lock);
+	}
+	sub_from_sb_grabbed(sbinfo, drained);
+	sbinfo->blocks_free += drained;
+}
+
+/* return all cached blocks to free space */
+void reiser4_drain_grab_cache(reiser4_super_info_data *sbinfo)
+{
+	spin_lock_reiser4_super(sbinfo);
+	drain_grab_cache_nolock(sbinfo);
+	spin_unlock_reiser4_super(sbinfo);
+}
+
+/* number of cached blocks. Is not exact, for statistics only */
+__u64 reiser4_grab_cache_count(const reiser4_super_info_data *sbinfo)
+{
+	int cpu;
+	__u64 nr = 0;
+
+	for_each_possible_cpu(cpu)
+		nr += READ_ONCE(per_cpu_ptr(sbinfo->grab_cache, cpu)->nr);
+	return nr;
+}
+
+/* take @count blocks from the local cache. Returns 1 on success */
+static int grab_from_cache(reiser4_super_info_data *sbinfo, __u64 count)
+{
+	struct reiser4_grab_cache *cache;
+	int ret = 0;
+
+	cache = get_cpu_ptr(sbinfo->grab_cache);
+	spin_lock(&cache->lock);
+	if (cache->nr >= count) {
+		cache->nr -= count;
+		ret = 1;
+	}
+	spin_unlock(&cache->lock);
+	put_cpu_ptr(sbinfo->grab_cache);
+	return ret;
+}
+
+/* put @count blocks to the local cache. Returns 1 on success */
+static int put_to_cache(reiser4_super_info_data *sbinfo, __u64 count)
+{
+	struct reiser4_grab_cache *cache;
+	int ret = 0;
+
+	cache = get_cpu_ptr(sbinfo->grab_cache);
+	spin_lock(&cache->lock);
+	if (cache->nr + count <= REISER4_GRAB_CACHE_MAX) {
+		cache->nr += count;
+		ret = 1;
+	}
+	spin_unlock(&cache->lock);
+	put_cpu_ptr(sbinfo->grab_cache);
+	return ret;
+}
+
 /* Adjust "working" free blocks counter for number of blocks we are going to
    allocate.  Record number of grabbed blocks in fs-wide and per-thread
    counters.  This function should be called before bitmap scanning or
@@ -265,7 +406,8 @@ static int
 reiser4_grab(reiser4_context * ctx, __u64 count, reiser4_ba_flags_t flags)
 {
 	__u64 free_blocks;
-	int ret = 0, use_reserved = flags & BA_RESERVED;
+	__u64 refill = 0;
+	int use_reserved = flags & BA_RESERVED;
 	reiser4_super_info_data *sbinfo;
 
 	assert("vs-1276", ctx == get_current_context());
@@ -278,35 +420,51 @@ reiser4_grab(reiser4_context * ctx, __u64 count, reiser4_ba_flags_t flags)
 
 	sbinfo = get_super_private(ctx->super);
 
+	if (ctx->grabbed_blocks == 0)
+		ctx->grabbed_reserved = 0;
+	if (grab_from_cache(sbinfo, count)) {
+		add_to_ctx_grabbed(ctx, count);
+		goto grabbed;
+	}
 	spin_lock_reiser4_super(sbinfo);
 
 	free_blocks = sbinfo->blocks_free;
-
+	if (free_blocks < count + (use_reserved ? 0 : sbinfo->blocks_reserved)) {
+		/* cached blocks may be just enough */
+		drain_grab_cache_nolock(sbinfo);
+		free_blocks = sbinfo->blocks_free;
+	}
 	if ((use_reserved && free_blocks < count) ||
 	    (!use_reserved && free_blocks < count + sbinfo->blocks_reserved)) {
-		ret = RETERR(-ENOSPC);
-		goto unlock_and_ret;
+		spin_unlock_reiser4_super(sbinfo);
+		return RETERR(-ENOSPC);
 	}
+	/* never refill the cache from the reserved area */
+	if (free_blocks >= count + sbinfo->blocks_reserved +
+	    REISER4_GRAB_CACHE_BATCH)
+		refill = REISER4_GRAB_CACHE_BATCH;
 
 	add_to_ctx_grabbed(ctx, count);
+	if (use_reserved && free_blocks < count + sbinfo->blocks_reserved)
+		ctx->grabbed_reserved = 1;
 
-	sbinfo->blocks_grabbed += count;
-	sbinfo->blocks_free -= count;
+	sbinfo->blocks_grabbed += count + refill;
+	sbinfo->blocks_free -= count + refill;
 
+	assert("nikita-2986", reiser4_check_block_counters(ctx->super));
+
+	spin_unlock_reiser4_super(sbinfo);
+
+	if (refill && !put_to_cache(sbinfo, refill))
+		grabbed2free_nocache(sbinfo, refill);
+ grabbed:
 #if REISER4_DEBUG
 	if (ctx->grabbed_initially == 0)
 		ctx->grabbed_initially = count;
 #endif
-
-	assert("nikita-2986", reiser4_check_block_counters(ctx->super));
-
 	/* disable grab space in current context */
 	ctx->grab_enabled = 0;
-
-unlock_and_ret:
-	spin_unlock_reiser4_super(sbinfo);
-
-	return ret;
+	return 0;
 }
 
 int reiser4_grab_space(__u64 count, reiser4_ba_flags_t flags)
@@ -328,6 +486,9 @@ int reiser4_grab_space(__u64 count, reiser4_ba_flags_t flags)
 		   present */
 		if (flags & BA_CAN_COMMIT) {
 			txnmgr_force_commit_all(ctx->super, 0);
+			/* blocks waiting for discard are not free yet */
+			if (reiser4_is_set(ctx->super, REISER4_DISCARD))
+				reiser4_flush_discard_queue(ctx->super);
 			ctx->grab_enabled = 1;
 			ret = reiser4_grab(ctx, count, flags);
 		}
@@ -601,18 +762,111 @@ static void flush_reserved2used(txn_atom * atom, __u64 count)
 	spin_unlock_reiser4_super(sbinfo);
 }
 
-/* update the per fs  blocknr hint default value. */
+/* ALLOCATION CURSORS
+
+   Allocations without a preceder start from the default blocknr hint, which
+   follows the last written location. With one hint per volume all parallel
+   flushers start from the same place, contend on the same bitmap block and
+   interleave their blocks. So the volume is split into allocation groups,
+   one per online cpu (but not smaller than REISER4_ALLOC_GROUP_MIN blocks),
+   and each group has its own cursor which starts at the group start.
+
+   A thread picks its group once: flush picks it by the id of the atom being
+   flushed (reiser4_pick_alloc_group()), so that all blocks an atom gets
+   without a preceder come from one group, whichever cpu or thread flushes
+   it, and concurrently flushed atoms use different groups. Other threads
+   use the group of the cpu they first allocate on.
+
+   A cursor follows the allocations of its group, so when the group fills
+   up, the cursor moves on to where free space is. Every
+   REISER4_CURSOR_REHOME a cursor which left its group is moved back to the
+   group start, so that space freed there is reused and cursors do not
+   gather in one place. */
+
+#define REISER4_ALLOC_GROUP_MIN (32768)
+#define REISER4_CURSOR_REHOME (30 * HZ)
+
+int reiser4_init_alloc_cursors(reiser4_super_info_data *sbinfo)
+{
+	int i;
+
+	/* there are never more groups than online cpus */
+	sbinfo->alloc_cursor = kcalloc(nr_cpu_ids,
+				       sizeof(struct reiser4_alloc_cursor),
+				       reiser4_ctx_gfp_mask_get());
+	if (sbinfo->alloc_cursor == NULL)
+		return RETERR(-ENOMEM);
+	for (i = 0; i < nr_cpu_ids; i++)
+		spin_lock_init(&sbinfo->alloc_cursor[i].lock);
+	return 0;
+}
+
+void reiser4_done_alloc_cursors(reiser4_super_info_data *sbinfo)
+{
+	kfree(sbinfo->alloc_cursor);
+	sbinfo->alloc_cursor = NULL;
+}
+
+/* make current thread allocate from the group @key maps to */
+void reiser4_pick_alloc_group(__u32 key)
+{
+	reiser4_context *ctx = get_current_context();
+
+	ctx->alloc_group = key;
+	ctx->alloc_group_set = 1;
+}
+
+/* find allocation group of current thread and return its cursor */
+static struct reiser4_alloc_cursor *
+get_alloc_group(reiser4_super_info_data *sbinfo, reiser4_block_nr *start,
+		reiser4_block_nr *end)
+{
+	reiser4_context *ctx = get_current_context();
+	reiser4_block_nr block_count = sbinfo->block_count;
+	reiser4_block_nr size;
+	unsigned int nr_groups;
+	unsigned int group;
+
+	if (!ctx->alloc_group_set)
+		reiser4_pick_alloc_group(raw_smp_processor_id());
+
+	nr_groups = num_online_cpus();
+	if (block_count < (reiser4_block_nr)nr_groups * REISER4_ALLOC_GROUP_MIN)
+		nr_groups = div64_u64(block_count, REISER4_ALLOC_GROUP_MIN);
+	if (nr_groups <= 1) {
+		*start = 0;
+		*end = block_count;
+		return sbinfo->alloc_cursor;
+	}
+	size = div_u64(block_count, nr_groups);
+	group = ctx->alloc_group % nr_groups;
+	*start = group * size;
+	*end = group == nr_groups - 1 ? block_count : *start + size;
+	return sbinfo->alloc_cursor + group;
+}
+
+/* update the default blocknr hint of current allocation group. */
 void
 update_blocknr_hint_default(const struct super_block *s,
 			    const reiser4_block_nr * block)
 {
 	reiser4_super_info_data *sbinfo = get_super_private(s);
+	struct reiser4_alloc_cursor *cursor;
 
 	assert("nikita-3342", !reiser4_blocknr_is_fake(block));
 
-	spin_lock_reiser4_super(sbinfo);
 	if (*block < sbinfo->block_count) {
-		sbinfo->blocknr_hint_default = *block;
+		reiser4_block_nr start;
+		reiser4_block_nr end;
+
+		cursor = get_alloc_group(sbinfo, &start, &end);
+		spin_lock(&cursor->lock);
+		/* rehome timeout runs while cursor is out of its group */
+		if (!cursor->valid || (*block >= start && *block < end))
+			cursor->rehome = jiffies + REISER4_CURSOR_REHOME;
+		cursor->blk = *block;
+		cursor->valid = 1;
+		spin_unlock(&cursor->lock);
 	} else {
 		warning("zam-676",
 			"block number %llu is too large to be used in a blocknr hint\n",
@@ -620,18 +874,29 @@ update_blocknr_hint_default(const struct super_block *s,
 		dump_stack();
 		DEBUGON(1);
 	}
-	spin_unlock_reiser4_super(sbinfo);
 }
 
 /* get current value of the default blocknr hint. */
 void get_blocknr_hint_default(reiser4_block_nr * result)
 {
 	reiser4_super_info_data *sbinfo = get_current_super_private();
-
-	spin_lock_reiser4_super(sbinfo);
-	*result = sbinfo->blocknr_hint_default;
+	struct reiser4_alloc_cursor *cursor;
+	reiser4_block_nr start;
+	reiser4_block_nr end;
+
+	cursor = get_alloc_group(sbinfo, &start, &end);
+	spin_lock(&cursor->lock);
+	if (!cursor->valid || cursor->blk >= sbinfo->block_count ||
+	    ((cursor->blk < start || cursor->blk >= end) &&
+	     time_after(jiffies, cursor->rehome))) {
+		/* start in (or get back to) allocation group */
+		cursor->blk = start;
+		cursor->rehome = jiffies + REISER4_CURSOR_REHOME;
+		cursor->valid = 1;
+	}
+	*result = cursor->blk;
+	spin_unlock(&cursor->lock);
 	assert("zam-677", *result < sbinfo->block_count);
-	spin_unlock_reiser4_super(sbinfo);
 }
 
 /* Allocate "real" disk blocks by calling a proper space allocation plugin
@@ -724,25 +989,217 @@ reiser4_alloc_blocks(reiser4_blocknr_hint * hint, reiser4_block_nr * blk,
 	return ret;
 }
 
+/* PER-FILE ALLOCATION WINDOWS
+
+   When several files are appended in parallel, their unformatted nodes are
+   flushed in turn and allocated right after the same preceder, so their
+   extents interleave. To prevent that, each regular file gets an allocation
+   window (see struct reiser4_alloc_window). Windows are opened one after
+   another at the per-super block window cursor, and sized from the file's
+   growth: when a window is used up within REISER4_WINDOW_FAST, the next one
+   is twice as big, otherwise it is as big as what was used from it.
+
+   Windows are released when the file is closed and are not used when free
+   space is low. */
+
+#define REISER4_WINDOW_MIN_SIZE (256)
+#define REISER4_WINDOW_MAX_SIZE (16384)
+#define REISER4_WINDOW_FAST (5 * HZ)
+/* don't use windows when less than 1/REISER4_WINDOW_LOW_SPACE of the volume
+   is free */
+#define REISER4_WINDOW_LOW_SPACE (20)
+
+void reiser4_init_alloc_window(struct reiser4_alloc_window *win)
+{
+	spin_lock_init(&win->guard);
+	win->next = win->end = 0;
+	win->used = 0;
+	win->size = REISER4_WINDOW_MIN_SIZE;
+	win->opened = 0;
+	win->users = 0;
+}
+
+/* drop the window, give its unused tail back to the window cursor if nobody
+   opened a window after it */
+static void close_alloc_window(reiser4_super_info_data *sbinfo,
+			       struct reiser4_alloc_window *win)
+{
+	assert_spin_locked(&win->guard);
+
+	if (win->end == 0)
+		return;
+	spin_lock_reiser4_super(sbinfo);
+	if (sbinfo->alloc_window_cursor == win->end)
+		sbinfo->alloc_window_cursor = win->next;
+	spin_unlock_reiser4_super(sbinfo);
+	win->next = win->end = 0;
+}
+
+void reiser4_release_alloc_window(struct super_block *super,
+				  struct reiser4_alloc_window *win)
+{
+	spin_lock(&win->guard);
+	close_alloc_window(get_super_private(super), win);
+	win->size = REISER4_WINDOW_MIN_SIZE;
+	spin_unlock(&win->guard);
+}
+
+/* drop the window pinned by unformatted_alloc_window() */
+void reiser4_put_alloc_window(struct reiser4_alloc_window *win)
+{
+	reiser4_super_info_data *sbinfo = get_current_super_private();
+	int last;
+
+	spin_lock(&sbinfo->window_lock);
+	assert("jalex-45", win->users > 0);
+	last = (--win->users == 0);
+	spin_unlock(&sbinfo->window_lock);
+	if (last)
+		wake_up(&sbinfo->window_wait);
+}
+
+static int alloc_window_unused(reiser4_super_info_data *sbinfo,
+			       struct reiser4_alloc_window *win)
+{
+	int ret;
+
+	spin_lock(&sbinfo->window_lock);
+	ret = (win->users == 0);
+	spin_unlock(&sbinfo->window_lock);
+	return ret;
+}
+
+/**
+ * reiser4_done_alloc_window - release window of a file being destroyed
+ * @super: super block of the file
+ * @win: allocation window of the file
+ *
+ * The file has no jnodes left, so flush can not find the window anymore.
+ * Waits for flushers which found it before.
+ */
+void reiser4_done_alloc_window(struct super_block *super,
+			       struct reiser4_alloc_window *win)
+{
+	reiser4_super_info_data *sbinfo = get_super_private(super);
+
+	wait_event(sbinfo->window_wait, alloc_window_unused(sbinfo, win));
+	reiser4_release_alloc_window(super, win);
+}
+
+/* open new window after the window cursor, or after @near if the cursor is
+   behind it */
+static void open_alloc_window(reiser4_super_info_data *sbinfo,
+			      struct reiser4_alloc_window *win,
+			      reiser4_block_nr near)
+{
+	reiser4_block_nr size;
+
+	assert_spin_locked(&win->guard);
+
+	size = win->size;
+	if (win->end != 0) {
+		/* previous window is used up: size the new one after it */
+		if (time_before(jiffies, win->opened + REISER4_WINDOW_FAST))
+			size = win->used << 1;
+		else
+			size = win->used;
+		size = clamp_t(reiser4_block_nr, size,
+			       REISER4_WINDOW_MIN_SIZE,
+			       REISER4_WINDOW_MAX_SIZE);
+	}
+	spin_lock_reiser4_super(sbinfo);
+	if (sbinfo->alloc_window_cursor < near ||
+	    sbinfo->alloc_window_cursor + size > sbinfo->block_count)
+		sbinfo->alloc_window_cursor = near;
+	win->next = sbinfo->alloc_window_cursor;
+	sbinfo->alloc_window_cursor += size;
+	win->end = sbinfo->alloc_window_cursor;
+	spin_unlock_reiser4_super(sbinfo);
+
+	win->size = size;
+	win->used = 0;
+	win->opened = jiffies;
+}
+
+static int low_space_for_windows(reiser4_super_info_data *sbinfo)
+{
+	return sbinfo->blocks_free * REISER4_WINDOW_LOW_SPACE <
+		sbinfo->block_count;
+}
+
+/* try to allocate @wanted_count blocks from the allocation window @win.
+   Returns 0 on success */
+static int alloc_from_window(struct reiser4_alloc_window *win,
+			     reiser4_blocknr_hint *preceder,
+			     reiser4_block_nr wanted_count,
+			     reiser4_block_nr *first_allocated,
+			     reiser4_block_nr *allocated)
+{
+	reiser4_super_info_data *sbinfo = get_current_super_private();
+	reiser4_block_nr start;
+	reiser4_block_nr end;
+	reiser4_blocknr_hint hint;
+	int ret;
+
+	spin_lock(&win->guard);
+	if (low_space_for_windows(sbinfo)) {
+		close_alloc_window(sbinfo, win);
+		spin_unlock(&win->guard);
+		return RETERR(-ENOSPC);
+	}
+	if (win->next >= win->end)
+		open_alloc_window(sbinfo, win, preceder->blk);
+	start = win->next;
+	end = win->end;
+	spin_unlock(&win->guard);
+
+	hint = *preceder;
+	hint.blk = start;
+	hint.max_dist = end - start;
+	*allocated = wanted_count;
+	ret = reiser4_alloc_blocks(&hint, first_allocated, allocated,
+				   BA_PERMANENT);
+
+	spin_lock(&win->guard);
+	if (win->end == end) {
+		if (ret == 0) {
+			win->next = *first_allocated + *allocated;
+			win->used += *allocated;
+		} else
+			/* window was taken by other allocations, next
+			   attempt will open a new one */
+			win->next = win->end;
+	}
+	spin_unlock(&win->guard);
+	return ret;
+}
+
 /**
  * ask block allocator for some unformatted blocks
+ *
+ * If @win is not NULL, blocks are taken from that allocation window first.
  */
 void allocate_blocks_unformatted(reiser4_blocknr_hint *preceder,
 				 reiser4_block_nr wanted_count,
 				 reiser4_block_nr *first_allocated,
 				 reiser4_block_nr *allocated,
-				 block_stage_t block_stage)
+				 block_stage_t block_stage,
+				 struct reiser4_alloc_window *win)
 {
-	*allocated = wanted_count;
-	preceder->max_dist = 0;	/* scan whole disk, if needed */
-
 	/* that number of blocks (wanted_count) is either in UNALLOCATED or in GRABBED */
 	preceder->block_stage = block_stage;
 
-	/* FIXME: we do not handle errors here now */
-	check_me("vs-420",
-		 reiser4_alloc_blocks(preceder, first_allocated, allocated,
-				      BA_PERMANENT) == 0);
+	if (win == NULL ||
+	    alloc_from_window(win, preceder, wanted_count,
+			      first_allocated, allocated) != 0) {
+		*allocated = wanted_count;
+		preceder->max_dist = 0;	/* scan whole disk, if needed */
+
+		/* FIXME: we do not handle errors here now */
+		check_me("vs-420",
+			 reiser4_alloc_blocks(preceder, first_allocated,
+					      allocated, BA_PERMANENT) == 0);
+	}
 	/* update flush_pos's preceder to last allocated block number */
 	preceder->blk = *first_allocated + *allocated - 1;
 }
@@ -850,13 +1307,13 @@ void grabbed2free(reiser4_context *ctx, reiser4_super_info_data *sbinfo,
 {
 	sub_from_ctx_grabbed(ctx, count);
 
-	spin_lock_reiser4_super(sbinfo);
-
-	sub_from_sb_grabbed(sbinfo, count);
-	sbinfo->blocks_free += count;
-	assert("nikita-2684", reiser4_check_block_counters(ctx->super));
-
-	spin_unlock_reiser4_super(sbinfo);
+	if (count == 0)
+		return;
+	/* blocks of reserved area go back to ->blocks_free, otherwise
+	   ordinary grabs could take them from the cache */
+	if (!ctx->grabbed_reserved && put_to_cache(sbinfo, count))
+		return;
+	grabbed2free_nocache(sbinfo, count);
 }
 
 void grabbed2flush_reserved_nolock(txn_atom * atom, __u64 count)
@@ -1084,8 +1541,18 @@ reiser4_dealloc_blocks(const reiser4_block_nr * start,
 int reiser4_pre_commit_hook(void)
 {
 	assert("zam-502", get_current_super_private() != NULL);
-	sa_pre_commit_hook();
-	return 0;
+	return sa_pre_commit_hook();
+}
+
+/* complete deferred deallocation of @len blocks starting from @start */
+void reiser4_dealloc_deferred_blocks(reiser4_block_nr start,
+				     reiser4_block_nr len)
+{
+	reiser4_super_info_data *sbinfo = get_current_super_private();
+
+	sa_dealloc_blocks(&sbinfo->space_allocator, start, len);
+	/* adjust sb block counters */
+	used2free(sbinfo, len);
 }
 
 /* an actor which applies delete set to block allocator data */
@@ -1116,9 +1583,7 @@ apply_dset(txn_atom * atom UNUSED_ARG, const reiser4_block_nr * a,
 		spin_unlock_reiser4_super(sbinfo);
 	}
 
-	sa_dealloc_blocks(&sbinfo->space_allocator, *a, len);
-	/* adjust sb block counters */
-	used2free(sbinfo, len);
+	reiser4_dealloc_deferred_blocks(*a, len);
 	return 0;
 }
 
@@ -1142,7 +1607,14 @@ void reiser4_post_write_back_hook(void)
 	txn_atom *atom;
 	int ret;
 
-	/* process and issue discard requests */
+	/* hand delete set over to the discard queue. Its blocks are
+	   deallocated once they are discarded */
+	do {
+		atom = get_current_atom_locked();
+		ret = discard_atom_queue(atom);
+	} while (ret == -E_REPEAT);
+
+	/* process and issue discard requests for the rest */
 	blocknr_list_init (&discarded_set);
 	do {
 		atom = get_current_atom_locked();
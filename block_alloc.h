@@ -57,6 +57,31 @@ struct reiser4_blocknr_hint {
 
 };
 
+/*
+ * Allocation window of a regular file: a range of disk blocks flush takes
+ * blocks for the file's unformatted nodes from, so that extents of files
+ * appended in parallel do not interleave. The window is a soft reservation:
+ * its blocks are not marked in bitmaps and other allocations may take them,
+ * which only makes the window shorter. Nothing is committed to disk until
+ * blocks of the window get allocated.
+ */
+struct reiser4_alloc_window {
+	spinlock_t guard;
+	/* next block to allocate from the window */
+	reiser4_block_nr next;
+	/* first block after the window, 0 if there is no window */
+	reiser4_block_nr end;
+	/* number of blocks allocated from the current window */
+	reiser4_block_nr used;
+	/* size of the current window */
+	reiser4_block_nr size;
+	/* when the current window was opened (jiffies) */
+	unsigned long opened;
+	/* number of flushers using the window, protected by super block's
+	   ->window_lock */
+	int users;
+};
+
 /* These flags control block allocation/deallocation behavior */
 enum reiser4_ba_flags {
 	/* do allocatations from reserved (5%) area */
@@ -89,6 +114,9 @@ extern void reiser4_blocknr_hint_done(reiser4_blocknr_hint * hint);
 extern void update_blocknr_hint_default(const struct super_block *,
 					const reiser4_block_nr *);
 extern void get_blocknr_hint_default(reiser4_block_nr *);
+extern void reiser4_pick_alloc_group(__u32 key);
+extern int reiser4_init_alloc_cursors(reiser4_super_info_data *);
+extern void reiser4_done_alloc_cursors(reiser4_super_info_data *);
 
 extern reiser4_block_nr reiser4_fs_reserved_space(struct super_block *super);
 
@@ -99,6 +127,8 @@ reiser4_block_nr fake_blocknr_unformatted(int);
 
 int reiser4_grab_space(__u64 count, reiser4_ba_flags_t flags);
 void all_grabbed2free(void);
+void reiser4_dealloc_deferred_blocks(reiser4_block_nr start,
+				     reiser4_block_nr len);
 void grabbed2free(reiser4_context * , reiser4_super_info_data * , __u64 count);
 void fake_allocated2free(__u64 count, reiser4_ba_flags_t flags);
 void grabbed2flush_reserved_nolock(txn_atom * atom, __u64 count);
@@ -150,6 +180,11 @@ extern void cluster_reserved2free(int count);
 
 extern int reiser4_check_block_counters(const struct super_block *);
 
+extern int reiser4_init_grab_cache(reiser4_super_info_data *);
+extern void reiser4_done_grab_cache(reiser4_super_info_data *);
+extern void reiser4_drain_grab_cache(reiser4_super_info_data *);
+extern __u64 reiser4_grab_cache_count(const reiser4_super_info_data *);
+
 
 extern int reiser4_check_blocks(const reiser4_block_nr *start,
                                 const reiser4_block_nr *len, int desired);
@@ -160,6 +195,13 @@ static inline int reiser4_check_block(const reiser4_block_nr *start,
 	return reiser4_check_blocks(start, NULL, desired);
 }
 
+extern void reiser4_init_alloc_window(struct reiser4_alloc_window *);
+extern void reiser4_release_alloc_window(struct super_block *,
+					 struct reiser4_alloc_window *);
+extern void reiser4_put_alloc_window(struct reiser4_alloc_window *);
+extern void reiser4_done_alloc_window(struct super_block *,
+				      struct reiser4_alloc_window *);
+
 extern int reiser4_pre_commit_hook(void);
 extern void reiser4_post_commit_hook(void);
 extern void reiser4_post_write_back_hook(void);
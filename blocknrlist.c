@@ -277,6 +277,32 @@ int blocknr_list_add_extent(txn_atom *atom,
 	return 0;
 }
 
+/**
+ * Removes the first extent from @blist and stores it in @start and @len.
+ * Returns -ENOENT if @blist is empty.
+ */
+int blocknr_list_pop(struct list_head *blist,
+                     reiser4_block_nr *start,
+                     reiser4_block_nr *len)
+{
+	blocknr_list_entry *entry;
+
+	assert("jalex-15", blist != NULL);
+
+	if (list_empty(blist)) {
+		return -ENOENT;
+	}
+
+	entry = blocknr_list_entry(blist->next);
+	*start = entry->start;
+	*len = entry->len;
+
+	list_del_init(&entry->link);
+	blocknr_list_entry_free(entry);
+
+	return 0;
+}
+
 int blocknr_list_iterator(txn_atom *atom,
                           struct list_head *blist,
                           blocknr_set_actor_f actor,
@@ -17,6 +17,8 @@
 #include <linux/spinlock.h>
 #include <linux/sched.h>	/* for struct task_struct */
 
+struct entd_worker;
+
 /* reiser4 per-thread context */
 struct reiser4_context {
 	/* magic constant. For identification of reiser4 contexts. */
@@ -48,6 +50,9 @@ struct reiser4_context {
 
 	/* grabbing space is enabled */
 	unsigned int grab_enabled:1;
+	/* some of grabbed blocks were taken from reserved area. They are not
+	   returned to per-cpu caches of grabbed space */
+	unsigned int grabbed_reserved:1;
 	/* should be set when we are write dirty nodes to disk in jnode_flush or
 	 * reiser4_write_logs() */
 	unsigned int writeout_mode:1;
@@ -63,6 +68,14 @@ struct reiser4_context {
 	   kmalloc-ed and has to be kfree-ed */
 	unsigned int on_stack:1;
 
+	/* ->alloc_group is chosen */
+	unsigned int alloc_group_set:1;
+	/* allocation group of this thread, see block_alloc.c */
+	unsigned int alloc_group;
+
+	/* ent thread this context runs in, if ->entd is set */
+	struct entd_worker *entd_worker;
+
 	/* count non-trivial jnode_set_dirty() calls */
 	unsigned long nr_marked_dirty;
 	/*
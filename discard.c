@@ -68,6 +68,30 @@
  * - elements of the discard set are sorted;
  * - the discard set is iterated, joining any adjacent extents;
  * - for each extent, a single call to blkdev_issue_discard() is done.
+ *
+ * DISCARD QUEUE:
+ *
+ * Discarding synchronously adds device latency to every commit. So normally
+ * the discard set is not discarded at commit time, but moved to the discard
+ * queue of the super block instead, and deferred deallocation of its blocks
+ * is postponed until they are discarded. This way queued blocks can not be
+ * reused before they are discarded.
+ *
+ * The queue accumulates extents of many atoms, so that adjacent extents freed
+ * by different atoms get merged. A background work sorts and joins queued
+ * extents, trims them to the device erase unit lattice and discards them,
+ * REISER4_DISCARD_BATCH blocks at most per REISER4_DISCARD_INTERVAL. Each
+ * discarded extent is deallocated right after that.
+ *
+ * If the queue grows above REISER4_DISCARD_QUEUE_MAX blocks, or the file
+ * system is being unmounted, atoms are discarded synchronously as described
+ * above. The queue is also flushed when space is about to run out (see
+ * reiser4_grab_space()) and on umount.
+ *
+ * FITRIM:
+ *
+ * reiser4_trim_fs() implements the FITRIM ioctl: space allocator walks its
+ * free space and discards all free extents which are long enough.
  */
 
 #include "discard.h"
@@ -75,6 +99,7 @@
 #include "debug.h"
 #include "txnmgr.h"
 #include "super.h"
+#include "block_alloc.h"
 
 #include <linux/slab.h>
 #include <linux/fs.h>
@@ -167,6 +192,264 @@ void discard_atom_post(txn_atom *atom, struct list_head *processed_set)
 	spin_unlock_atom(atom);
 }
 
+/* do not queue more blocks than that */
+#define REISER4_DISCARD_QUEUE_MAX (1 << 18)
+/* maximal number of blocks discarded per run of discard work */
+#define REISER4_DISCARD_BATCH (1 << 14)
+/* delay between runs of discard work */
+#define REISER4_DISCARD_INTERVAL (HZ / 10)
+/* delay before discard of newly queued extents */
+#define REISER4_DISCARD_DELAY (HZ)
+
+/* trim sector range [@start, @start + @len) to whole erase units of @bdev */
+static void align_to_erase_units(struct block_device *bdev, sector_t *start,
+				 sector_t *len)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	sector_t gran = q->limits.discard_granularity >> 9;
+	sector_t off = bdev_discard_alignment(bdev) >> 9;
+	sector_t end = *start + *len;
+	sector_t tmp;
+	sector_t rem;
+
+	if (gran <= 1)
+		return;
+	off = sector_div(off, gran);
+
+	/* erase units start at sectors which are equal to @off modulo @gran */
+	tmp = *start + gran - off;
+	rem = sector_div(tmp, gran);
+	if (rem != 0)
+		*start += gran - rem;
+
+	tmp = end + gran - off;
+	rem = sector_div(tmp, gran);
+	end -= rem;
+
+	*len = end > *start ? end - *start : 0;
+}
+
+/**
+ * reiser4_discard_blocks - discard erase units within block extent
+ * @sb: super block
+ * @start: first block of the extent
+ * @len: length of the extent
+ * @discarded: if not NULL, number of discarded bytes is added to it
+ *
+ * Partial erase units at head and tail of the extent are not discarded.
+ */
+int reiser4_discard_blocks(struct super_block *sb, reiser4_block_nr start,
+			   reiser4_block_nr len, __u64 *discarded)
+{
+	const int sec_per_blk = sb->s_blocksize >> 9;
+	sector_t start_sec = start * sec_per_blk;
+	sector_t len_sec = len * sec_per_blk;
+	int ret;
+
+	assert("jalex-16", sec_per_blk > 0);
+
+	align_to_erase_units(sb->s_bdev, &start_sec, &len_sec);
+	if (len_sec == 0)
+		return 0;
+	ret = __discard_extent(sb->s_bdev, start_sec, len_sec);
+	if (ret == 0 && discarded != NULL)
+		*discarded += (__u64)len_sec << 9;
+	return ret;
+}
+
+static int count_blocks(txn_atom *atom UNUSED_ARG,
+			const reiser4_block_nr *start UNUSED_ARG,
+			const reiser4_block_nr *len, void *data)
+{
+	*(__u64 *)data += *len;
+	return 0;
+}
+
+int discard_atom_queue(txn_atom *atom)
+{
+	struct super_block *sb = reiser4_get_current_sb();
+	struct reiser4_discard_queue *queue;
+	__u64 nr_blocks = 0;
+	int ret = -E_REPEAT;
+
+	assert("jalex-17", atom != NULL);
+
+	if (!reiser4_is_set(sb, REISER4_DISCARD) ||
+	    list_empty(&atom->discard.delete_set)) {
+		spin_unlock_atom(atom);
+		return 0;
+	}
+
+	queue = &get_super_private(sb)->discard_queue;
+	blocknr_list_iterator(atom, &atom->discard.delete_set, count_blocks,
+			      &nr_blocks, 0);
+
+	spin_lock(&queue->guard);
+	if (queue->stopped ||
+	    queue->nr_blocks + nr_blocks > REISER4_DISCARD_QUEUE_MAX) {
+		ret = RETERR(-EBUSY);
+	} else {
+		blocknr_list_merge(&atom->discard.delete_set, &queue->extents);
+		queue->nr_blocks += nr_blocks;
+		schedule_delayed_work(&queue->work, REISER4_DISCARD_DELAY);
+	}
+	spin_unlock(&queue->guard);
+	spin_unlock_atom(atom);
+
+	return ret;
+}
+
+/* discard and deallocate at most @budget queued blocks. Called in reiser4
+   context */
+static void process_discard_queue(struct reiser4_discard_queue *queue,
+				  __u64 budget)
+{
+	reiser4_block_nr start;
+	reiser4_block_nr len;
+	struct list_head extents;
+
+	/* the queue may hold many extents: sort them without the lock
+	   committers take to queue their extents */
+	blocknr_list_init(&extents);
+	mutex_lock(&queue->processing);
+	spin_lock(&queue->guard);
+	blocknr_list_merge(&queue->extents, &extents);
+	spin_unlock(&queue->guard);
+
+	if (list_empty(&extents)) {
+		mutex_unlock(&queue->processing);
+		return;
+	}
+	blocknr_list_sort_and_join(&extents);
+	while (budget != 0 && blocknr_list_pop(&extents, &start, &len) == 0) {
+		/* discard is advisory, errors are ignored */
+		reiser4_discard_blocks(queue->super, start, len, NULL);
+		reiser4_dealloc_deferred_blocks(start, len);
+
+		budget = budget > len ? budget - len : 0;
+		spin_lock(&queue->guard);
+		queue->nr_blocks -= len;
+		queue->nr_discarded += len;
+		spin_unlock(&queue->guard);
+	}
+
+	/* put back what is left for the next run */
+	spin_lock(&queue->guard);
+	blocknr_list_merge(&extents, &queue->extents);
+	spin_unlock(&queue->guard);
+	mutex_unlock(&queue->processing);
+}
+
+static void discard_work(struct work_struct *work)
+{
+	struct reiser4_discard_queue *queue;
+	reiser4_context *ctx;
+
+	queue = container_of(to_delayed_work(work),
+			     struct reiser4_discard_queue, work);
+
+	ctx = reiser4_init_context(queue->super);
+	if (IS_ERR(ctx)) {
+		schedule_delayed_work(&queue->work, REISER4_DISCARD_INTERVAL);
+		return;
+	}
+	process_discard_queue(queue, REISER4_DISCARD_BATCH);
+
+	spin_lock(&queue->guard);
+	if (queue->nr_blocks != 0 && !queue->stopped)
+		schedule_delayed_work(&queue->work, REISER4_DISCARD_INTERVAL);
+	spin_unlock(&queue->guard);
+
+	reiser4_exit_context(ctx);
+}
+
+void reiser4_init_discard_queue(struct super_block *super)
+{
+	struct reiser4_discard_queue *queue;
+
+	queue = &get_super_private(super)->discard_queue;
+	spin_lock_init(&queue->guard);
+	blocknr_list_init(&queue->extents);
+	queue->nr_blocks = 0;
+	mutex_init(&queue->processing);
+	queue->nr_discarded = 0;
+	queue->stopped = 0;
+	queue->super = super;
+	INIT_DELAYED_WORK(&queue->work, discard_work);
+}
+
+/* discard and deallocate all queued blocks now */
+void reiser4_flush_discard_queue(struct super_block *super)
+{
+	process_discard_queue(&get_super_private(super)->discard_queue,
+			      ~0ULL);
+}
+
+/* stop background discard and flush the queue. Called on umount in reiser4
+   context, after that atoms are discarded synchronously */
+void reiser4_done_discard_queue(struct super_block *super)
+{
+	struct reiser4_discard_queue *queue;
+
+	queue = &get_super_private(super)->discard_queue;
+
+	spin_lock(&queue->guard);
+	queue->stopped = 1;
+	spin_unlock(&queue->guard);
+
+	cancel_delayed_work_sync(&queue->work);
+	reiser4_flush_discard_queue(super);
+	assert("jalex-18", list_empty(&queue->extents));
+}
+
+/**
+ * reiser4_trim_fs - discard free space
+ * @super: super block
+ * @range: byte range of the volume to trim, see FITRIM ioctl
+ *
+ * Discards all free extents within @range which are not shorter than
+ * @range->minlen. On return @range->len is set to the number of discarded
+ * bytes.
+ */
+int reiser4_trim_fs(struct super_block *super, struct fstrim_range *range)
+{
+	struct request_queue *q = bdev_get_queue(super->s_bdev);
+	reiser4_block_nr start;
+	reiser4_block_nr end;
+	reiser4_block_nr minlen;
+	__u64 trimmed = 0;
+	int ret;
+
+	if (!blk_queue_discard(q))
+		return RETERR(-EOPNOTSUPP);
+
+	start = range->start >> super->s_blocksize_bits;
+	if (start >= reiser4_block_count(super))
+		return RETERR(-EINVAL);
+	if (range->len >> super->s_blocksize_bits <
+	    reiser4_block_count(super) - start)
+		end = start + (range->len >> super->s_blocksize_bits);
+	else
+		end = reiser4_block_count(super);
+	minlen = range->minlen >> super->s_blocksize_bits;
+	if (minlen < (q->limits.discard_granularity >> super->s_blocksize_bits))
+		minlen = q->limits.discard_granularity >>
+			super->s_blocksize_bits;
+	if (minlen == 0)
+		minlen = 1;
+
+	/* block 0 is never free */
+	if (start == 0)
+		start = 1;
+	if (start >= end)
+		return RETERR(-EINVAL);
+
+	ret = sa_trim_blocks(reiser4_get_space_allocator(super),
+			     start, end, minlen, &trimmed);
+	range->len = trimmed;
+	return ret;
+}
+
 /* Make Linus happy.
    Local variables:
    c-indentation-style: "K&R"
@@ -9,6 +9,8 @@
 #include "forward.h"
 #include "dformat.h"
 
+#include <linux/fs.h>
+
 /**
  * Issue discard requests for all block extents recorded in @atom's delete sets,
  * if discard is enabled. The extents processed are removed from the @atom's
@@ -28,6 +30,26 @@ extern int discard_atom(txn_atom *atom, struct list_head *processed_set);
  */
 extern void discard_atom_post(txn_atom *atom, struct list_head *processed_set);
 
+/**
+ * Moves extents of @atom's delete set to the discard queue of the super block.
+ * Queued blocks remain allocated until they are discarded in background.
+ * Returns -E_REPEAT if anything was queued, -EBUSY if the queue does not
+ * accept extents (it is full or being shut down), 0 if there is nothing to
+ * queue. The extents left in the delete set are to be discarded by
+ * discard_atom().
+ *
+ * @atom must be locked on entry and is unlocked on exit.
+ */
+extern int discard_atom_queue(txn_atom *atom);
+
+extern void reiser4_init_discard_queue(struct super_block *);
+extern void reiser4_done_discard_queue(struct super_block *);
+extern void reiser4_flush_discard_queue(struct super_block *);
+extern int reiser4_discard_blocks(struct super_block *,
+				  reiser4_block_nr start, reiser4_block_nr len,
+				  __u64 *discarded);
+extern int reiser4_trim_fs(struct super_block *, struct fstrim_range *);
+
 /* __FS_REISER4_DISCARD_H__ */
 #endif
 
@@ -23,11 +23,21 @@
 #include <linux/wait.h>
 #include <linux/kthread.h>
 #include <linux/freezer.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
 
 #define DEF_PRIORITY 12
 #define MAX_ENTD_ITERS 10
 
-static void entd_flush(struct super_block *, struct wbq *);
+/* Ent threads work as a pool: there is one thread per cpu, but not more than
+ * ENTD_MAX_WORKERS and not more than one per ENTD_QUEUE_PER_WORKER requests
+ * of the device queue. Each request is served by one thread, and two threads
+ * do not flush the same atom at the same time (see entd_claim_atom()). */
+#define ENTD_MAX_WORKERS (8)
+#define ENTD_QUEUE_PER_WORKER (32)
+
+static void entd_flush(struct super_block *, struct entd_worker *,
+		       struct wbq *);
 static int entd(void *arg);
 
 /*
@@ -37,16 +47,40 @@ static int entd(void *arg);
 	snprintf(current->comm, sizeof(current->comm),	\
 		"ent:%s%s", super->s_id, (state))
 
+/* number of ent threads to start for @super */
+static int entd_nr_workers(struct super_block *super)
+{
+	int nr;
+
+	nr = min_t(int, num_online_cpus(), ENTD_MAX_WORKERS);
+	if (super->s_bdev != NULL)
+		nr = min_t(int, nr,
+			   bdev_get_queue(super->s_bdev)->nr_requests /
+			   ENTD_QUEUE_PER_WORKER);
+	return max(nr, 1);
+}
+
+static void stop_entd_workers(entd_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->nr_workers; i++)
+		kthread_stop(ctx->workers[i].tsk);
+	kfree(ctx->workers);
+	ctx->workers = NULL;
+	ctx->nr_workers = 0;
+}
+
 /**
- * reiser4_init_entd - initialize entd context and start kernel daemon
- * @super: super block to start ent thread for
+ * reiser4_init_entd - initialize entd context and start kernel daemons
+ * @super: super block to start ent threads for
  *
- * Creates entd contexts, starts kernel thread and waits until it
- * initializes.
+ * Creates entd contexts, starts pool of kernel threads.
  */
 int reiser4_init_entd(struct super_block *super)
 {
 	entd_context *ctx;
+	int nr;
 
 	assert("nikita-3104", super != NULL);
 
@@ -54,6 +88,7 @@ int reiser4_init_entd(struct super_block *super)
 
 	memset(ctx, 0, sizeof *ctx);
 	spin_lock_init(&ctx->guard);
+	spin_lock_init(&ctx->atom_guard);
 	init_waitqueue_head(&ctx->wait);
 #if REISER4_DEBUG
 	INIT_LIST_HEAD(&ctx->flushers_list);
@@ -61,10 +96,25 @@ int reiser4_init_entd(struct super_block *super)
 	/* lists of writepage requests */
 	INIT_LIST_HEAD(&ctx->todo_list);
 	INIT_LIST_HEAD(&ctx->done_list);
+
+	nr = entd_nr_workers(super);
+	ctx->workers = kcalloc(nr, sizeof(struct entd_worker), GFP_KERNEL);
+	if (ctx->workers == NULL)
+		return RETERR(-ENOMEM);
 	/* start entd */
-	ctx->tsk = kthread_run(entd, super, "ent:%s", super->s_id);
-	if (IS_ERR(ctx->tsk))
-		return PTR_ERR(ctx->tsk);
+	for (; ctx->nr_workers < nr; ctx->nr_workers++) {
+		struct entd_worker *worker = ctx->workers + ctx->nr_workers;
+
+		worker->super = super;
+		worker->tsk = kthread_run(entd, worker, "ent:%s/%d",
+					  super->s_id, ctx->nr_workers);
+		if (IS_ERR(worker->tsk)) {
+			int result = PTR_ERR(worker->tsk);
+
+			stop_entd_workers(ctx);
+			return result;
+		}
+	}
 	return 0;
 }
 
@@ -91,11 +141,12 @@ static struct wbq *__get_wbq(entd_context * ent)
 /* ent thread function */
 static int entd(void *arg)
 {
+	struct entd_worker *worker = arg;
 	struct super_block *super;
 	entd_context *ent;
 	int done = 0;
 
-	super = arg;
+	super = worker->super;
 	/* do_fork() just copies task_struct into the new
 	   thread. ->fs_context shouldn't be copied of course. This shouldn't
 	   be a problem for the rest of the code though.
@@ -111,17 +162,16 @@ static int entd(void *arg)
 		while (ent->nr_todo_reqs != 0) {
 			struct wbq *rq;
 
-			assert("", list_empty(&ent->done_list));
-
 			/* take request from the queue head */
 			rq = __get_wbq(ent);
 			assert("", rq != NULL);
-			ent->cur_request = rq;
+			worker->request = rq;
 			spin_unlock(&ent->guard);
 
 			entd_set_comm("!");
-			entd_flush(super, rq);
+			entd_flush(super, worker, rq);
 
+			worker->request = NULL;
 			put_wbq(rq);
 
 			/*
@@ -146,7 +196,8 @@ static int entd(void *arg)
 			DEFINE_WAIT(__wait);
 
 			do {
-				prepare_to_wait(&ent->wait, &__wait, TASK_INTERRUPTIBLE);
+				prepare_to_wait_exclusive(&ent->wait, &__wait,
+							  TASK_INTERRUPTIBLE);
 				if (kthread_should_stop()) {
 					done = 1;
 					break;
@@ -158,16 +209,15 @@ static int entd(void *arg)
 			finish_wait(&ent->wait, &__wait);
 		}
 	}
-	BUG_ON(ent->nr_todo_reqs != 0);
 	return 0;
 }
 
 /**
- * reiser4_done_entd - stop entd kernel thread
- * @super: super block to stop ent thread for
+ * reiser4_done_entd - stop entd kernel threads
+ * @super: super block to stop ent threads for
  *
- * It is called on umount. Sends stop signal to entd and wait until it handles
- * it.
+ * It is called on umount. Sends stop signal to ent threads and waits until
+ * they handle it.
  */
 void reiser4_done_entd(struct super_block *super)
 {
@@ -176,8 +226,47 @@ void reiser4_done_entd(struct super_block *super)
 	assert("nikita-3103", super != NULL);
 
 	ent = get_entd_context(super);
-	assert("zam-1055", ent->tsk != NULL);
-	kthread_stop(ent->tsk);
+	assert("zam-1055", ent->workers != NULL);
+	stop_entd_workers(ent);
+	BUG_ON(ent->nr_todo_reqs != 0);
+}
+
+/**
+ * entd_claim_atom - register atom the current ent thread is going to flush
+ * @super: super block
+ * @atom: atom to be flushed
+ *
+ * Returns 0 on success, -EBUSY if another ent thread is flushing @atom
+ * already: parallel flushes of one atom only contend on its nodes.
+ */
+int entd_claim_atom(struct super_block *super, txn_atom *atom)
+{
+	entd_context *ent = get_entd_context(super);
+	struct entd_worker *self = get_current_context()->entd_worker;
+	int result = 0;
+	int i;
+
+	spin_lock(&ent->atom_guard);
+	for (i = 0; i < ent->nr_workers; i++) {
+		if (ent->workers + i != self && ent->workers[i].atom == atom) {
+			result = RETERR(-EBUSY);
+			break;
+		}
+	}
+	if (result == 0)
+		self->atom = atom;
+	spin_unlock(&ent->atom_guard);
+	return result;
+}
+
+/* the current ent thread is done with atom it flushed */
+void entd_release_atom(struct super_block *super)
+{
+	entd_context *ent = get_entd_context(super);
+
+	spin_lock(&ent->atom_guard);
+	get_current_context()->entd_worker->atom = NULL;
+	spin_unlock(&ent->atom_guard);
 }
 
 /* called at the beginning of jnode_flush to register flusher thread with ent
@@ -218,17 +307,19 @@ void reiser4_leave_flush(struct super_block *super)
 #endif
 	spin_unlock(&ent->guard);
 	if (wake_up_ent)
-		wake_up_process(ent->tsk);
+		wake_up(&ent->wait);
 }
 
 #define ENTD_CAPTURE_APAGE_BURST SWAP_CLUSTER_MAX
 
-static void entd_flush(struct super_block *super, struct wbq *rq)
+static void entd_flush(struct super_block *super, struct entd_worker *worker,
+		       struct wbq *rq)
 {
 	reiser4_context ctx;
 
 	init_stack_context(&ctx, super);
 	ctx.entd = 1;
+	ctx.entd_worker = worker;
 	ctx.gfp_mask = GFP_NOFS;
 
 	rq->wbc->range_start = page_offset(rq->page);
@@ -289,6 +380,8 @@ int write_page_by_ent(struct page *page, struct writeback_control *wbc)
 	struct inode *inode;
 	entd_context *ent;
 	struct wbq rq;
+	ktime_t queued;
+	__u64 latency;
 
 	assert("", PageLocked(page));
 	assert("", page->mapping != NULL);
@@ -326,17 +419,27 @@ int write_page_by_ent(struct page *page, struct writeback_control *wbc)
 	init_completion(&rq.completion);
 
 	/* add request to entd's list of writepage requests */
+	queued = ktime_get();
 	spin_lock(&ent->guard);
 	ent->nr_todo_reqs++;
+	if (ent->nr_todo_reqs > ent->max_todo_reqs)
+		ent->max_todo_reqs = ent->nr_todo_reqs;
 	list_add_tail(&rq.link, &ent->todo_list);
-	if (ent->nr_todo_reqs == 1)
-		wake_up_process(ent->tsk);
-
 	spin_unlock(&ent->guard);
+	/* wake up one idle ent thread, if any */
+	wake_up(&ent->wait);
 
 	/* wait until entd finishes */
 	wait_for_completion(&rq.completion);
 
+	latency = ktime_us_delta(ktime_get(), queued);
+	spin_lock(&ent->guard);
+	ent->nr_served++;
+	ent->total_latency += latency;
+	if (latency > ent->max_latency)
+		ent->max_latency = latency;
+	spin_unlock(&ent->guard);
+
 	if (rq.written)
 		/* Eventually ENTD has written the page to disk. */
 		return 0;
@@ -27,16 +27,30 @@ struct wbq {
 	int written; /* set if ent thread wrote requested page */
 };
 
+/* one of ent threads of a super block */
+struct entd_worker {
+	struct task_struct *tsk;
+	struct super_block *super;
+	/* request being served by this thread */
+	struct wbq *request;
+	/* atom being flushed by this thread, it is only compared with, never
+	 * dereferenced. Protected by entd_context->atom_guard */
+	txn_atom *atom;
+};
+
 /* ent-thread context. This is used to synchronize starting/stopping ent
  * threads. */
 typedef struct entd_context {
-	 /* wait queue that ent thread waits on for more work. It's
+	 /* wait queue that ent threads wait on for more work. It's
 	  * signaled by write_page_by_ent(). */
 	wait_queue_head_t wait;
 	/* spinlock protecting other fields */
 	spinlock_t guard;
-	/* ent thread */
-	struct task_struct *tsk;
+	/* pool of ent threads */
+	struct entd_worker *workers;
+	int nr_workers;
+	/* protects ->atom of workers */
+	spinlock_t atom_guard;
 	/* set to indicate that ent thread should leave. */
 	int done;
 	/* counter of active flushers */
@@ -47,9 +61,16 @@ typedef struct entd_context {
 	 */
 	struct list_head todo_list;
 	/* number of elements on the above list */
-	int nr_todo_reqs;
+	__u32 nr_todo_reqs;
+	/* the longest the above list was */
+	__u32 max_todo_reqs;
+	/* number of served requests */
+	__u64 nr_served;
+	/* total and maximal time requests took from queueing to completion,
+	 * in microseconds */
+	__u64 total_latency;
+	__u64 max_latency;
 
-	struct wbq *cur_request;
 	/*
 	 * when entd writes a page it moves write-back request from todo_list
 	 * to done_list. This list is used at the end of entd iteration to
@@ -76,6 +97,17 @@ extern int wbq_available(void);
 extern void ent_writes_page(struct super_block *, struct page *);
 
 extern jnode *get_jnode_by_wbq(struct super_block *, struct wbq *);
+extern int entd_claim_atom(struct super_block *, txn_atom *);
+extern void entd_release_atom(struct super_block *);
+
+/* request the current ent thread is serving */
+static inline struct wbq *entd_current_request(void)
+{
+	reiser4_context *ctx = get_current_context();
+
+	assert("jalex-24", ctx->entd && ctx->entd_worker != NULL);
+	return ctx->entd_worker->request;
+}
 /* __ENTD_H__ */
 #endif
 
@@ -684,6 +684,129 @@ static txmod_plugin *get_txmod_plugin(void)
    properly rather than restarting, but there are a bunch of cases to audit.
 */
 
+/* ADAPTIVE FLUSH PARAMETERS
+
+   Mount-time flush parameters (sbinfo->flush) can be good either for disks
+   with seek penalty or for solid state devices, but not for both. So the
+   values flush actually uses (sbinfo->flush_adapt) are derived from them at
+   run time:
+
+   - on a non-rotational device relocation costs nothing in seeks, while
+     overwrite costs a second (wandered) write. So the relocate threshold and
+     the relocate distance are lowered to prefer relocation;
+
+   - on a rotational device with little free space left the free space is
+     fragmented, and relocating short slums makes it worse. The relocate
+     threshold is raised until the volume has more free space;
+
+   - the scan limit follows the running average of the slum sizes: there is
+     no reason to scan far when slums are short, and when scans keep hitting
+     the limit it is doubled. The mount-time scan_maxnodes is the upper bound.
+
+   The mount option "dont_adapt_flush" makes flush use mount-time parameters
+   as is. Decisions are counted and exported through debugfs.
+
+   Effective parameters are read and recalculated by concurrent flushers
+   without locking: each of them is a single word accessed with
+   READ_ONCE/WRITE_ONCE, and a lost update of the running average only
+   delays adaptation a little. */
+
+/* lower bound of the adaptive scan limit */
+#define FLUSH_SCAN_MINNODES 128
+/* free space (in percents) below which free space is considered to be
+   fragmented */
+#define FLUSH_LOW_FREE_SPACE 10
+
+/**
+ * reiser4_init_flush_adapt - initialize adaptive flush parameters
+ * @super: super block being mounted
+ *
+ * Is called when mount options are parsed.
+ */
+void reiser4_init_flush_adapt(struct super_block *super)
+{
+	reiser4_super_info_data *sbinfo = get_super_private(super);
+	struct flush_adapt *adapt = &sbinfo->flush_adapt;
+
+	memset(adapt, 0, sizeof(*adapt));
+	atomic64_set(&adapt->nr_slums, 0);
+	atomic64_set(&adapt->nr_scan_limited, 0);
+	atomic64_set(&adapt->nr_leaf_relocate, 0);
+	atomic64_set(&adapt->nr_leaf_overwrite, 0);
+	adapt->nonrot = blk_queue_nonrot(bdev_get_queue(super->s_bdev));
+	adapt->scan_maxnodes = sbinfo->flush.scan_maxnodes;
+	adapt->relocate_threshold = sbinfo->flush.relocate_threshold;
+	adapt->relocate_distance = sbinfo->flush.relocate_distance;
+	adapt->avg_slum = sbinfo->flush.relocate_threshold << 3;
+}
+
+/* relocate distance the txmod plugins should use */
+unsigned reiser4_flush_relocate_distance(reiser4_super_info_data *sbinfo)
+{
+	return READ_ONCE(sbinfo->flush_adapt.relocate_distance);
+}
+
+/* take a snapshot of effective flush parameters */
+static void get_flush_params(reiser4_super_info_data *sbinfo,
+			     struct flush_params *params)
+{
+	params->relocate_threshold =
+		READ_ONCE(sbinfo->flush_adapt.relocate_threshold);
+	params->relocate_distance =
+		READ_ONCE(sbinfo->flush_adapt.relocate_distance);
+	params->written_threshold = sbinfo->flush.written_threshold;
+	params->scan_maxnodes = READ_ONCE(sbinfo->flush_adapt.scan_maxnodes);
+}
+
+/* recalculate effective flush parameters after a slum of @count nodes was
+   scanned. @limited is set when the left scan stopped at the scan limit,
+   @relocate is the decision made about slum leaves. */
+static void update_flush_params(reiser4_super_info_data *sbinfo,
+				unsigned count, int limited, int relocate)
+{
+	struct flush_adapt *adapt = &sbinfo->flush_adapt;
+	const struct flush_params *base = &sbinfo->flush;
+	unsigned threshold;
+	unsigned distance;
+	unsigned long avg_slum;
+	unsigned long scan;
+
+	atomic64_inc(&adapt->nr_slums);
+	if (limited)
+		atomic64_inc(&adapt->nr_scan_limited);
+	if (relocate)
+		atomic64_inc(&adapt->nr_leaf_relocate);
+	else
+		atomic64_inc(&adapt->nr_leaf_overwrite);
+
+	if (reiser4_is_set(sbinfo->tree.super, REISER4_DONT_ADAPT_FLUSH))
+		return;
+	avg_slum = READ_ONCE(adapt->avg_slum) + count;
+	avg_slum -= avg_slum >> 3;
+	WRITE_ONCE(adapt->avg_slum, avg_slum);
+
+	threshold = base->relocate_threshold;
+	distance = base->relocate_distance;
+	if (adapt->nonrot) {
+		threshold = max(threshold >> 2, 1u);
+		distance = max(distance >> 2, 1u);
+	} else if (READ_ONCE(sbinfo->blocks_free) * 100 <
+		   sbinfo->block_count * FLUSH_LOW_FREE_SPACE)
+		/* free block count is a hint here, it is read unlocked */
+		threshold <<= 1;
+	WRITE_ONCE(adapt->relocate_threshold, threshold);
+	WRITE_ONCE(adapt->relocate_distance, distance);
+
+	scan = (avg_slum >> 3) << 2;
+	if (limited)
+		scan = max(scan,
+			   (unsigned long)READ_ONCE(adapt->scan_maxnodes) << 1);
+	scan = max(scan, (unsigned long)max(threshold << 1,
+					    (unsigned)FLUSH_SCAN_MINNODES));
+	WRITE_ONCE(adapt->scan_maxnodes,
+		   min(scan, (unsigned long)base->scan_maxnodes));
+}
+
 static int
 jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 	    flush_queue_t *fq, int flags)
@@ -695,6 +818,7 @@ jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 	int todo;
 	struct super_block *sb;
 	reiser4_super_info_data *sbinfo;
+	struct flush_params params;
 	jnode *leftmost_in_slum = NULL;
 
 	assert("jmacd-76619", lock_stack_isclean(get_current_lock_stack()));
@@ -714,6 +838,7 @@ jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 
 	sb = reiser4_get_current_sb();
 	sbinfo = get_super_private(sb);
+	get_flush_params(sbinfo, &params);
 
 	/* Flush-concurrency debug code */
 #if REISER4_DEBUG
@@ -729,6 +854,7 @@ jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 	flush_pos->fq = fq;
 	flush_pos->flags = flags;
 	flush_pos->nr_to_write = nr_to_write;
+	flush_pos->nr_queued = fq->nr_queued;
 
 	scan_init(right_scan);
 	scan_init(left_scan);
@@ -745,8 +871,7 @@ jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 	   and, hence, is kept during leftward scan. As a result, we have to
 	   use try-lock when taking long term locks during the leftward scan.
 	 */
-	ret = scan_left(left_scan, right_scan,
-			node, sbinfo->flush.scan_maxnodes);
+	ret = scan_left(left_scan, right_scan, node, params.scan_maxnodes);
 	if (ret != 0)
 		goto failed;
 
@@ -760,7 +885,7 @@ jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 	   FLUSH_RELOCATE_THRESHOLD number of nodes are being flushed. The scan
 	   limit is the difference between left_scan.count and the threshold. */
 
-	todo = sbinfo->flush.relocate_threshold - left_scan->count;
+	todo = params.relocate_threshold - left_scan->count;
 	/* scan right is inherently deadlock prone, because we are
 	 * (potentially) holding a lock on the twig node at this moment.
 	 * FIXME: this is incorrect comment: lock is not held */
@@ -778,7 +903,14 @@ jnode_flush(jnode * node, long nr_to_write, long *nr_written,
 	   FLUSH_RELOCATE_THRESHOLD nodes were found. */
 	flush_pos->leaf_relocate = JF_ISSET(node, JNODE_REPACK) ||
 	    (left_scan->count + right_scan->count >=
-	     sbinfo->flush.relocate_threshold);
+	     params.relocate_threshold);
+
+	flush_pos->repack = JF_ISSET(node, JNODE_REPACK);
+	flush_pos->slum_hot = jnode_is_hot(node);
+
+	update_flush_params(sbinfo, left_scan->count + right_scan->count,
+			    left_scan->count >= params.scan_maxnodes,
+			    flush_pos->leaf_relocate);
 
 	/* Funny business here.  We set the 'point' in the flush_position at
 	   prior to starting squalloc regardless of whether the first point is
@@ -1039,7 +1171,10 @@ flush_current_atom(int flags, long nr_to_write, long *nr_submitted,
 
 	BUG_ON(rofs_super(get_current_context()->super));
 
-	nr_to_write = LONG_MAX;
+	/* short flushes fragment the slum, so only background writeback
+	   which trickles atoms out asks to stop early */
+	if (!(flags & JNODE_FLUSH_LIMITED))
+		nr_to_write = LONG_MAX;
 	while (1) {
 		ret = reiser4_fq_by_atom(*atom, &fq);
 		if (ret != -E_REPEAT)
@@ -1064,6 +1199,8 @@ flush_current_atom(int flags, long nr_to_write, long *nr_submitted,
 
 	/* count ourself as a flusher */
 	(*atom)->nr_flushers++;
+	/* blocks of the atom are allocated from one group */
+	reiser4_pick_alloc_group((*atom)->atom_id);
 
 	writeout_mode_enable();
 
@@ -2467,6 +2604,13 @@ static int squalloc(flush_pos_t *pos)
 		if (ret < 0)
 			break;
 
+		if (reiser4_pos_left_to_write(pos) <= 0) {
+			/* caller's limit reached, the rest of the slum is
+			   left dirty */
+			pos->state = POS_INVALID;
+			break;
+		}
+
 		ret = rapid_flush(pos);
 		if (ret)
 			break;
@@ -3510,6 +3654,12 @@ flush_queue_t *reiser4_pos_fq(flush_pos_t *pos)
 	return pos->fq;
 }
 
+/* how many more nodes flush may queue for write */
+long reiser4_pos_left_to_write(flush_pos_t *pos)
+{
+	return pos->nr_to_write - (long)(pos->fq->nr_queued - pos->nr_queued);
+}
+
 /* Make Linus happy.
    Local variables:
    c-indentation-style: "K&R"
@@ -110,6 +110,10 @@ struct flush_position {
 	reiser4_blocknr_hint preceder;	/* The flush 'hint' state. */
 	int leaf_relocate;	/* True if enough leaf-level nodes were
 				 * found to suggest a relocate policy. */
+	int repack;		/* True if the node flush started from is
+				 * marked for repacking */
+	int slum_hot;		/* True if the node flush started from is
+				 * frequently rewritten */
 	int alloc_cnt;		/* The number of nodes allocated during squeeze
 				   and allococate. */
 	int prep_or_free_cnt;	/* The number of nodes prepared for write
@@ -125,8 +129,9 @@ struct flush_position {
 	unsigned long pos_in_unit;	/* for extents only. Position
 					   within an extent unit of first
 					   jnode of slum */
-	long nr_to_write;	/* number of unformatted nodes to handle on
+	long nr_to_write;	/* number of nodes to queue for write on
 				   flush */
+	unsigned long nr_queued;	/* fq->nr_queued when flush started */
 };
 
 static inline int item_convert_count(flush_pos_t *pos)
@@ -261,6 +266,8 @@ squeeze_result squalloc_extent(znode *left, const coord_t *, flush_pos_t *,
 			       reiser4_key *stop_key);
 extern int reiser4_init_fqs(void);
 extern void reiser4_done_fqs(void);
+extern void reiser4_init_flush_adapt(struct super_block *super);
+extern unsigned reiser4_flush_relocate_distance(reiser4_super_info_data *);
 
 #if REISER4_DEBUG
 
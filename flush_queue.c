@@ -13,6 +13,7 @@
 #include "flush.h"
 
 #include <linux/bio.h>
+#include <linux/list_sort.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/blkdev.h>
@@ -151,6 +152,7 @@ static flush_queue_t *create_fq(gfp_t gfp)
 /* adjust atom's and flush queue's counters of queued nodes */
 static void count_enqueued_node(flush_queue_t *fq)
 {
+	fq->nr_queued++;
 	ON_DEBUG(fq->atom->num_queued++);
 }
 
@@ -181,12 +183,28 @@ static void detach_fq(flush_queue_t *fq)
 	spin_unlock(&(fq->guard));
 }
 
+/* add write-out statistics of @fq to the per-super block totals */
+static void fold_fq_stats(flush_queue_t *fq)
+{
+	reiser4_super_info_data *sbinfo;
+
+	if (fq->nr_bios == 0)
+		return;
+
+	sbinfo = get_current_super_private();
+	spin_lock_reiser4_super(sbinfo);
+	sbinfo->fq_stats.nr_bios += fq->nr_bios;
+	sbinfo->fq_stats.nr_blocks += fq->nr_bio_blocks;
+	spin_unlock_reiser4_super(sbinfo);
+}
+
 /* destroy flush queue object */
 static void done_fq(flush_queue_t *fq)
 {
 	assert("zam-763", list_empty_careful(ATOM_FQ_LIST(fq)));
 	assert("zam-766", atomic_read(&fq->nr_submitted) == 0);
 
+	fold_fq_stats(fq);
 	kmem_cache_free(fq_slab, fq);
 }
 
@@ -452,8 +470,42 @@ void add_fq_to_bio(flush_queue_t *fq, struct bio *bio)
 	bio->bi_private = fq;
 	bio->bi_end_io = end_io_handler;
 
-	if (fq)
+	if (fq) {
 		atomic_add(bio->bi_vcnt, &fq->nr_submitted);
+		fq->nr_bios++;
+		fq->nr_bio_blocks += bio->bi_vcnt;
+	}
+}
+
+/* A comparison function for list_sort(): order prepped jnodes by their
+   block numbers */
+static int prepped_jnode_compare(void *priv UNUSED_ARG,
+				 struct list_head *a, struct list_head *b)
+{
+	const reiser4_block_nr *blk_a;
+	const reiser4_block_nr *blk_b;
+
+	blk_a = jnode_get_block(list_entry(a, jnode, capture_link));
+	blk_b = jnode_get_block(list_entry(b, jnode, capture_link));
+
+	if (*blk_a < *blk_b)
+		return -1;
+	if (*blk_a > *blk_b)
+		return 1;
+	return 0;
+}
+
+/* Sort @fq->prepped list in ascending order of block numbers, so that
+   write_jnode_list() finds the longest possible runs of contiguous blocks and
+   submits them as large multi-page bios. Squalloc produces the list in parent
+   first order which in general does not match the disk order of relocated
+   nodes. Atom must be locked, fq must be IN_USE. */
+static void sort_prepped_list(flush_queue_t *fq)
+{
+	assert("jalex-1", fq_in_use(fq));
+	assert_spin_locked(&(fq->atom->alock));
+
+	list_sort(NULL, ATOM_FQ_LIST(fq), prepped_jnode_compare);
 }
 
 /* Move all queued nodes out from @fq->prepped list. */
@@ -508,6 +560,7 @@ int reiser4_write_fq(flush_queue_t *fq, long *nr_submitted, int flags)
 {
 	int ret;
 	txn_atom *atom;
+	struct blk_plug plug;
 
 	while (1) {
 		atom = atom_locked_by_fq(fq);
@@ -519,10 +572,18 @@ int reiser4_write_fq(flush_queue_t *fq, long *nr_submitted, int flags)
 		reiser4_atom_wait_event(atom);
 	}
 
+	/* nobody else modifies the prepped list while fq is in use and the
+	   atom is locked */
+	sort_prepped_list(fq);
+
 	atom->nr_running_queues++;
 	spin_unlock_atom(atom);
 
+	/* let the block layer hold the bios until the whole sorted list is
+	   submitted */
+	blk_start_plug(&plug);
 	ret = write_jnode_list(ATOM_FQ_LIST(fq), fq, nr_submitted, flags);
+	blk_finish_plug(&plug);
 	release_prepped_list(fq);
 
 	return ret;
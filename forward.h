@@ -200,6 +200,10 @@ typedef enum {
 
 	/* not implemented */
 	JNODE_FLUSH_MEMORY_UNFORMATTED = 8,
+
+	/* stop once nr_to_write nodes are queued for write. Without it the
+	   whole slum is flushed whatever the caller asks for */
+	JNODE_FLUSH_LIMITED = 16,
 } jnode_flush_flags;
 
 /* Flags to insert/paste carry operations. Currently they only used in
@@ -2,6 +2,8 @@
 
 #include "super.h"
 #include "inode.h"
+#include "flush.h"
+#include "discard.h"
 #include "plugin/plugin_set.h"
 
 #include <linux/swap.h>
@@ -30,9 +32,25 @@ int reiser4_init_fs_info(struct super_block *super)
 
 	mutex_init(&sbinfo->delete_mutex);
 	spin_lock_init(&(sbinfo->guard));
+	spin_lock_init(&sbinfo->window_lock);
+	init_waitqueue_head(&sbinfo->window_wait);
+
+	if (reiser4_init_grab_cache(sbinfo)) {
+		super->s_fs_info = NULL;
+		kfree(sbinfo);
+		return RETERR(-ENOMEM);
+	}
+	if (reiser4_init_alloc_cursors(sbinfo)) {
+		reiser4_done_grab_cache(sbinfo);
+		super->s_fs_info = NULL;
+		kfree(sbinfo);
+		return RETERR(-ENOMEM);
+	}
 
 	/*  initialize per-super-block d_cursor resources */
 	reiser4_init_super_d_info(super);
+	reiser4_init_discard_queue(super);
+	reiser4_init_conv_queue(super);
 
 	return 0;
 }
@@ -54,6 +72,8 @@ void reiser4_done_fs_info(struct super_block *super)
 	/* make sure that there are not jnodes already */
 	assert("", list_empty(&get_super_private(super)->all_jnodes));
 	assert("", get_current_context()->trans->atom == NULL);
+	reiser4_done_grab_cache(get_super_private(super));
+	reiser4_done_alloc_cursors(get_super_private(super));
 	reiser4_check_block_counters(super);
 	kfree(super->s_fs_info);
 	super->s_fs_info = NULL;
@@ -85,7 +105,7 @@ typedef enum {
 
 	/*
 	 * option take one of txmod plugin labels.
-	 * Example is "txmod=journal" or "txmod=wa"
+	 * Example is "txmod=journal", "txmod=wa" or "txmod=adaptive"
 	 */
 	OPT_TXMOD,
 } opt_type_t;
@@ -466,6 +486,8 @@ int reiser4_init_super_data(struct super_block *super, char *opt_string)
 	/* initialize default readahead params */
 	sbinfo->ra_params.max = totalram_pages / 4;
 	sbinfo->ra_params.flags = 0;
+	atomic64_set(&sbinfo->ra_params.nr_issued, 0);
+	atomic64_set(&sbinfo->ra_params.nr_used, 0);
 
 	/* allocate memory for structure describing reiser4 mount options */
 	opts = kmalloc(sizeof(struct opt_desc) * MAX_NR_OPTIONS,
@@ -496,6 +518,10 @@ int reiser4_init_super_data(struct super_block *super, char *opt_string)
 	PUSH_BIT_OPT("discard", REISER4_DISCARD);
 	/* disable hole punching at flush time */
 	PUSH_BIT_OPT("dont_punch_holes", REISER4_DONT_PUNCH_HOLES);
+	/* don't adjust flush parameters at run time */
+	PUSH_BIT_OPT("dont_adapt_flush", REISER4_DONT_ADAPT_FLUSH);
+	/* index free extents to speed up allocation of long extents */
+	PUSH_BIT_OPT("free_extent_index", REISER4_FREE_EXTENT_INDEX);
 
 	PUSH_OPT(p, opts,
 	{
@@ -573,6 +599,7 @@ int reiser4_init_super_data(struct super_block *super, char *opt_string)
 		warning("nikita-2497", "optimal_io_size is too small");
 		return RETERR(-EINVAL);
 	}
+	reiser4_init_flush_adapt(super);
 	return result;
 }
 
@@ -467,6 +467,29 @@ struct inode *reiser4_iget(struct super_block *super, const reiser4_key *key,
 	return inode;
 }
 
+/**
+ * reiser4_ilookup - find inode in inode cache
+ * @super: super block of filesystem
+ * @key: key of inode's stat-data
+ *
+ * Returns referenced inode if it is in cache and is fully loaded, NULL
+ * otherwise. Stat data is never read.
+ */
+struct inode *reiser4_ilookup(struct super_block *super,
+			      const reiser4_key *key)
+{
+	struct inode *inode;
+
+	inode = ilookup5(super, (unsigned long)get_key_objectid(key),
+			 reiser4_inode_find_actor, (reiser4_key *)key);
+	if (inode != NULL &&
+	    (is_bad_inode(inode) || !is_inode_loaded(inode))) {
+		iput(inode);
+		inode = NULL;
+	}
+	return inode;
+}
+
 /* reiser4_iget() may return not fully initialized inode, this function should
  * be called after one completes reiser4 inode initializing. */
 void reiser4_iget_complete(struct inode *inode)
@@ -10,6 +10,7 @@
 #include "debug.h"
 #include "key.h"
 #include "seal.h"
+#include "block_alloc.h"
 #include "plugin/plugin.h"
 #include "plugin/file/cryptcompress.h"
 #include "plugin/file/file.h"
@@ -61,7 +62,9 @@ typedef enum {
 	REISER4_PART_MIXED = 9,
 	REISER4_PART_IN_CONV = 10,
 	/* This flag indicates that file plugin conversion is in progress */
-	REISER4_FILE_CONV_IN_PROGRESS = 11
+	REISER4_FILE_CONV_IN_PROGRESS = 11,
+	/* file is queued for deferred tail to extent conversion */
+	REISER4_PART_CONV_QUEUED = 12
 } reiser4_file_plugin_flags;
 
 /* state associated with each inode.
@@ -332,6 +335,8 @@ extern int setup_inode_ops(struct inode *inode, reiser4_object_create_data *);
 extern struct inode *reiser4_iget(struct super_block *super,
 				  const reiser4_key * key, int silent);
 extern void reiser4_iget_complete(struct inode *inode);
+extern struct inode *reiser4_ilookup(struct super_block *super,
+				     const reiser4_key *key);
 extern void reiser4_inode_set_flag(struct inode *inode,
 				   reiser4_file_plugin_flags f);
 extern void reiser4_inode_clr_flag(struct inode *inode,
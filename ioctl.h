@@ -26,6 +26,30 @@
  */
 #define REISER4_IOC_UNPACK _IOW(0xCD, 1, long)
 
+/*
+ * ioctl(2) command used to defragment reiser4 file built of extents. Blocks
+ * of the file are captured and relocated by flush as one atom after another,
+ * so that the file stays consistent after a crash at any moment.
+ *
+ * This ioctl should be used as
+ *
+ *     struct reiser4_defrag_args args = { .rate = 0 };
+ *     result = ioctl(fd, REISER4_IOC_DEFRAG, &args);
+ *
+ * @rate limits the number of pages relocated per second (0 means the
+ * default limit). On return @extents_before and @extents_after contain
+ * the number of extents of the file before and after defragmentation. The
+ * ioctl can be interrupted by a signal, the file is partially defragmented
+ * then.
+ */
+struct reiser4_defrag_args {
+	__u64 rate;
+	__u64 extents_before;
+	__u64 extents_after;
+};
+
+#define REISER4_IOC_DEFRAG _IOWR(0xCD, 2, struct reiser4_defrag_args)
+
 /* __REISER4_IOCTL_H__ */
 #endif
 
@@ -169,7 +169,11 @@ struct jnode {
 	 * offset => key conversion.  */
 	/* NOTE: this parent_item_id looks like jnode type. */
 	/*   88 */ reiser4_plugin_id parent_item_id;
-	/*   92 */
+	/* how often this node gets dirtied, see jnode_update_heat() */
+	/*   90 */ __u16 heat;
+	/* time (in seconds) of the last heat decay */
+	/*   92 */ __u32 heat_stamp;
+	/*   96 */
 #if REISER4_DEBUG
 	/* list of all jnodes for debugging purposes. */
 	struct list_head jnodes;
@@ -260,6 +264,8 @@ typedef enum {
 	JNODE_REPACK = 23,
 	/* node should be converted by flush in squalloc phase */
 	JNODE_CONVERTIBLE = 24,
+	/* node was read by twig readahead and was not used yet */
+	JNODE_READAHEAD = 25,
 	/*
 	 * When jnode is dirtied for the first time in given transaction,
 	 * do_jnode_make_dirty() checks whether this jnode can possible became
@@ -303,6 +309,37 @@ static inline int JF_TEST_AND_SET(jnode * j, int f)
 	return test_and_set_bit(f, &j->state);
 }
 
+static inline int JF_TEST_AND_CLEAR(jnode * j, int f)
+{
+	assert("unknown-5", j->magic == JMAGIC);
+	return test_and_clear_bit(f, &j->state);
+}
+
+/* jnode heat is halved every JNODE_HEAT_PERIOD seconds */
+#define JNODE_HEAT_PERIOD (30)
+/* node dirtied this many times during recent heat periods is "hot" */
+#define JNODE_HOT_THRESHOLD (4)
+
+/* account one more dirtying of @node. Jnode spin lock must be held */
+static inline void jnode_update_heat(jnode * node)
+{
+	__u32 now = (__u32)get_seconds();
+	__u32 periods = (now - node->heat_stamp) / JNODE_HEAT_PERIOD;
+
+	if (periods != 0) {
+		node->heat = periods < 16 ? node->heat >> periods : 0;
+		node->heat_stamp = now;
+	}
+	if (node->heat < U16_MAX)
+		node->heat++;
+}
+
+/* true if @node was frequently rewritten recently */
+static inline int jnode_is_hot(const jnode * node)
+{
+	return node->heat >= JNODE_HOT_THRESHOLD;
+}
+
 static inline void spin_lock_jnode(jnode *node)
 {
 	/* check that spinlocks of lower priorities are not held */
@@ -399,6 +436,7 @@ static inline const reiser4_block_nr *jnode_get_io_block(jnode * node)
 /* Jnode flush interface. */
 extern reiser4_blocknr_hint *reiser4_pos_hint(flush_pos_t *pos);
 extern flush_queue_t *reiser4_pos_fq(flush_pos_t *pos);
+extern long reiser4_pos_left_to_write(flush_pos_t *pos);
 
 /* FIXME-VS: these are used in plugin/item/extent.c */
 
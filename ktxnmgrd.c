@@ -16,9 +16,16 @@
  *     accesses to this directory.
  *
  * ktxnmgrd binds its time sleeping on condition variable. When is awakes
- * either due to (tunable) timeout or because it was explicitly woken up by
- * call to ktxnmgrd_kick(), it scans list of all atoms and commits ones
- * eligible.
+ * either due to timeout or because it was explicitly woken up by call to
+ * ktxnmgrd_kick(), it scans list of all atoms and commits ones eligible.
+ *
+ * ktxnmgrd is kicked when an atom grows over tmgr.atom_max_size and when a
+ * transaction handle leaves commit to it. Timeout is not fixed: ktxnmgrd
+ * sleeps until the oldest atom reaches tmgr.atom_max_age (see
+ * txnmgr_schedule()). Atoms which are over half of that age are written back
+ * gradually, REISER4_TRICKLE_BATCH nodes every REISER4_TRICKLE_INTERVAL, so
+ * that their commit does not come as a burst of I/O. When atoms pin too much
+ * memory, the oldest one is committed early.
  *
  */
 
@@ -38,6 +45,7 @@
 #include <linux/freezer.h>
 
 static int scan_mgr(struct super_block *);
+static void trickle_writeback(struct super_block *, __u32 atom_id);
 
 /*
  * change current->comm so that ps, top, and friends will see changed
@@ -60,6 +68,9 @@ static int ktxnmgrd(void *arg)
 	struct super_block *super;
 	ktxnmgrd_context *ctx;
 	txn_mgr *mgr;
+	long timeout;
+	int trickle;
+	__u32 trickle_atom;
 	int done = 0;
 
 	super = arg;
@@ -74,6 +85,12 @@ static int ktxnmgrd(void *arg)
 	ctx = mgr->daemon;
 	while (1) {
 		try_to_freeze();
+		timeout = txnmgr_schedule(mgr, ctx->timeout, &trickle,
+					  &trickle_atom);
+		if (trickle) {
+			set_comm("trickle");
+			trickle_writeback(super, trickle_atom);
+		}
 		set_comm("wait");
 		{
 			DEFINE_WAIT(__wait);
@@ -83,7 +100,7 @@ static int ktxnmgrd(void *arg)
 			if (kthread_should_stop())
 				done = 1;
 			else
-				schedule_timeout(ctx->timeout);
+				schedule_timeout(timeout);
 			finish_wait(&ctx->wait, &__wait);
 		}
 		if (done)
@@ -186,6 +203,23 @@ static int scan_mgr(struct super_block *super)
 	return ret;
 }
 
+/**
+ * trickle_writeback - write some nodes of an atom back
+ * @super: super block
+ * @atom_id: id of the atom selected by txnmgr_schedule()
+ *
+ * Flushes up to REISER4_TRICKLE_BATCH nodes of the atom. The atom is left to
+ * be committed when it reaches its commit age.
+ */
+static void trickle_writeback(struct super_block *super, __u32 atom_id)
+{
+	reiser4_context ctx;
+
+	init_stack_context(&ctx, super);
+	reiser4_trickle_atom(atom_id, REISER4_TRICKLE_BATCH);
+	reiser4_exit_context(&ctx);
+}
+
 /**
  * reiser4_done_ktxnmgrd - stop kernel thread and frees ktxnmgrd context
  * @mgr:
@@ -468,7 +468,7 @@ static int can_hit_entd(reiser4_context *ctx, struct super_block *s)
 		return 1;
 	if (ctx->super != s)
 		return 1;
-	if (get_super_private(s)->entd.tsk == current)
+	if (ctx->entd)
 		return 0;
 	if (!lock_stack_isclean(&ctx->stack))
 		return 0;
@@ -89,9 +89,10 @@ static int update_backup_version(const format40_disk_super_block * sb)
 		FORMAT40_UPDATE_BACKUP);
 }
 
-static int update_disk_version_minor(const format40_disk_super_block * sb)
+static int update_disk_version_minor(const format40_disk_super_block * sb,
+				     const reiser4_super_info_data * sbinfo)
 {
-	return (get_format40_version(sb) < get_release_number_minor());
+	return (get_format40_version(sb) < sbinfo->version);
 }
 
 static int incomplete_compatibility(const format40_disk_super_block * sb)
@@ -322,15 +323,19 @@ static int try_init_format40(struct super_block *super,
 	printk("reiser4: %s: found disk format 4.0.%u.\n",
 	       super->s_id,
 	       get_format40_version(sb_copy));
-	if (incomplete_compatibility(sb_copy))
+	if (incomplete_compatibility(sb_copy)) {
+		/* newer versions may change meaning of on-disk data (e.g.
+		   unwritten extents), writing such a volume could corrupt it */
 		printk("reiser4: %s: format version number (4.0.%u) is "
 		       "greater than release number (4.%u.%u) of reiser4 "
 		       "kernel module. Some objects of the volume can be "
-		       "inaccessible.\n",
+		       "inaccessible, forcing read-only mount.\n",
 		       super->s_id,
 		       get_format40_version(sb_copy),
 		       get_release_number_major(),
 		       get_release_number_minor());
+		super->s_flags |= MS_RDONLY;
+	}
 	/* make sure that key format of kernel and filesystem match */
 	result = check_key_format(sb_copy);
 	if (result) {
@@ -493,8 +498,8 @@ static void pack_format40_super(const struct super_block *s, char *data)
 	put_unaligned(cpu_to_le16(sbinfo->tree.height),
 		      &super_data->tree_height);
 
-	if (update_disk_version_minor(super_data)) {
-		__u32 version = PLUGIN_LIBRARY_VERSION | FORMAT40_UPDATE_BACKUP;
+	if (update_disk_version_minor(super_data, sbinfo)) {
+		__u32 version = sbinfo->version | FORMAT40_UPDATE_BACKUP;
 
 		put_unaligned(cpu_to_le32(version), &super_data->version);
 	}
@@ -610,24 +615,25 @@ int check_open_format40(const struct inode *object)
 
 /*
  * plugin->u.format.version_update
- * Upgrade minor disk format version number
+ * Upgrade minor disk format version number to @version
  */
-int version_update_format40(struct super_block *super) {
+int version_update_format40(struct super_block *super, int version) {
 	txn_handle * trans;
 	lock_handle lh;
 	txn_atom *atom;
 	int ret;
 
+	assert("jalex-49", version <= get_release_number_minor());
+
 	/* Nothing to do if RO mount or the on-disk version is not less. */
 	if (super->s_flags & MS_RDONLY)
  		return 0;
 
-	if (get_super_private(super)->version >= get_release_number_minor())
+	if (get_super_private(super)->version >= version)
 		return 0;
 
 	printk("reiser4: %s: upgrading disk format to 4.0.%u.\n",
-	       super->s_id,
-	       get_release_number_minor());
+	       super->s_id, version);
 	printk("reiser4: %s: use 'fsck.reiser4 --fix' "
 	       "to complete disk format upgrade.\n", super->s_id);
 
@@ -640,6 +646,8 @@ int version_update_format40(struct super_block *super) {
 
 	znode_make_dirty(lh.node);
 	done_lh(&lh);
+	/* log_super writes it to disk super block */
+	get_super_private(super)->version = version;
 
 	/* Update the backup blocks. */
 
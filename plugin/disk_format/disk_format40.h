@@ -94,7 +94,7 @@ extern const reiser4_key *root_dir_key_format40(const struct super_block *);
 extern int release_format40(struct super_block *s);
 extern jnode *log_super_format40(struct super_block *s);
 extern int check_open_format40(const struct inode *object);
-extern int version_update_format40(struct super_block *super);
+extern int version_update_format40(struct super_block *super, int version);
 
 /* __DISK_FORMAT40_H__ */
 #endif
@@ -3667,6 +3667,38 @@ int release_cryptcompress(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/* plugin->fiemap */
+int fiemap_cryptcompress(struct inode *inode,
+			 struct fiemap_extent_info *fieinfo,
+			 __u64 start, __u64 len)
+{
+	int result;
+	reiser4_context *ctx;
+
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	result = reiser4_fiemap_body(inode, fieinfo, start, len);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/* plugin->llseek */
+loff_t llseek_cryptcompress(struct file *file, loff_t offset, int origin)
+{
+	loff_t result;
+	struct inode *inode;
+	reiser4_context *ctx;
+
+	inode = file_inode(file);
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	result = reiser4_seek_body(file, inode, offset, origin);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
 /* plugin->write_begin() */
 int write_begin_cryptcompress(struct file *file, struct page *page,
 			      loff_t pos, unsigned len, void **fsdata)
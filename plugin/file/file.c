@@ -22,6 +22,11 @@
 #include <linux/writeback.h>
 #include <linux/pagevec.h>
 #include <linux/syscalls.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/buffer_head.h>
+#include <linux/falloc.h>
+#include <linux/mount.h>
 
 
 static int unpack(struct file *file, struct inode *inode, int forever);
@@ -557,7 +562,7 @@ static int shorten_file(struct inode *inode, loff_t new_size)
  * Calls formatting plugin to see whether file of size @new_size has to be
  * stored in unformatted nodes or in tail items. 0 is returned for later case.
  */
-static int should_have_notail(const struct unix_file_info *uf_info, loff_t new_size)
+int should_have_notail(const struct unix_file_info *uf_info, loff_t new_size)
 {
 	if (!uf_info->tplug)
 		return 1;
@@ -740,7 +745,6 @@ int hint_is_set(const hint_t * hint)
 	return reiser4_seal_is_set(&hint->seal);
 }
 
-#if REISER4_DEBUG
 static int all_but_offset_key_eq(const reiser4_key * k1, const reiser4_key * k2)
 {
 	return (get_key_locality(k1) == get_key_locality(k2) &&
@@ -749,7 +753,6 @@ static int all_but_offset_key_eq(const reiser4_key * k1, const reiser4_key * k2)
 		get_key_ordering(k1) == get_key_ordering(k2) &&
 		get_key_objectid(k1) == get_key_objectid(k2));
 }
-#endif
 
 static int
 hint_validate(hint_t * hint, const reiser4_key * key, int check_key,
@@ -821,12 +824,12 @@ int find_or_create_extent(struct page *page)
 	JF_CLR(node, JNODE_WRITE_PREPARED);
 
 	if (get_current_context()->entd) {
-		entd_context *ent = get_entd_context(node->tree->super);
+		struct wbq *rq = entd_current_request();
 
-		if (ent->cur_request->page == page)
+		if (rq->page == page)
 			/* the following reference will be
 			   dropped in reiser4_writeout */
-			ent->cur_request->node = jref(node);
+			rq->node = jref(node);
 	}
 	jput(node);
 	return 0;
@@ -852,38 +855,122 @@ static int has_anonymous_pages(struct inode *inode)
 }
 
 /**
- * capture_page_and_create_extent -
- * @page: page to be captured
+ * find_or_create_extents - capture run of pages
+ * @pages: pages with consecutive indexes
+ * @nr: number of pages
+ *
+ * Does what find_or_create_extent() does for each of @pages. Extent items are
+ * created or updated in one pass over the tree for each run of pages which
+ * have no blocks yet. Pages which have blocks need no extent update, they are
+ * captured under one lock of the atom.
+ */
+static int find_or_create_extents(struct page **pages, int nr)
+{
+	struct inode *inode;
+	jnode *jnodes[PAGEVEC_SIZE];
+	int plugged_hole;
+	int result;
+	int end;
+	int i;
+
+	assert("jalex-43", nr > 0 && nr <= PAGEVEC_SIZE);
+	inode = pages[0]->mapping->host;
+
+	result = 0;
+	for (i = 0; i < nr; i++) {
+		lock_page(pages[i]);
+		jnodes[i] = jnode_of_page(pages[i]);
+		if (IS_ERR(jnodes[i])) {
+			unlock_page(pages[i]);
+			result = PTR_ERR(jnodes[i]);
+			nr = i;
+			goto out;
+		}
+		JF_SET(jnodes[i], JNODE_WRITE_PREPARED);
+		unlock_page(pages[i]);
+	}
+
+	plugged_hole = 0;
+	for (i = 0; i < nr; i = end) {
+		if (jnodes[i]->blocknr != 0) {
+			for (end = i + 1; end < nr; end++)
+				if (jnodes[end]->blocknr == 0)
+					break;
+			reiser4_capture_dirty_jnodes(jnodes + i, end - i);
+			continue;
+		}
+		for (end = i + 1; end < nr; end++)
+			if (jnodes[end]->blocknr != 0)
+				break;
+		result = reiser4_update_extents(inode, jnodes + i, end - i,
+						&plugged_hole);
+		if (result) {
+			warning("jalex-44", "reiser4_update_extents failed: %d",
+				result);
+			break;
+		}
+	}
+	if (plugged_hole)
+		reiser4_update_sd(inode);
+	if (result)
+		goto out;
+
+	if (get_current_context()->entd) {
+		struct wbq *rq = entd_current_request();
+
+		for (i = 0; i < nr; i++)
+			if (rq->page == pages[i]) {
+				/* the following reference will be
+				   dropped in reiser4_writeout */
+				rq->node = jref(jnodes[i]);
+				break;
+			}
+	}
+ out:
+	for (i = 0; i < nr; i++) {
+		BUG_ON(result == 0 && jnodes[i]->atom == NULL);
+		JF_CLR(jnodes[i], JNODE_WRITE_PREPARED);
+		jput(jnodes[i]);
+	}
+	return result;
+}
+
+/**
+ * capture_pages_and_create_extents -
+ * @pages: pages with consecutive indexes to be captured
+ * @nr: number of pages
  *
  * Grabs space for extent creation and stat data update and calls function to
  * do actual work.
  * Exclusive, or non-exclusive lock must be held.
  */
-static int capture_page_and_create_extent(struct page *page)
+static int capture_pages_and_create_extents(struct page **pages, int nr)
 {
 	int result;
+	int i;
 	struct inode *inode;
 
-	assert("vs-1084", page->mapping && page->mapping->host);
-	inode = page->mapping->host;
+	assert("vs-1084", pages[0]->mapping && pages[0]->mapping->host);
+	inode = pages[0]->mapping->host;
 	assert("vs-1139",
 	       unix_file_inode_data(inode)->container == UF_CONTAINER_EXTENTS);
-	/* page belongs to file */
+	/* pages belong to file */
 	assert("vs-1393",
-	       inode->i_size > page_offset(page));
+	       inode->i_size > page_offset(pages[nr - 1]));
 
 	/* page capture may require extent creation (if it does not exist yet)
 	   and stat data's update (number of blocks changes on extent
 	   creation) */
 	grab_space_enable();
-	result = reiser4_grab_space(2 * estimate_one_insert_into_item
+	result = reiser4_grab_space(nr * 2 * estimate_one_insert_into_item
 				    (reiser4_tree_by_inode(inode)),
 				    BA_CAN_COMMIT);
 	if (likely(!result))
-		result = find_or_create_extent(page);
+		result = find_or_create_extents(pages, nr);
 
 	if (result != 0)
-		SetPageError(page);
+		for (i = 0; i < nr; i++)
+			SetPageError(pages[i]);
 	return result;
 }
 
@@ -908,31 +995,6 @@ static int capture_page_and_create_extent(struct page *page)
  * tree. This is done by capture_anonymous_*() functions below.
  */
 
-/**
- * capture_anonymous_page - involve page into transaction
- * @pg: page to deal with
- *
- * Takes care that @page has corresponding metadata in the tree, creates jnode
- * for @page and captures it. On success 1 is returned.
- */
-static int capture_anonymous_page(struct page *page)
-{
-	int result;
-
-	if (PageWriteback(page))
-		/* FIXME: do nothing? */
-		return 0;
-
-	result = capture_page_and_create_extent(page);
-	if (result == 0) {
-		result = 1;
-	} else
-		warning("nikita-3329",
-				"Cannot capture anon page: %i", result);
-
-	return result;
-}
-
 /**
  * capture_anonymous_pages - find and capture pages dirtied via mmap
  * @mapping: address space where to look for pages
@@ -941,7 +1003,8 @@ static int capture_anonymous_page(struct page *page)
  *
  * Looks for pages tagged REISER4_MOVED starting from the *@index-th page,
  * captures (involves into atom) them, returns number of captured pages,
- * updates @index to next page after the last captured one.
+ * updates @index to next page after the last captured one. Runs of pages with
+ * consecutive indexes are captured together.
  */
 static int
 capture_anonymous_pages(struct address_space *mapping, pgoff_t *index,
@@ -949,7 +1012,7 @@ capture_anonymous_pages(struct address_space *mapping, pgoff_t *index,
 {
 	int result;
 	struct pagevec pvec;
-	unsigned int i, count;
+	unsigned int i, end, count;
 	int nr;
 
 	pagevec_init(&pvec, 0);
@@ -982,48 +1045,54 @@ capture_anonymous_pages(struct address_space *mapping, pgoff_t *index,
 
 	*index = pvec.pages[i - 1]->index + 1;
 
-	for (i = 0; i < pagevec_count(&pvec); i++) {
-		result = capture_anonymous_page(pvec.pages[i]);
-		if (result == 1)
-			nr++;
-		else {
-			if (result < 0) {
-				warning("vs-1454",
-					"failed to capture page: "
-					"result=%d, captured=%d)\n",
-					result, i);
+	for (i = 0; i < pagevec_count(&pvec); i = end) {
+		if (PageWriteback(pvec.pages[i])) {
+			/*
+			 * FIXME: do nothing? Set MOVED tag on that page
+			 */
+			spin_lock_irq(&mapping->tree_lock);
+			radix_tree_tag_set(&mapping->page_tree,
+					   pvec.pages[i]->index,
+					   PAGECACHE_TAG_REISER4_MOVED);
+			spin_unlock_irq(&mapping->tree_lock);
+			if (i == 0)
+				*index = pvec.pages[0]->index;
+			else
+				*index = pvec.pages[i - 1]->index + 1;
+			end = i + 1;
+			continue;
+		}
+		/* find the end of run of consecutive pages */
+		for (end = i + 1; end < pagevec_count(&pvec); end++)
+			if (pvec.pages[end]->index !=
+			    pvec.pages[end - 1]->index + 1 ||
+			    PageWriteback(pvec.pages[end]))
+				break;
 
-				/*
-				 * set MOVED tag to all pages which left not
-				 * captured
-				 */
-				spin_lock_irq(&mapping->tree_lock);
-				for (; i < pagevec_count(&pvec); i ++) {
-					radix_tree_tag_set(&mapping->page_tree,
-							   pvec.pages[i]->index,
-							   PAGECACHE_TAG_REISER4_MOVED);
-				}
-				spin_unlock_irq(&mapping->tree_lock);
+		result = capture_pages_and_create_extents(pvec.pages + i,
+							  end - i);
+		if (result < 0) {
+			warning("vs-1454",
+				"failed to capture page: "
+				"result=%d, captured=%d)\n",
+				result, i);
 
-				pagevec_release(&pvec);
-				return result;
-			} else {
-				/*
-				 * result == 0. capture_anonymous_page returns
-				 * 0 for Writeback-ed page. Set MOVED tag on
-				 * that page
-				 */
-				spin_lock_irq(&mapping->tree_lock);
+			/*
+			 * set MOVED tag to all pages which left not
+			 * captured
+			 */
+			spin_lock_irq(&mapping->tree_lock);
+			for (; i < pagevec_count(&pvec); i ++) {
 				radix_tree_tag_set(&mapping->page_tree,
 						   pvec.pages[i]->index,
 						   PAGECACHE_TAG_REISER4_MOVED);
-				spin_unlock_irq(&mapping->tree_lock);
-				if (i == 0)
-					*index = pvec.pages[0]->index;
-				else
-					*index = pvec.pages[i - 1]->index + 1;
 			}
+			spin_unlock_irq(&mapping->tree_lock);
+
+			pagevec_release(&pvec);
+			return result;
 		}
+		nr += end - i;
 	}
 	pagevec_release(&pvec);
 	return nr;
@@ -1506,6 +1575,7 @@ int readpage_unix_file(struct file *file, struct page *page)
 struct uf_readpages_context {
 	lock_handle lh;
 	coord_t coord;
+	struct extent_read_bio erb;
 };
 
 /*
@@ -1529,6 +1599,8 @@ static int readpages_filler(void * data, struct page * page)
 	int cbk_done = 0;
 	struct address_space *mapping = page->mapping;
 
+	if (rc->erb.nr_pages)
+		rc->erb.nr_pages--;
 	if (PageUptodate(page)) {
 		unlock_page(page);
 		return 0;
@@ -1540,6 +1612,8 @@ static int readpages_filler(void * data, struct page * page)
 		reiser4_key key;
 	repeat:
 		unlock_page(page);
+		/* do not sleep with pages of unsubmitted bio locked */
+		reiser4_submit_extent_read(&rc->erb);
 		key_by_inode_and_offset_common(
 			mapping->host, page_offset(page), &key);
 		ret = coord_by_key(
@@ -1573,6 +1647,14 @@ static int readpages_filler(void * data, struct page * page)
 	}
 	ext = extent_by_coord(&rc->coord);
 	ext_index = extent_unit_index(&rc->coord);
+	/* pages come in ascending order: move to the next extent unit
+	   without tree search if possible */
+	while (page->index >= ext_index + extent_get_width(ext) &&
+	       rc->coord.unit_pos < coord_last_unit_pos(&rc->coord)) {
+		rc->coord.unit_pos++;
+		ext = extent_by_coord(&rc->coord);
+		ext_index = extent_unit_index(&rc->coord);
+	}
 	if (page->index < ext_index ||
 	    page->index >= ext_index + extent_get_width(ext)) {
 		/* the page index doesn't belong to the extent unit
@@ -1588,6 +1670,14 @@ static int readpages_filler(void * data, struct page * page)
 		}
 		goto repeat;
 	}
+	ret = reiser4_readahead_extent(&rc->erb, ext, page->index - ext_index,
+				       page);
+	if (ret <= 0) {
+		zrelse(rc->coord.node);
+		if (likely(!ret))
+			goto exit;
+		goto unlock;
+	}
 	node = jnode_of_page(page);
 	if (unlikely(IS_ERR(node))) {
 		zrelse(rc->coord.node);
@@ -1623,7 +1713,10 @@ int readpages_unix_file(struct file *file, struct address_space *mapping,
 		return PTR_ERR(ctx);
 	}
 	init_lh(&rc.lh);
+	rc.erb.bio = NULL;
+	rc.erb.nr_pages = nr_pages;
 	ret = read_cache_pages(mapping, pages,  readpages_filler, &rc);
+	reiser4_submit_extent_read(&rc.erb);
 	done_lh(&rc.lh);
 
 	context_set_commit_async(ctx);
@@ -1648,7 +1741,7 @@ static reiser4_block_nr unix_file_estimate_read(struct inode *inode,
    file's container can not change */
 static ssize_t do_read_compound_file(hint_t *hint, struct file *file,
 				     char __user *buf, size_t count,
-				     loff_t *off)
+				     loff_t *off, ra_info_t *ra_info)
 {
 	int result;
 	struct inode *inode;
@@ -1687,7 +1780,7 @@ static ssize_t do_read_compound_file(hint_t *hint, struct file *file,
 		}
 
 		loaded = coord->node;
-		result = zload(loaded);
+		result = zload_ra(loaded, ra_info);
 		if (unlikely(result)) {
 			done_lh(hint->ext_coord.lh);
 			break;
@@ -1710,6 +1803,125 @@ static ssize_t do_read_compound_file(hint_t *hint, struct file *file,
 }
 
 static ssize_t read_compound_file(struct file*, char __user*, size_t, loff_t*);
+static ssize_t read_unix_file_direct(struct file *, char __user *, size_t,
+				     loff_t *);
+static ssize_t write_unix_file_direct(struct file *, const char __user *,
+				      size_t, loff_t *);
+
+/* check whether pages of file range within file size are uptodate */
+static int range_is_cached(struct inode *inode, loff_t pos, size_t count)
+{
+	loff_t size;
+	pgoff_t index;
+	pgoff_t end;
+	struct page *page;
+	int uptodate;
+
+	size = i_size_read(inode);
+	if (pos >= size)
+		return 1;
+	if (pos + count > size)
+		count = size - pos;
+	end = (pos + count - 1) >> PAGE_SHIFT;
+	for (index = pos >> PAGE_SHIFT; index <= end; index++) {
+		page = find_get_page(inode->i_mapping, index);
+		if (page == NULL)
+			return 0;
+		uptodate = PageUptodate(page);
+		put_page(page);
+		if (!uptodate)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * check whether read of @file may update its atime. This is simplified
+ * version of the check done by touch_atime(): it can tell yes when atime is
+ * not to be updated, but not the reverse
+ */
+static int read_updates_atime(struct file *file, struct inode *inode)
+{
+	struct vfsmount *mnt = file->f_path.mnt;
+	struct timespec now;
+
+	if ((file->f_flags & O_NOATIME) || IS_NOATIME(inode) ||
+	    (mnt->mnt_flags & MNT_NOATIME))
+		return 0;
+	if (!(mnt->mnt_flags & MNT_RELATIME))
+		return 1;
+	if (timespec_compare(&inode->i_mtime, &inode->i_atime) >= 0 ||
+	    timespec_compare(&inode->i_ctime, &inode->i_atime) >= 0)
+		return 1;
+	now = CURRENT_TIME;
+	return now.tv_sec - inode->i_atime.tv_sec >= 24 * 60 * 60;
+}
+
+/**
+ * read_unix_file_cached - read file from page cache without locking
+ * @file: file to read
+ * @buf: user buffer to read to
+ * @count: number of bytes to read
+ * @off: position to read from
+ * @result: where to store number of bytes read or error code
+ *
+ * Reads of files built of extents whose pages are all uptodate are served by
+ * generic page cache read without taking the latch of unix file info: page
+ * cache of such file can be read the same way as by page faults. Neither
+ * reiser4 context nor space for stat data update is needed, unless the read
+ * updates atime. Tail conversion running concurrently is detected by
+ * @conv_seq of unix file info, such read is redone by the slow path.
+ *
+ * Returns 1 if the read is done, 0 if it has to be done by the slow path.
+ */
+static int read_unix_file_cached(struct file *file, char __user *buf,
+				 size_t count, loff_t *off, ssize_t *result)
+{
+	struct inode *inode;
+	struct unix_file_info *uf_info;
+	reiser4_context *ctx = NULL;
+	loff_t pos = *off;
+	unsigned seq;
+	int ret;
+
+	if (file->f_flags & O_DIRECT)
+		return 0;
+	inode = file_inode(file);
+	uf_info = unix_file_inode_data(inode);
+	seq = raw_read_seqcount(&uf_info->conv_seq);
+	if (seq & 1)
+		/* conversion is in progress */
+		return 0;
+	if (READ_ONCE(uf_info->container) != UF_CONTAINER_EXTENTS ||
+	    reiser4_inode_get_flag(inode, REISER4_PART_MIXED) ||
+	    !range_is_cached(inode, pos, count))
+		return 0;
+
+	if (read_updates_atime(file, inode)) {
+		/* stat data is updated in reiser4 context */
+		ctx = reiser4_init_context(inode->i_sb);
+		if (IS_ERR(ctx))
+			return 0;
+		ret = reiser4_grab_space_force(unix_file_estimate_read(inode,
+								       count),
+					       BA_CAN_COMMIT);
+		if (ret) {
+			reiser4_exit_context(ctx);
+			return 0;
+		}
+	}
+	*result = new_sync_read(file, buf, count, off);
+	if (ctx != NULL) {
+		context_set_commit_async(ctx);
+		reiser4_exit_context(ctx);
+	}
+	if (read_seqcount_retry(&uf_info->conv_seq, seq)) {
+		/* file was being converted, read it again */
+		*off = pos;
+		return 0;
+	}
+	return 1;
+}
 
 /**
  * unix-file specific ->read() method
@@ -1729,6 +1941,9 @@ ssize_t read_unix_file(struct file *file, char __user *buf,
 	inode = file_inode(file);
 	assert("vs-972", !reiser4_inode_get_flag(inode, REISER4_NO_SD));
 
+	if (read_unix_file_cached(file, buf, read_amount, off, &result))
+		return result;
+
 	ctx = reiser4_init_context(inode->i_sb);
 	if (IS_ERR(ctx))
 		return PTR_ERR(ctx);
@@ -1752,7 +1967,13 @@ ssize_t read_unix_file(struct file *file, char __user *buf,
 	switch (uf_info->container) {
 	case UF_CONTAINER_EXTENTS:
 		if (!reiser4_inode_get_flag(inode, REISER4_PART_MIXED)) {
-			result = new_sync_read(file, buf, read_amount, off);
+			if (file->f_flags & O_DIRECT)
+				result = read_unix_file_direct(file, buf,
+							       read_amount,
+							       off);
+			else
+				result = new_sync_read(file, buf, read_amount,
+						       off);
 			break;
 		}
 	case UF_CONTAINER_TAILS:
@@ -1794,6 +2015,8 @@ static ssize_t read_compound_file(struct file *file, char __user *buf,
 	size_t to_read;
 	size_t was_read = 0;
 	loff_t i_size;
+	loff_t ra_end;
+	ra_info_t ra_info;
 
 	inode = file_inode(file);
 	assert("vs-972", !reiser4_inode_get_flag(inode, REISER4_NO_SD));
@@ -1816,6 +2039,15 @@ static ssize_t read_compound_file(struct file *file, char __user *buf,
 	}
 	uf_info = unix_file_inode_data(inode);
 
+	/* leaves with tails of the whole request are read in one batch. If
+	   this read continues the previous one, extend that to the readahead
+	   window of the file */
+	ra_end = *off + count;
+	if (reiser4_seal_is_set(&hint->seal) && hint->offset == *off)
+		ra_end = max_t(loff_t, ra_end, *off +
+			       ((loff_t)file->f_ra.ra_pages << PAGE_SHIFT));
+	key_by_inode_and_offset_common(inode, ra_end - 1, &ra_info.key_to_stop);
+
 	/* read by page-aligned chunks */
 	to_read = PAGE_SIZE - (*off & (loff_t)(PAGE_SIZE - 1));
 	if (to_read > count)
@@ -1829,7 +2061,8 @@ static ssize_t read_compound_file(struct file *file, char __user *buf,
 		if (result)
 			return RETERR(-EFAULT);
 
-		result = do_read_compound_file(hint, file, buf, to_read, off);
+		result = do_read_compound_file(hint, file, buf, to_read, off,
+					       &ra_info);
 		if (result < 0)
 			break;
 		count -= result;
@@ -2086,7 +2319,7 @@ ssize_t write_unix_file(struct file *file,
 	struct inode *inode;
 	struct unix_file_info *uf_info;
 	ssize_t written;
-	int to_write = PAGE_SIZE * WRITE_GRANULARITY;
+	size_t to_write;
 	size_t left;
 	ssize_t (*write_op)(struct file *, struct inode *,
 			    const char __user *, size_t,
@@ -2116,14 +2349,25 @@ ssize_t write_unix_file(struct file *file,
 	ea = NEITHER_OBTAINED;
 	enospc = 0;
 
+	if (file->f_flags & O_DIRECT) {
+		get_nonexclusive_access(uf_info);
+		written = write_unix_file_direct(file, buf, left, pos);
+		drop_nonexclusive_access(uf_info);
+		if (written < 0) {
+			context_set_commit_async(ctx);
+			return written;
+		}
+		left -= written;
+		buf += written;
+		reiser4_txn_restart(ctx);
+	}
+
 	new_size = i_size_read(inode);
-	if (*pos + count > new_size)
-		new_size = *pos + count;
+	if (*pos + left > new_size)
+		new_size = *pos + left;
 
 	while (left) {
 		int update_sd = 0;
-		if (left < to_write)
-			to_write = left;
 
 		if (uf_info->container == UF_CONTAINER_EMPTY) {
 			get_exclusive_access(uf_info);
@@ -2163,8 +2407,13 @@ ssize_t write_unix_file(struct file *file,
 			else
 				write_op = reiser4_write_tail;
 		} else {
-			/* file is built of tail items */
-			if (should_have_notail(uf_info, new_size)) {
+			/*
+			 * file is built of tail items. If it is to be converted
+			 * to extents, leave that to conversion worker when
+			 * possible and keep writing tails
+			 */
+			if (should_have_notail(uf_info, new_size) &&
+			    reiser4_queue_tail2extent(inode) != 0) {
 				if (ea == NEA_OBTAINED) {
 					drop_nonexclusive_access(uf_info);
 					get_exclusive_access(uf_info);
@@ -2201,6 +2450,13 @@ ssize_t write_unix_file(struct file *file,
 			write_op = reiser4_write_tail;
 		}
 
+		/* extent write handles large writes in batches */
+		if (write_op == reiser4_write_extent)
+			to_write = PAGE_SIZE * WRITE_BATCH;
+		else
+			to_write = PAGE_SIZE * WRITE_GRANULARITY;
+		if (left < to_write)
+			to_write = left;
 		written = write_op(file, inode, buf, to_write, pos);
 		if (written == -ENOSPC && !enospc) {
 			drop_access(uf_info);
@@ -2357,6 +2613,11 @@ int release_unix_file(struct inode *inode, struct file *file)
 		 */
 		warning("vs-44", "out of memory?");
 	}
+	/* last writer is gone: file is not going to grow anymore */
+	if ((file->f_mode & FMODE_WRITE) &&
+	    atomic_read(&inode->i_writecount) == 1)
+		reiser4_release_alloc_window(inode->i_sb,
+					     &unix_file_inode_data(inode)->window);
 
 	reiser4_free_file_fsdata(file);
 
@@ -2424,123 +2685,1353 @@ static int unpack(struct file *filp, struct inode *inode, int forever)
 	return result;
 }
 
-/* implentation of vfs' ioctl method of struct file_operations for unix file
-   plugin
-*/
-int ioctl_unix_file(struct file *filp, unsigned int cmd,
-		    unsigned long arg UNUSED_ARG)
-{
-	reiser4_context *ctx;
-	int result;
-	struct inode *inode = filp->f_path.dentry->d_inode;
+/* pages captured for relocation per atom */
+#define DEFRAG_BATCH (256)
+/* default limit of pages relocated per second */
+#define DEFRAG_DEFAULT_RATE (8192)
+
+struct extent_walk {
+	reiser4_key key;	/* key of the file body */
+	__u64 from;		/* page index to start from */
+	int find_allocated;	/* stop at first allocated extent */
+	__u64 nr_extents;	/* number of disk extents met */
+	reiser4_block_nr last_end;	/* end of last disk extent */
+	__u64 index;		/* first allocated extent found */
+	__u64 width;
+};
 
-	ctx = reiser4_init_context(inode->i_sb);
-	if (IS_ERR(ctx))
-		return PTR_ERR(ctx);
+/* actor for reiser4_iterate_tree() called for each extent unit of file */
+static int extent_walk_actor(reiser4_tree *tree UNUSED_ARG, coord_t *coord,
+			     lock_handle *lh UNUSED_ARG, void *arg)
+{
+	struct extent_walk *walk = arg;
+	reiser4_extent *ext;
+	reiser4_key key;
+	reiser4_block_nr start;
+	__u64 index;
+	__u64 width;
+	int contiguous;
+
+	item_key_by_coord(coord, &key);
+	if (!item_is_extent(coord) || !all_but_offset_key_eq(&key, &walk->key))
+		/* end of file body */
+		return 0;
 
-	switch (cmd) {
-	case REISER4_IOC_UNPACK:
-		get_exclusive_access(unix_file_inode_data(inode));
-		result = unpack(filp, inode, 1 /* forever */ );
-		drop_exclusive_access(unix_file_inode_data(inode));
-		break;
+	ext = extent_by_coord(coord);
+	index = extent_unit_index(coord);
+	width = extent_get_width(ext);
+	if (state_of_extent(ext) != ALLOCATED_EXTENT)
+		return 1;
 
-	default:
-		result = RETERR(-ENOTTY);
-		break;
+	start = extent_get_start(ext);
+	if (index + width <= walk->from) {
+		/* unit holding page @walk->from - 1 */
+		walk->last_end = start + width;
+		return 1;
 	}
-	reiser4_exit_context(ctx);
-	return result;
+	if (index < walk->from) {
+		start += walk->from - index;
+		width -= walk->from - index;
+		index = walk->from;
+		/* the rest of unit follows page @walk->from - 1 on disk */
+		walk->last_end = start;
+	}
+	/* neighbouring units can be contiguous on disk */
+	contiguous = (start == walk->last_end);
+	walk->last_end = start + width;
+	if (walk->find_allocated) {
+		if (contiguous)
+			/* already in place, nothing to relocate */
+			return 1;
+		walk->index = index;
+		walk->width = width;
+		return 0;
+	}
+	if (!contiguous)
+		walk->nr_extents++;
+	return 1;
 }
 
-/* implentation of vfs' bmap method of struct address_space_operations for unix
-   file plugin
-*/
-sector_t bmap_unix_file(struct address_space * mapping, sector_t lblock)
+/* walk extents of file starting from page @walk->from. Page preceding
+   @walk->from is looked at as well to find whether the first extent
+   walked is contiguous with it */
+static int walk_file_extents(struct inode *inode, struct extent_walk *walk)
 {
-	reiser4_context *ctx;
-	sector_t result;
-	reiser4_key key;
 	coord_t coord;
 	lock_handle lh;
-	struct inode *inode;
-	item_plugin *iplug;
-	sector_t block;
-
-	inode = mapping->host;
+	reiser4_key key;
+	int result;
 
-	ctx = reiser4_init_context(inode->i_sb);
-	if (IS_ERR(ctx))
-		return PTR_ERR(ctx);
+	walk->last_end = 0;
+	key_by_inode_and_offset_common(inode, 0, &walk->key);
 	key_by_inode_and_offset_common(inode,
-				       (loff_t) lblock * current_blocksize,
-				       &key);
+				       (loff_t)(walk->from ? walk->from - 1 : 0)
+				       << PAGE_SHIFT, &key);
 
 	init_lh(&lh);
-	result =
-	    find_file_item_nohint(&coord, &lh, &key, ZNODE_READ_LOCK, inode);
+	result = find_file_item_nohint(&coord, &lh, &key, ZNODE_READ_LOCK,
+				       inode);
 	if (cbk_errored(result)) {
 		done_lh(&lh);
-		reiser4_exit_context(ctx);
 		return result;
 	}
-
-	result = zload(coord.node);
-	if (result) {
+	if (result != CBK_COORD_FOUND || coord.between != AT_UNIT) {
+		/* nothing after @walk->from */
 		done_lh(&lh);
-		reiser4_exit_context(ctx);
-		return result;
+		return 0;
 	}
-
-	iplug = item_plugin_by_coord(&coord);
-	if (iplug->s.file.get_block) {
-		result = iplug->s.file.get_block(&coord, lblock, &block);
-		if (result == 0)
-			result = block;
-	} else
-		result = RETERR(-EINVAL);
-
-	zrelse(coord.node);
+	result = reiser4_iterate_tree(reiser4_tree_by_inode(inode), &coord,
+				      &lh, extent_walk_actor, walk,
+				      ZNODE_READ_LOCK, 1);
 	done_lh(&lh);
-	reiser4_exit_context(ctx);
+	if (result == -E_NO_NEIGHBOR)
+		/* end of tree */
+		result = 0;
 	return result;
 }
 
-/**
- * flow_by_inode_unix_file - initizlize structure flow
- * @inode: inode of file for which read or write is abou
- * @buf: buffer to perform read to or write from
- * @user: flag showing whether @buf is user space or kernel space
- * @size: size of buffer @buf
- * @off: start offset fro read or write
- * @op: READ or WRITE
- * @flow:
- *
- * Initializes fields of @flow: key, size of data, i/o mode (read or write).
- */
-int flow_by_inode_unix_file(struct inode *inode,
-			    const char __user *buf, int user,
-			    loff_t size, loff_t off,
-			    rw_op op, flow_t *flow)
+/* count disk extents of file */
+static int count_file_extents(struct inode *inode, __u64 *count)
 {
-	assert("nikita-1100", inode != NULL);
+	struct extent_walk walk;
+	int result;
 
-	flow->length = size;
-	memcpy(&flow->data, &buf, sizeof(buf));
-	flow->user = user;
-	flow->op = op;
-	assert("nikita-1931", inode_file_plugin(inode) != NULL);
-	assert("nikita-1932",
-	       inode_file_plugin(inode)->key_by_inode ==
-	       key_by_inode_and_offset_common);
-	/* calculate key of write position and insert it into flow->key */
-	return key_by_inode_and_offset_common(inode, off, &flow->key);
+	memset(&walk, 0, sizeof(walk));
+	result = walk_file_extents(inode, &walk);
+	*count = walk.nr_extents;
+	return result;
 }
 
-/* plugin->u.file.set_plug_in_sd = NULL
-   plugin->u.file.set_plug_in_inode = NULL
-   plugin->u.file.create_blank_sd = NULL */
-/* plugin->u.file.delete */
+/* capture page @index of file and mark its jnode for relocation */
+static int capture_for_relocation(struct file *filp, struct inode *inode,
+				  pgoff_t index)
+{
+	struct page *page;
+	jnode *node;
+	int result;
+
+	page = read_mapping_page(inode->i_mapping, index, filp);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+
+	lock_page(page);
+	if (page->mapping != inode->i_mapping) {
+		/* truncated meanwhile */
+		unlock_page(page);
+		put_page(page);
+		return 0;
+	}
+	node = jnode_of_page(page);
+	if (IS_ERR(node)) {
+		unlock_page(page);
+		put_page(page);
+		return PTR_ERR(node);
+	}
+	JF_SET(node, JNODE_WRITE_PREPARED);
+	set_page_dirty_notag(page);
+	unlock_page(page);
+
+	/* flush relocates extents whose jnodes are marked for repacking */
+	JF_SET(node, JNODE_REPACK);
+	do {
+		if (node->blocknr == 0) {
+			/* page was read without jnode. Take block number from
+			   the extent, capture and dirty jnode like
+			   find_or_create_extent does */
+			result = reiser4_update_extent(inode, node,
+						       page_offset(page), NULL);
+		} else {
+			spin_lock_jnode(node);
+			result = reiser4_try_capture(node, ZNODE_WRITE_LOCK,
+						     0);
+			if (result == 0)
+				jnode_make_dirty_locked(node);
+			spin_unlock_jnode(node);
+		}
+		/* capture may have to wait for a committing atom */
+	} while (result == -E_REPEAT);
+
+	JF_CLR(node, JNODE_WRITE_PREPARED);
+	jput(node);
+	put_page(page);
+	return result;
+}
+
+/* commit current atom, so that captured pages get relocated */
+static void defrag_commit(void)
+{
+	reiser4_context *ctx = get_current_context();
+	txn_atom *atom;
+
+	atom = get_current_atom_locked_nocheck();
+	if (atom == NULL)
+		return;
+	spin_lock_txnh(ctx->trans);
+	force_commit_atom(ctx->trans);
+	all_grabbed2free();
+}
+
+/*
+ * defragment - relocate blocks of file built of extents
+ *
+ * Allocated extents of the file are captured DEFRAG_BATCH pages at a time
+ * and the atom is committed. Flush relocates dirty extents to a contiguous
+ * range allocated after the preceder, and commit makes the relocation
+ * persistent. Exclusive access must be held.
+ */
+static int defragment(struct file *filp, struct inode *inode,
+		      struct reiser4_defrag_args *args)
+{
+	struct unix_file_info *uf_info;
+	struct extent_walk walk;
+	unsigned long start_time;
+	unsigned long expected;
+	__u64 rate;
+	__u64 done;
+	int batch;
+	int result;
+
+	uf_info = unix_file_inode_data(inode);
+	assert("jalex-23", ea_obtained(uf_info));
+
+	args->extents_before = args->extents_after = 0;
+	result = find_file_state(inode, uf_info);
+	if (result)
+		return result;
+	if (uf_info->container != UF_CONTAINER_EXTENTS)
+		/* nothing to defragment */
+		return 0;
+
+	result = count_file_extents(inode, &args->extents_before);
+	if (result)
+		return result;
+	if (args->extents_before <= 1) {
+		args->extents_after = args->extents_before;
+		return 0;
+	}
+
+	rate = args->rate ? args->rate : DEFRAG_DEFAULT_RATE;
+	start_time = jiffies;
+	done = 0;
+
+	memset(&walk, 0, sizeof(walk));
+	walk.find_allocated = 1;
+	while (1) {
+		walk.width = 0;
+		result = walk_file_extents(inode, &walk);
+		if (result || walk.width == 0)
+			break;
+
+		batch = min_t(__u64, walk.width, DEFRAG_BATCH);
+		grab_space_enable();
+		result = reiser4_grab_space((__u64)batch *
+			(1 + estimate_one_insert_into_item(reiser4_tree_by_inode(inode))),
+			BA_CAN_COMMIT);
+		if (result)
+			break;
+		for (; batch > 0; batch--, walk.index++, done++) {
+			result = capture_for_relocation(filp, inode, walk.index);
+			if (result)
+				break;
+		}
+		defrag_commit();
+		if (result)
+			break;
+		walk.from = walk.index;
+
+		if (signal_pending(current)) {
+			result = RETERR(-EINTR);
+			break;
+		}
+		/* rate limit */
+		expected = start_time + (unsigned long)div64_u64(done * HZ, rate);
+		if (time_before(jiffies, expected) &&
+		    schedule_timeout_interruptible(expected - jiffies)) {
+			result = RETERR(-EINTR);
+			break;
+		}
+	}
+	if (count_file_extents(inode, &args->extents_after))
+		args->extents_after = 0;
+	return result;
+}
+
+/* implentation of vfs' ioctl method of struct file_operations for unix file
+   plugin
+*/
+int ioctl_unix_file(struct file *filp, unsigned int cmd,
+		    unsigned long arg)
+{
+	reiser4_context *ctx;
+	int result;
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct reiser4_defrag_args args;
+
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	switch (cmd) {
+	case REISER4_IOC_UNPACK:
+		get_exclusive_access(unix_file_inode_data(inode));
+		result = unpack(filp, inode, 1 /* forever */ );
+		drop_exclusive_access(unix_file_inode_data(inode));
+		break;
+
+	case REISER4_IOC_DEFRAG:
+		if (!(filp->f_mode & FMODE_WRITE)) {
+			result = RETERR(-EBADF);
+			break;
+		}
+		if (copy_from_user(&args, (void __user *)arg, sizeof(args))) {
+			result = RETERR(-EFAULT);
+			break;
+		}
+		get_exclusive_access_careful(unix_file_inode_data(inode),
+					     inode);
+		result = defragment(filp, inode, &args);
+		drop_exclusive_access(unix_file_inode_data(inode));
+		if (copy_to_user((void __user *)arg, &args, sizeof(args)) &&
+		    result == 0)
+			result = RETERR(-EFAULT);
+		break;
+
+	default:
+		result = RETERR(-ENOTTY);
+		break;
+	}
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/* get index of the first page which is not addressed by file body */
+static int find_body_end(struct inode *inode, pgoff_t *end)
+{
+	coord_t coord;
+	lock_handle lh;
+	reiser4_key key;
+	int result;
+
+	*end = 0;
+	key_by_inode_and_offset_common(inode,
+				       get_key_offset(reiser4_max_key()),
+				       &key);
+	coord_init_zero(&coord);
+	init_lh(&lh);
+	result = find_file_item_nohint(&coord, &lh, &key, ZNODE_READ_LOCK,
+				       inode);
+	if (cbk_errored(result)) {
+		done_lh(&lh);
+		return result;
+	}
+	if (result != CBK_COORD_FOUND) {
+		/* file is empty */
+		done_lh(&lh);
+		return 0;
+	}
+	result = zload(coord.node);
+	if (result) {
+		done_lh(&lh);
+		return result;
+	}
+	if (item_is_extent(&coord) && coord.between == AFTER_UNIT) {
+		append_key_extent(&coord, &key);
+		*end = get_key_offset(&key) >> PAGE_SHIFT;
+	} else
+		result = RETERR(-EIO);
+	zrelse(coord.node);
+	done_lh(&lh);
+	return result;
+}
+
+/* zero bytes [@from, @to) of one page of file built of extents */
+static int zero_page_range(struct inode *inode, loff_t from, loff_t to)
+{
+	struct page *page;
+	int result;
+
+	if (from >= inode->i_size)
+		/* nothing to zero after end of file */
+		return 0;
+
+	result = reserve_partial_page(reiser4_tree_by_inode(inode));
+	if (result) {
+		reiser4_release_reserved(inode->i_sb);
+		return result;
+	}
+	page = read_mapping_page(inode->i_mapping, from >> PAGE_SHIFT, NULL);
+	if (IS_ERR(page)) {
+		/* the below does up(sbinfo->delete_mutex) */
+		reiser4_release_reserved(inode->i_sb);
+		return PTR_ERR(page);
+	}
+	wait_on_page_locked(page);
+	if (!PageUptodate(page))
+		result = RETERR(-EIO);
+	else
+		result = find_or_create_extent(page);
+	if (result == 0) {
+		lock_page(page);
+		zero_user_segment(page, from & (PAGE_SIZE - 1),
+				  ((to - 1) & (PAGE_SIZE - 1)) + 1);
+		unlock_page(page);
+	}
+	put_page(page);
+	/* the below does up(sbinfo->delete_mutex) */
+	reiser4_release_reserved(inode->i_sb);
+	return result;
+}
+
+/* update actor for cut_file_items which leaves file size as it is */
+static int keep_file_size(struct inode *inode UNUSED_ARG,
+			  loff_t new_size UNUSED_ARG, int update_sd UNUSED_ARG)
+{
+	return 0;
+}
+
+/*
+ * kernels which predate UNWRITTEN_EXTENT_VERSION of disk format do not know
+ * unwritten extents. Upgrade the volume before the first one is created
+ */
+static int enable_unwritten_extents(struct super_block *super)
+{
+	reiser4_super_info_data *sbinfo = get_super_private(super);
+	int result;
+
+	if (sbinfo->version >= UNWRITTEN_EXTENT_VERSION)
+		return 0;
+	result = sbinfo->df_plug->version_update(super,
+						 UNWRITTEN_EXTENT_VERSION);
+	/* commit the upgrade before any unwritten extent */
+	reiser4_txn_restart_current();
+	if (result)
+		return result;
+	if (sbinfo->version < UNWRITTEN_EXTENT_VERSION)
+		/* volume could not be upgraded */
+		return RETERR(-EOPNOTSUPP);
+	return 0;
+}
+
+/*
+ * preallocate blocks for range of file. Unlike holes filled by writes, holes
+ * filled by preallocation get allocated blocks right away. Those are
+ * unwritten extents which read as holes until written
+ */
+static int prealloc_unix_file(struct file *file, struct inode *inode,
+			      loff_t offset, loff_t len)
+{
+	struct unix_file_info *uf_info;
+	pgoff_t body_end;
+	loff_t end;
+	int result;
+
+	uf_info = unix_file_inode_data(inode);
+	end = offset + len;
+
+	result = enable_unwritten_extents(inode->i_sb);
+	if (result)
+		return result;
+	/*
+	 * preallocated file is built of extents. Do not let release convert
+	 * it back to tails
+	 */
+	result = unpack(file, inode, 1 /* forever */);
+	if (result)
+		return result;
+	result = find_body_end(inode, &body_end);
+	if (result)
+		return result;
+	if (((loff_t)body_end << PAGE_SHIFT) < end) {
+		/* append file body with hole as expanding truncate does */
+		result = reiser4_write_extent(NULL, inode, NULL, 0, &end);
+		all_grabbed2free();
+		reiser4_txn_restart_current();
+		if (result)
+			return result;
+		uf_info->container = UF_CONTAINER_EXTENTS;
+	}
+	return reiser4_prealloc_extent(inode, offset >> PAGE_SHIFT,
+				       (offset + len + PAGE_SIZE - 1) >>
+				       PAGE_SHIFT);
+}
+
+/*
+ * punch hole in range of file. Partial pages at range edges are zeroed,
+ * blocks of the rest are freed
+ */
+static int punch_hole_unix_file(struct file *file, struct inode *inode,
+				loff_t offset, loff_t len)
+{
+	struct unix_file_info *uf_info;
+	pgoff_t first, last, body_end;
+	loff_t end;
+	int result;
+
+	uf_info = unix_file_inode_data(inode);
+	end = offset + len;
+
+	/* wait for aio direct i/o to blocks being punched */
+	inode_dio_wait(inode);
+	result = unpack(file, inode, 0);
+	if (result)
+		return result;
+	if (uf_info->container != UF_CONTAINER_EXTENTS)
+		/* file is empty */
+		return 0;
+
+	first = (offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	last = end >> PAGE_SHIFT;
+	if (first > last)
+		/* range is within one page */
+		return zero_page_range(inode, offset, end);
+	if (offset < ((loff_t)first << PAGE_SHIFT)) {
+		result = zero_page_range(inode, offset,
+					 (loff_t)first << PAGE_SHIFT);
+		if (result)
+			return result;
+	}
+	if (end > ((loff_t)last << PAGE_SHIFT)) {
+		result = zero_page_range(inode, (loff_t)last << PAGE_SHIFT,
+					 end);
+		if (result)
+			return result;
+	}
+
+	result = find_body_end(inode, &body_end);
+	if (result)
+		return result;
+	if (last > body_end)
+		last = body_end;
+	if (first >= last)
+		return 0;
+	if (last < body_end)
+		/*
+		 * range is in the middle of file body. Items can not be cut
+		 * there: that would shift the rest of file body
+		 */
+		return reiser4_punch_extent(inode, first, last);
+
+	/*
+	 * range reaches end of file body: cut items off and append file body
+	 * with hole of the same length
+	 */
+	result = cut_file_items(inode, (loff_t)first << PAGE_SHIFT,
+				0 /* update_sd */, (loff_t)last << PAGE_SHIFT,
+				keep_file_size);
+	if (result)
+		return result;
+	if (first == 0)
+		uf_info->container = UF_CONTAINER_EMPTY;
+	end = (loff_t)last << PAGE_SHIFT;
+	result = reiser4_write_extent(NULL, inode, NULL, 0, &end);
+	if (result == 0)
+		uf_info->container = UF_CONTAINER_EXTENTS;
+	all_grabbed2free();
+	reiser4_txn_restart_current();
+	return result;
+}
+
+/**
+ * fallocate_unix_file - fallocate of struct file_operations
+ * @file: file to allocate space for
+ * @mode: FALLOC_FL_KEEP_SIZE and FALLOC_FL_PUNCH_HOLE are supported
+ * @offset: start of range
+ * @len: length of range
+ *
+ * Preallocates disk blocks for range of file, extending the file unless
+ * FALLOC_FL_KEEP_SIZE is set, or punches hole in it.
+ */
+long fallocate_unix_file(struct file *file, int mode, loff_t offset,
+			 loff_t len)
+{
+	reiser4_context *ctx;
+	struct inode *inode;
+	struct unix_file_info *uf_info;
+	__u64 tograb;
+	int result;
+
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+		return RETERR(-EOPNOTSUPP);
+
+	inode = file_inode(file);
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	inode_lock(inode);
+	uf_info = unix_file_inode_data(inode);
+	get_exclusive_access_careful(uf_info, inode);
+
+	if (mode & FALLOC_FL_PUNCH_HOLE)
+		result = punch_hole_unix_file(file, inode, offset, len);
+	else
+		result = prealloc_unix_file(file, inode, offset, len);
+	if (result == 0) {
+		grab_space_enable();
+		tograb = inode_file_plugin(inode)->estimate.update(inode);
+		result = reiser4_grab_space(tograb, BA_CAN_COMMIT);
+	}
+	if (result == 0) {
+		inode->i_ctime = CURRENT_TIME;
+		if (mode & FALLOC_FL_PUNCH_HOLE)
+			inode->i_mtime = inode->i_ctime;
+		else if (!(mode & FALLOC_FL_KEEP_SIZE) &&
+			 offset + len > inode->i_size)
+			INODE_SET_SIZE(inode, offset + len);
+		result = reiser4_update_sd(inode);
+	}
+
+	drop_exclusive_access(uf_info);
+	inode_unlock(inode);
+	context_set_commit_async(ctx);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/**
+ * body_map_add - report range of file data
+ * @map: body map
+ * @off: offset of range in file
+ * @len: length of range
+ * @phys: disk address of range in bytes
+ * @flags: FIEMAP_EXTENT_* flags of range
+ *
+ * Called by ->map() methods of items. Part of range which does not follow
+ * the end of the previously reported range is dropped: the walk may start in
+ * the middle of an item, and all items of one disk cluster of cryptcompress
+ * file report the same logical cluster.
+ */
+int body_map_add(struct body_map *map, loff_t off, loff_t len,
+		 __u64 phys, __u32 flags)
+{
+	if (off + len <= map->end)
+		return 0;
+	if (off < map->end) {
+		if (!(flags & FIEMAP_EXTENT_UNKNOWN))
+			phys += map->end - off;
+		len -= map->end - off;
+		off = map->end;
+	}
+	map->end = off + len;
+	return map->actor(map, off, len, phys, flags);
+}
+
+/* actor for reiser4_iterate_tree() called for each item of file */
+static int body_map_actor(reiser4_tree *tree UNUSED_ARG, coord_t *coord,
+			  lock_handle *lh UNUSED_ARG, void *arg)
+{
+	struct body_map *map = arg;
+	item_plugin *iplug;
+	int result;
+
+	if (!owns_item_common(map->inode, coord))
+		/* end of file body */
+		return 0;
+	iplug = item_plugin_by_coord(coord);
+	if (!plugin_of_group(iplug, UNIX_FILE_METADATA_ITEM_TYPE))
+		/* stat data */
+		return 1;
+	if (iplug->s.file.map == NULL)
+		return RETERR(-EIO);
+
+	result = iplug->s.file.map(coord, map->inode, map);
+	if (result < 0)
+		return result;
+	return result == 0;
+}
+
+/**
+ * reiser4_map_file_body - walk items of file body
+ * @inode: file to map
+ * @from: offset to start from
+ * @map: body map, ->actor is to be set by caller
+ *
+ * Calls ->map() method of items of file body in key order starting from the
+ * item which addresses offset @from. File data are not read. Caller has to
+ * keep file from conversion.
+ */
+int reiser4_map_file_body(struct inode *inode, loff_t from,
+			  struct body_map *map)
+{
+	coord_t coord;
+	lock_handle lh;
+	reiser4_key key;
+	int result;
+
+	map->inode = inode;
+	map->end = from;
+	inode_file_plugin(inode)->key_by_inode(inode, from, &key);
+
+	coord_init_zero(&coord);
+	init_lh(&lh);
+	result = find_file_item_nohint(&coord, &lh, &key, ZNODE_READ_LOCK,
+				       inode);
+	if (cbk_errored(result)) {
+		done_lh(&lh);
+		return result;
+	}
+	result = zload(coord.node);
+	if (result) {
+		done_lh(&lh);
+		return result;
+	}
+	if (!coord_is_existing_item(&coord)) {
+		/* nothing to walk */
+		zrelse(coord.node);
+		done_lh(&lh);
+		return 0;
+	}
+	/* iterate over items */
+	coord.unit_pos = 0;
+	coord.between = AT_UNIT;
+	zrelse(coord.node);
+
+	result = reiser4_iterate_tree(reiser4_tree_by_inode(inode), &coord,
+				      &lh, body_map_actor, map,
+				      ZNODE_READ_LOCK, 0);
+	done_lh(&lh);
+	if (result == -E_NO_NEIGHBOR)
+		/* end of tree */
+		result = 0;
+	return result < 0 ? result : 0;
+}
+
+/* number of ranges fiemap collects in one walk of file body */
+#define FIEMAP_BATCH (64)
+
+struct fiemap_range {
+	loff_t off;
+	loff_t len;
+	__u64 phys;
+	__u32 flags;
+};
+
+struct fiemap_walk {
+	struct body_map map;
+	/* end of requested range of file */
+	loff_t stop;
+	/* set when range beyond @stop is met */
+	int beyond;
+	int nr;
+	struct fiemap_range ranges[FIEMAP_BATCH];
+};
+
+/* check whether range @next continues range @prev */
+static int fiemap_ranges_mergeable(const struct fiemap_range *prev,
+				   loff_t off, __u64 phys, __u32 flags)
+{
+	return prev->flags == flags && prev->off + prev->len == off &&
+		((flags & FIEMAP_EXTENT_UNKNOWN) ||
+		 prev->phys + prev->len == phys);
+}
+
+static int fiemap_actor(struct body_map *map, loff_t off, loff_t len,
+			__u64 phys, __u32 flags)
+{
+	struct fiemap_walk *walk;
+	struct fiemap_range *range;
+
+	walk = container_of(map, struct fiemap_walk, map);
+	if (off >= walk->stop) {
+		walk->beyond = 1;
+		return 1;
+	}
+	if (walk->nr != 0) {
+		range = &walk->ranges[walk->nr - 1];
+		if (fiemap_ranges_mergeable(range, off, phys, flags)) {
+			range->len += len;
+			return 0;
+		}
+	}
+	if (walk->nr == FIEMAP_BATCH)
+		/* next walk starts at the end of the last collected range */
+		return 1;
+	range = &walk->ranges[walk->nr++];
+	range->off = off;
+	range->len = len;
+	range->phys = phys;
+	range->flags = flags;
+	return 0;
+}
+
+/**
+ * reiser4_fiemap_body - report extents of file body to fiemap
+ * @inode: file to map
+ * @fieinfo: fiemap request
+ * @start: start of range to map
+ * @len: length of range to map
+ *
+ * Ranges are collected by walks of file body under tree locks and copied to
+ * user space after every walk. Caller has to keep file from conversion.
+ */
+int reiser4_fiemap_body(struct inode *inode, struct fiemap_extent_info *fieinfo,
+			__u64 start, __u64 len)
+{
+	struct fiemap_walk *walk;
+	struct fiemap_range pending;
+	loff_t from;
+	int last;
+	int i;
+	int result;
+
+	result = fiemap_check_flags(fieinfo, FIEMAP_FLAG_SYNC);
+	if (result)
+		return result;
+
+	walk = kmalloc(sizeof(*walk), reiser4_ctx_gfp_mask_get());
+	if (walk == NULL)
+		return RETERR(-ENOMEM);
+	walk->map.actor = fiemap_actor;
+	walk->stop = start + len;
+	walk->beyond = 0;
+
+	pending.len = 0;
+	from = start;
+	while (1) {
+		walk->nr = 0;
+		result = reiser4_map_file_body(inode, from, &walk->map);
+		if (result)
+			break;
+		for (i = 0; i < walk->nr; i++) {
+			struct fiemap_range *range = &walk->ranges[i];
+
+			if (pending.len != 0 &&
+			    fiemap_ranges_mergeable(&pending, range->off,
+						    range->phys,
+						    range->flags)) {
+				pending.len += range->len;
+				continue;
+			}
+			if (pending.len != 0) {
+				result = fiemap_fill_next_extent(fieinfo,
+								 pending.off,
+								 pending.phys,
+								 pending.len,
+								 pending.flags);
+				if (result)
+					goto out;
+			}
+			pending = *range;
+		}
+		if (walk->nr < FIEMAP_BATCH || walk->beyond)
+			break;
+		from = walk->ranges[walk->nr - 1].off +
+			walk->ranges[walk->nr - 1].len;
+	}
+	if (result == 0 && pending.len != 0) {
+		/* the end of file body is reached unless a range beyond the
+		   requested one is met */
+		last = walk->beyond ? 0 : FIEMAP_EXTENT_LAST;
+		result = fiemap_fill_next_extent(fieinfo, pending.off,
+						 pending.phys, pending.len,
+						 pending.flags | last);
+	}
+ out:
+	kfree(walk);
+	/* 1 means that user's extent array is full */
+	return result < 0 ? result : 0;
+}
+
+struct seek_walk {
+	struct body_map map;
+	int origin;
+	/* found offset */
+	loff_t pos;
+	int found;
+};
+
+static int seek_actor(struct body_map *map, loff_t off, loff_t len,
+		      __u64 phys UNUSED_ARG, __u32 flags)
+{
+	struct seek_walk *walk;
+
+	walk = container_of(map, struct seek_walk, map);
+	if (flags & FIEMAP_EXTENT_UNWRITTEN)
+		/* unwritten extent reads as zeros, consider it a hole */
+		return 0;
+	if (walk->origin == SEEK_DATA) {
+		walk->pos = off;
+		walk->found = 1;
+		return 1;
+	}
+	if (off > walk->pos)
+		/* hole at @walk->pos */
+		return 1;
+	walk->pos = off + len;
+	return 0;
+}
+
+/**
+ * reiser4_seek_body - SEEK_DATA and SEEK_HOLE
+ * @file: file to seek
+ * @inode: inode of @file
+ * @offset: offset to start from
+ * @origin: SEEK_DATA or SEEK_HOLE
+ *
+ * Looks for data or hole by walking items of file body. Holes of files built
+ * of tail items and zeros of compressed clusters are not detected. Caller has
+ * to keep file from conversion.
+ */
+loff_t reiser4_seek_body(struct file *file, struct inode *inode, loff_t offset,
+			 int origin)
+{
+	struct seek_walk walk;
+	loff_t size;
+	int result;
+
+	assert("jalex-38", origin == SEEK_DATA || origin == SEEK_HOLE);
+
+	size = i_size_read(inode);
+	if (offset < 0 || offset >= size)
+		return RETERR(-ENXIO);
+
+	walk.map.actor = seek_actor;
+	walk.origin = origin;
+	walk.pos = offset;
+	walk.found = 0;
+	result = reiser4_map_file_body(inode, offset, &walk.map);
+	if (result)
+		return result;
+
+	if (origin == SEEK_DATA) {
+		if (!walk.found || walk.pos >= size)
+			return RETERR(-ENXIO);
+		offset = walk.pos;
+	} else
+		/* there is an implicit hole at the end of file */
+		offset = min(walk.pos, size);
+	return vfs_setpos(file, offset, inode->i_sb->s_maxbytes);
+}
+
+/**
+ * fiemap_unix_file - fiemap of struct inode_operations
+ * @inode: file to map
+ * @fieinfo: fiemap request
+ * @start: start of range to map
+ * @len: length of range to map
+ */
+int fiemap_unix_file(struct inode *inode, struct fiemap_extent_info *fieinfo,
+		     __u64 start, __u64 len)
+{
+	reiser4_context *ctx;
+	struct unix_file_info *uf_info;
+	int result;
+
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	uf_info = unix_file_inode_data(inode);
+	get_nonexclusive_access(uf_info);
+	result = reiser4_fiemap_body(inode, fieinfo, start, len);
+	drop_nonexclusive_access(uf_info);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/**
+ * llseek_unix_file - SEEK_DATA and SEEK_HOLE of unix file
+ * @file: file to seek
+ * @offset: offset to start from
+ * @origin: SEEK_DATA or SEEK_HOLE
+ */
+loff_t llseek_unix_file(struct file *file, loff_t offset, int origin)
+{
+	reiser4_context *ctx;
+	struct inode *inode;
+	struct unix_file_info *uf_info;
+	loff_t result;
+
+	inode = file_inode(file);
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	uf_info = unix_file_inode_data(inode);
+	get_nonexclusive_access(uf_info);
+	result = reiser4_seek_body(file, inode, offset, origin);
+	drop_nonexclusive_access(uf_info);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/* implentation of vfs' bmap method of struct address_space_operations for unix
+   file plugin
+*/
+sector_t bmap_unix_file(struct address_space * mapping, sector_t lblock)
+{
+	reiser4_context *ctx;
+	sector_t result;
+	reiser4_key key;
+	coord_t coord;
+	lock_handle lh;
+	struct inode *inode;
+	item_plugin *iplug;
+	sector_t block;
+
+	inode = mapping->host;
+
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	key_by_inode_and_offset_common(inode,
+				       (loff_t) lblock * current_blocksize,
+				       &key);
+
+	init_lh(&lh);
+	result =
+	    find_file_item_nohint(&coord, &lh, &key, ZNODE_READ_LOCK, inode);
+	if (cbk_errored(result)) {
+		done_lh(&lh);
+		reiser4_exit_context(ctx);
+		return result;
+	}
+
+	result = zload(coord.node);
+	if (result) {
+		done_lh(&lh);
+		reiser4_exit_context(ctx);
+		return result;
+	}
+
+	iplug = item_plugin_by_coord(&coord);
+	if (iplug->s.file.get_block) {
+		result = iplug->s.file.get_block(&coord, lblock, &block);
+		if (result == 0)
+			result = block;
+	} else
+		result = RETERR(-EINVAL);
+
+	zrelse(coord.node);
+	done_lh(&lh);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/*
+ * Direct I/O.
+ *
+ * Only files built of extents are read and written directly, and only when
+ * none of the pages of the range has dirty jnode: data of such pages are not
+ * on disk yet (unallocated extents) or are to be written by the atom machinery
+ * (overwrite and relocate sets), and when there are no pages dirtied via mmap.
+ * Writes are done only over allocated extents within i_size. In all other
+ * cases ->direct_IO() returns 0 and I/O falls back to page cache.
+ *
+ * read_unix_file() and write_unix_file() hold access to file, so they can not
+ * use generic helpers which write dirty pages out (that would need access
+ * again), and call direct_IO_unix_file() themselves.
+ */
+
+#define DIO_GANG_SIZE (16)
+
+/* true if some page of [@start, @end] has data which are to be written by
+   atom */
+static int range_has_dirty_jnodes(struct inode *inode, pgoff_t start,
+				  pgoff_t end)
+{
+	reiser4_tree *tree;
+	jnode *gang[DIO_GANG_SIZE];
+	int taken;
+	int result = 0;
+	int i;
+
+	tree = reiser4_tree_by_inode(inode);
+	read_lock_tree(tree);
+	while (result == 0 && start <= end) {
+		taken = radix_tree_gang_lookup(jnode_tree_by_inode(inode),
+					       (void **)gang, start,
+					       DIO_GANG_SIZE);
+		if (taken == 0)
+			break;
+		for (i = 0; i < taken; i++) {
+			if (index_jnode(gang[i]) > end)
+				break;
+			if (gang[i]->state & ((1 << JNODE_DIRTY) |
+					      (1 << JNODE_FLUSH_QUEUED) |
+					      (1 << JNODE_WRITEBACK) |
+					      (1 << JNODE_OVRWR) |
+					      (1 << JNODE_RELOC))) {
+				result = 1;
+				break;
+			}
+		}
+		if (i < taken)
+			break;
+		start = index_jnode(gang[taken - 1]) + 1;
+		if (start == 0)
+			break;
+	}
+	read_unlock_tree(tree);
+	return result;
+}
+
+/*
+ * find extent unit @index page of file falls into. Returns state of extent,
+ * first block corresponding to @index (allocated extent only) and number of
+ * pages from @index to the end of unit, or -ENOENT if there is no extent.
+ */
+static int map_extent(struct inode *inode, __u64 index,
+		      reiser4_block_nr *block, __u64 *nr)
+{
+	coord_t coord;
+	lock_handle lh;
+	reiser4_key key;
+	reiser4_extent *ext;
+	__u64 unit_index;
+	int result;
+
+	key_by_inode_and_offset_common(inode, (loff_t)index << PAGE_SHIFT,
+				       &key);
+	init_lh(&lh);
+	result = find_file_item_nohint(&coord, &lh, &key, ZNODE_READ_LOCK,
+				       inode);
+	if (cbk_errored(result)) {
+		done_lh(&lh);
+		return result;
+	}
+	if (result != CBK_COORD_FOUND || coord.between != AT_UNIT) {
+		done_lh(&lh);
+		return RETERR(-ENOENT);
+	}
+	result = zload(coord.node);
+	if (result) {
+		done_lh(&lh);
+		return result;
+	}
+	if (item_is_extent(&coord)) {
+		ext = extent_by_coord(&coord);
+		unit_index = extent_unit_index(&coord);
+		assert("jalex-31", index >= unit_index &&
+		       index < unit_index + extent_get_width(ext));
+		result = state_of_extent(ext);
+		*block = extent_get_start(ext) + index - unit_index;
+		*nr = unit_index + extent_get_width(ext) - index;
+	} else
+		result = RETERR(-ENOENT);
+	zrelse(coord.node);
+	done_lh(&lh);
+	return result;
+}
+
+/* check whether [@pos, @pos + @count) can be accessed directly */
+static int can_direct_io(struct inode *inode, loff_t pos, size_t count,
+			 int rw)
+{
+	struct unix_file_info *uf_info;
+	reiser4_block_nr block;
+	__u64 index;
+	__u64 end;
+	__u64 nr;
+
+	uf_info = unix_file_inode_data(inode);
+	if (uf_info->container != UF_CONTAINER_EXTENTS ||
+	    reiser4_inode_get_flag(inode, REISER4_PART_MIXED) || count == 0 ||
+	    has_anonymous_pages(inode))
+		return 0;
+	index = pos >> PAGE_SHIFT;
+	end = (pos + count - 1) >> PAGE_SHIFT;
+	if (range_has_dirty_jnodes(inode, index, end))
+		return 0;
+	if (rw == READ)
+		return 1;
+	if (pos + count > i_size_read(inode))
+		return 0;
+	while (index <= end) {
+		if (map_extent(inode, index, &block, &nr) != ALLOCATED_EXTENT)
+			return 0;
+		index += nr;
+	}
+	return 1;
+}
+
+/* get_block_t for blockdev_direct_IO(). Maps as many blocks of one extent
+   unit as requested */
+static int get_block_unix_file_direct(struct inode *inode, sector_t iblock,
+				      struct buffer_head *bh, int create)
+{
+	reiser4_block_nr block;
+	__u64 nr;
+	int result;
+
+	assert("jalex-32", inode->i_sb->s_blocksize == PAGE_SIZE);
+
+	result = map_extent(inode, iblock, &block, &nr);
+	switch (result) {
+	case ALLOCATED_EXTENT:
+		map_bh(bh, inode->i_sb, block);
+		/* fall through */
+	case HOLE_EXTENT:
+	case UNWRITTEN_EXTENT:
+		/* hole and unwritten extent are read as zeroes */
+		if (bh->b_size > (nr << inode->i_blkbits))
+			bh->b_size = nr << inode->i_blkbits;
+		return 0;
+	case -ENOENT:
+		/* past the end of file */
+		return 0;
+	case UNALLOCATED_EXTENT:
+		/* can only appear after can_direct_io() by racing with
+		   writer. Do not let direct io bypass it */
+		return RETERR(-ENOTBLK);
+	default:
+		return result;
+	}
+}
+
+/**
+ * direct_IO_unix_file - ->direct_IO() of unix file plugin
+ * @iocb:
+ * @iter:
+ *
+ * read_unix_file() and write_unix_file() come here with access to file
+ * obtained, ->read_iter() (aio) comes here from generic_file_read_iter()
+ * without reiser4 context.
+ */
+ssize_t direct_IO_unix_file(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	struct unix_file_info *uf_info;
+	reiser4_context *ctx;
+	ssize_t result = 0;
+	int nested;
+
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	nested = ctx->nr_children != 0;
+
+	uf_info = unix_file_inode_data(inode);
+	if (!nested)
+		get_nonexclusive_access(uf_info);
+	if (can_direct_io(inode, iocb->ki_pos, iov_iter_count(iter),
+			  iov_iter_rw(iter)))
+		/* no DIO_LOCKING: it would take inode lock with access to file
+		   held, while writers take inode lock first. The file access
+		   lock and can_direct_io() give what DIO_LOCKING does for
+		   other filesystems */
+		result = __blockdev_direct_IO(iocb, inode,
+					      inode->i_sb->s_bdev, iter,
+					      get_block_unix_file_direct,
+					      NULL, NULL, DIO_SKIP_HOLES);
+	if (!nested)
+		drop_nonexclusive_access(uf_info);
+	reiser4_exit_context(ctx);
+	return result;
+}
+
+/*
+ * O_DIRECT read of file built of extents. Non-exclusive access is obtained.
+ * What can not be read directly is read through page cache.
+ */
+static ssize_t read_unix_file_direct(struct file *file, char __user *buf,
+				     size_t count, loff_t *off)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = count };
+	struct kiocb kiocb;
+	struct iov_iter iter;
+	ssize_t done;
+	ssize_t result;
+
+	init_sync_kiocb(&kiocb, file);
+	kiocb.ki_pos = *off;
+	kiocb.ki_flags &= ~IOCB_DIRECT;
+	iov_iter_init(&iter, READ, &iov, 1, count);
+
+	done = direct_IO_unix_file(&kiocb, &iter);
+	if (done == -ENOTBLK)
+		done = 0;
+	if (done < 0)
+		return done;
+	kiocb.ki_pos += done;
+
+	result = 0;
+	if (iov_iter_count(&iter) != 0 &&
+	    kiocb.ki_pos < i_size_read(file_inode(file)))
+		result = generic_file_read_iter(&kiocb, &iter);
+	*off = kiocb.ki_pos;
+	if (done == 0)
+		return result;
+	return (result > 0) ? done + result : done;
+}
+
+/*
+ * O_DIRECT write. Non-exclusive access is obtained. Returns number of bytes
+ * written directly, the rest is to be written through page cache.
+ */
+static ssize_t write_unix_file_direct(struct file *file,
+				      const char __user *buf, size_t count,
+				      loff_t *pos)
+{
+	struct inode *inode = file_inode(file);
+	struct address_space *mapping = inode->i_mapping;
+	struct iovec iov = { .iov_base = (void __user *)buf, .iov_len = count };
+	struct kiocb kiocb;
+	struct iov_iter iter;
+	reiser4_block_nr reserve;
+	pgoff_t start;
+	pgoff_t end;
+	ssize_t written;
+
+	init_sync_kiocb(&kiocb, file);
+	kiocb.ki_pos = *pos;
+	iov_iter_init(&iter, WRITE, &iov, 1, count);
+
+	start = *pos >> PAGE_SHIFT;
+	end = (*pos + count - 1) >> PAGE_SHIFT;
+	written = direct_IO_unix_file(&kiocb, &iter);
+	if (written == -ENOTBLK)
+		written = 0;
+	if (written <= 0)
+		return written;
+	/* cached pages of the range are out of date now */
+	invalidate_inode_pages2_range(mapping, start, end);
+
+	*pos += written;
+	if (!IS_NOCMTIME(inode)) {
+		reserve = inode_file_plugin(inode)->estimate.update(inode);
+		if (reiser4_grab_space_force(reserve, BA_CAN_COMMIT) == 0) {
+			inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+			if (reiser4_update_sd(inode))
+				warning("jalex-33",
+					"Can not update stat-data");
+		}
+	}
+	return written;
+}
+
+/**
+ * flow_by_inode_unix_file - initizlize structure flow
+ * @inode: inode of file for which read or write is abou
+ * @buf: buffer to perform read to or write from
+ * @user: flag showing whether @buf is user space or kernel space
+ * @size: size of buffer @buf
+ * @off: start offset fro read or write
+ * @op: READ or WRITE
+ * @flow:
+ *
+ * Initializes fields of @flow: key, size of data, i/o mode (read or write).
+ */
+int flow_by_inode_unix_file(struct inode *inode,
+			    const char __user *buf, int user,
+			    loff_t size, loff_t off,
+			    rw_op op, flow_t *flow)
+{
+	assert("nikita-1100", inode != NULL);
+
+	flow->length = size;
+	memcpy(&flow->data, &buf, sizeof(buf));
+	flow->user = user;
+	flow->op = op;
+	assert("nikita-1931", inode_file_plugin(inode) != NULL);
+	assert("nikita-1932",
+	       inode_file_plugin(inode)->key_by_inode ==
+	       key_by_inode_and_offset_common);
+	/* calculate key of write position and insert it into flow->key */
+	return key_by_inode_and_offset_common(inode, off, &flow->key);
+}
+
+/* plugin->u.file.set_plug_in_sd = NULL
+   plugin->u.file.set_plug_in_inode = NULL
+   plugin->u.file.create_blank_sd = NULL */
+/* plugin->u.file.delete */
 /*
    plugin->u.file.add_link = reiser4_add_link_common
    plugin->u.file.rem_link = NULL */
@@ -2621,6 +4112,8 @@ int setattr_unix_file(struct dentry *dentry,	/* Object to change attributes */
 
 		uf_info = unix_file_inode_data(dentry->d_inode);
 		get_exclusive_access_careful(uf_info, dentry->d_inode);
+		/* wait for aio direct i/o to blocks being cut */
+		inode_dio_wait(dentry->d_inode);
 		result = setattr_truncate(dentry->d_inode, attr);
 		drop_exclusive_access(uf_info);
 		context_set_commit_async(ctx);
@@ -2635,6 +4128,20 @@ int setattr_unix_file(struct dentry *dentry,	/* Object to change attributes */
 void
 init_inode_data_unix_file(struct inode *inode,
 			  reiser4_object_create_data * crd, int create)
+{
+	init_unix_file_info(inode, create);
+	init_inode_ordering(inode, crd, create);
+}
+
+/**
+ * init_unix_file_info - initialize unix file specific part of inode
+ * @inode: inode to initialize
+ * @create: true if the file is being created
+ *
+ * Is used on inode load and creation, and when cryptcompress file is
+ * converted to unix file.
+ */
+void init_unix_file_info(struct inode *inode, int create)
 {
 	struct unix_file_info *data;
 
@@ -2643,12 +4150,21 @@ init_inode_data_unix_file(struct inode *inode,
 	init_rwsem(&data->latch);
 	data->tplug = inode_formatting_plugin(inode);
 	data->exclusive_use = 0;
+	reiser4_init_alloc_window(&data->window);
+	seqcount_init(&data->conv_seq);
 
 #if REISER4_DEBUG
 	data->ea_owner = NULL;
 	atomic_set(&data->nr_neas, 0);
 #endif
-	init_inode_ordering(inode, crd, create);
+}
+
+/* plugin->u.file.destroy_inode */
+void destroy_inode_unix_file(struct inode *inode)
+{
+	/* flush may have opened a window after the file was closed */
+	reiser4_done_alloc_window(inode->i_sb,
+				  &unix_file_inode_data(inode)->window);
 }
 
 /**
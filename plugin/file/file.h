@@ -28,6 +28,8 @@ struct dispatch_context {
 
 /* inode operations */
 int reiser4_setattr_dispatch(struct dentry *, struct iattr *);
+int reiser4_fiemap_dispatch(struct inode *, struct fiemap_extent_info *,
+			    __u64 start, __u64 len);
 
 /* file operations */
 ssize_t reiser4_read_dispatch(struct file *, char __user *buf,
@@ -36,9 +38,16 @@ ssize_t reiser4_write_dispatch(struct file *, const char __user *buf,
 			       size_t count, loff_t * off);
 long reiser4_ioctl_dispatch(struct file *filp, unsigned int cmd,
 			    unsigned long arg);
+#ifdef CONFIG_COMPAT
+long reiser4_compat_ioctl_dispatch(struct file *filp, unsigned int cmd,
+				   unsigned long arg);
+#endif
 int reiser4_mmap_dispatch(struct file *, struct vm_area_struct *);
 int reiser4_open_dispatch(struct inode *inode, struct file *file);
 int reiser4_release_dispatch(struct inode *, struct file *);
+long reiser4_fallocate_dispatch(struct file *, int mode, loff_t offset,
+				loff_t len);
+loff_t reiser4_llseek_dispatch(struct file *, loff_t offset, int origin);
 int reiser4_sync_file_common(struct file *, loff_t, loff_t, int datasync);
 
 /* address space operations */
@@ -56,6 +65,7 @@ int reiser4_write_end_dispatch(struct file *file,
 			       loff_t pos, unsigned len, unsigned copied,
 			       struct page *page, void *fsdata);
 sector_t reiser4_bmap_dispatch(struct address_space *, sector_t lblock);
+ssize_t reiser4_direct_IO_dispatch(struct kiocb *, struct iov_iter *);
 
 /*
  * Private methods of unix-file plugin
@@ -64,6 +74,8 @@ sector_t reiser4_bmap_dispatch(struct address_space *, sector_t lblock);
 
 /* private inode operations */
 int setattr_unix_file(struct dentry *, struct iattr *);
+int fiemap_unix_file(struct inode *, struct fiemap_extent_info *,
+		     __u64 start, __u64 len);
 
 /* private file operations */
 
@@ -75,6 +87,8 @@ int ioctl_unix_file(struct file *, unsigned int cmd, unsigned long arg);
 int mmap_unix_file(struct file *, struct vm_area_struct *);
 int open_unix_file(struct inode *, struct file *);
 int release_unix_file(struct inode *, struct file *);
+long fallocate_unix_file(struct file *, int mode, loff_t offset, loff_t len);
+loff_t llseek_unix_file(struct file *, loff_t offset, int origin);
 
 /* private address space operations */
 int readpage_unix_file(struct file *, struct page *);
@@ -86,6 +100,7 @@ int write_begin_unix_file(struct file *file, struct page *page,
 int write_end_unix_file(struct file *file, struct page *page,
 			loff_t pos, unsigned copied, void *fsdata);
 sector_t bmap_unix_file(struct address_space *, sector_t lblock);
+ssize_t direct_IO_unix_file(struct kiocb *, struct iov_iter *);
 
 /* other private methods */
 int delete_object_unix_file(struct inode *);
@@ -94,6 +109,8 @@ int flow_by_inode_unix_file(struct inode *, const char __user *buf,
 int owns_item_unix_file(const struct inode *, const coord_t *);
 void init_inode_data_unix_file(struct inode *, reiser4_object_create_data *,
 			       int create);
+void init_unix_file_info(struct inode *, int create);
+void destroy_inode_unix_file(struct inode *);
 
 /*
  * Private methods of cryptcompress file plugin
@@ -102,6 +119,8 @@ void init_inode_data_unix_file(struct inode *, reiser4_object_create_data *,
 
 /* private inode operations */
 int setattr_cryptcompress(struct dentry *, struct iattr *);
+int fiemap_cryptcompress(struct inode *, struct fiemap_extent_info *,
+			 __u64 start, __u64 len);
 
 /* private file operations */
 ssize_t read_cryptcompress(struct file *, char __user *buf,
@@ -113,6 +132,7 @@ int ioctl_cryptcompress(struct file *, unsigned int cmd, unsigned long arg);
 int mmap_cryptcompress(struct file *, struct vm_area_struct *);
 int open_cryptcompress(struct inode *, struct file *);
 int release_cryptcompress(struct inode *, struct file *);
+loff_t llseek_cryptcompress(struct file *, loff_t offset, int origin);
 
 /* private address space operations */
 int readpage_cryptcompress(struct file *, struct page *);
@@ -171,6 +191,7 @@ typedef enum {
 
 struct formatting_plugin;
 struct inode;
+struct body_map;
 
 /* unix file plugin specific part of reiser4 inode */
 struct unix_file_info {
@@ -192,6 +213,14 @@ struct unix_file_info {
 	struct formatting_plugin *tplug;
 	/* if this is set, file is in exclusive use */
 	int exclusive_use;
+	/* blocks for unformatted nodes are allocated from here on flush */
+	struct reiser4_alloc_window window;
+	/*
+	 * odd while the file is being converted from tails to extents or
+	 * back. Readers which do not take the latch check it to find out
+	 * whether a conversion ran during their read
+	 */
+	seqcount_t conv_seq;
 #if REISER4_DEBUG
 	/* pointer to task struct of thread owning exclusive access to file */
 	void *ea_owner;
@@ -275,6 +304,31 @@ int reiser4_update_file_size(struct inode *, loff_t, int update_sd);
 int cut_file_items(struct inode *, loff_t new_size,
 		   int update_sd, loff_t cur_size,
 		   int (*update_actor) (struct inode *, loff_t, int));
+
+/*
+ * Mapping of file body without reading file data (fiemap, SEEK_DATA and
+ * SEEK_HOLE). Items of file body are walked in key order and ->map() method of
+ * each item reports ranges of file it has data for.
+ */
+struct body_map {
+	struct inode *inode;
+	/* end of the last reported range */
+	loff_t end;
+	/*
+	 * called for each range of file data in ascending offset order with
+	 * FIEMAP_EXTENT_* flags. Non-zero return value stops the walk
+	 */
+	int (*actor) (struct body_map *, loff_t off, loff_t len,
+		      __u64 phys, __u32 flags);
+};
+
+int body_map_add(struct body_map *, loff_t off, loff_t len,
+		 __u64 phys, __u32 flags);
+int reiser4_map_file_body(struct inode *, loff_t from, struct body_map *);
+int reiser4_fiemap_body(struct inode *, struct fiemap_extent_info *,
+			__u64 start, __u64 len);
+loff_t reiser4_seek_body(struct file *, struct inode *, loff_t offset,
+			 int origin);
 #if REISER4_DEBUG
 
 /* return 1 is exclusive access is obtained, 0 - otherwise */
@@ -291,9 +345,20 @@ static inline int ea_obtained(struct unix_file_info * uf_info)
 #endif
 
 #define WRITE_GRANULARITY 32
+/*
+ * maximal number of pages reiser4_write_extent() writes in one call: under one
+ * space reservation and with one pass over extent items
+ */
+#define WRITE_BATCH 256
 
 int tail2extent(struct unix_file_info *);
 int extent2tail(struct file *, struct unix_file_info *);
+int reiser4_queue_tail2extent(struct inode *);
+int reiser4_init_conv_wq(void);
+void reiser4_done_conv_wq(void);
+void reiser4_init_conv_queue(struct super_block *);
+void reiser4_done_conv_queue(struct super_block *);
+int should_have_notail(const struct unix_file_info *, loff_t new_size);
 
 int goto_right_neighbor(coord_t *, lock_handle *);
 int find_or_create_extent(struct page *);
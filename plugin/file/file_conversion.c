@@ -29,6 +29,7 @@
  */
 
 #include <linux/uio.h>
+#include <linux/compat.h>
 #include "../../inode.h"
 #include "../cluster.h"
 #include "file.h"
@@ -101,7 +102,6 @@ static int __cryptcompress2unixfile(struct file *file, struct inode * inode)
 {
 	int result;
 	reiser4_inode *info;
-	struct unix_file_info * uf;
 	info = reiser4_inode_data(inode);
 
 	result = aset_set_unsafe(&info->pset,
@@ -123,18 +123,8 @@ static int __cryptcompress2unixfile(struct file *file, struct inode * inode)
 
 	reiser4_inode_clr_flag(inode, REISER4_SDLEN_KNOWN);
 
-	/* FIXME use init_inode_data_unix_file() instead,
-	   but aviod init_inode_ordering() */
 	/* Init unix-file specific part of inode */
-	uf = unix_file_inode_data(inode);
-	uf->container = UF_CONTAINER_UNKNOWN;
-	init_rwsem(&uf->latch);
-	uf->tplug = inode_formatting_plugin(inode);
-	uf->exclusive_use = 0;
-#if REISER4_DEBUG
-	uf->ea_owner = NULL;
-	atomic_set(&uf->nr_neas, 0);
-#endif
+	init_unix_file_info(inode, 0);
 	/**
 	 * we was carefull for file_ops, inode_ops and as_ops
 	 * to be invariant for plugin conversion, so there is
@@ -614,6 +604,9 @@ ssize_t reiser4_write_dispatch(struct file *file, const char __user *buf,
  * ->ioctl();
  * ->mmap();
  * ->release();
+ * ->fallocate();
+ * ->llseek();
+ * ->fiemap();
  * ->bmap().
  */
 
@@ -636,6 +629,16 @@ long reiser4_ioctl_dispatch(struct file *filp, unsigned int cmd,
 	return PROT_PASSIVE(int, ioctl, (filp, cmd, arg));
 }
 
+#ifdef CONFIG_COMPAT
+/* struct reiser4_defrag_args has the same layout for 32-bit callers */
+long reiser4_compat_ioctl_dispatch(struct file *filp, unsigned int cmd,
+				   unsigned long arg)
+{
+	return reiser4_ioctl_dispatch(filp, cmd,
+				      (unsigned long)compat_ptr(arg));
+}
+#endif
+
 int reiser4_mmap_dispatch(struct file *file, struct vm_area_struct *vma)
 {
 	struct inode *inode = file_inode(file);
@@ -647,6 +650,35 @@ int reiser4_release_dispatch(struct inode *inode, struct file *file)
 	return PROT_PASSIVE(int, release, (inode, file));
 }
 
+long reiser4_fallocate_dispatch(struct file *file, int mode, loff_t offset,
+				loff_t len)
+{
+	struct inode *inode = file_inode(file);
+
+	if (inode_file_plugin(inode)->fallocate == NULL)
+		return RETERR(-EOPNOTSUPP);
+	return PROT_PASSIVE(long, fallocate, (file, mode, offset, len));
+}
+
+loff_t reiser4_llseek_dispatch(struct file *file, loff_t offset, int origin)
+{
+	struct inode *inode = file_inode(file);
+
+	if ((origin != SEEK_DATA && origin != SEEK_HOLE) ||
+	    inode_file_plugin(inode)->llseek == NULL)
+		return generic_file_llseek(file, offset, origin);
+	return PROT_PASSIVE(loff_t, llseek, (file, offset, origin));
+}
+
+int reiser4_fiemap_dispatch(struct inode *inode,
+			    struct fiemap_extent_info *fieinfo,
+			    __u64 start, __u64 len)
+{
+	if (inode_file_plugin(inode)->fiemap == NULL)
+		return RETERR(-EOPNOTSUPP);
+	return PROT_PASSIVE(int, fiemap, (inode, fieinfo, start, len));
+}
+
 sector_t reiser4_bmap_dispatch(struct address_space * mapping, sector_t lblock)
 {
 	struct inode *inode = mapping->host;
@@ -231,6 +231,20 @@ static int reserve_tail2extent_iteration(struct inode *inode)
 	     inode_file_plugin(inode)->estimate.update(inode), BA_CAN_COMMIT);
 }
 
+/* mark file as being converted. Lock-free readers of the file notice that
+   by conv_seq of unix file info */
+static void start_conversion(struct inode *inode)
+{
+	reiser4_inode_set_flag(inode, REISER4_PART_IN_CONV);
+	write_seqcount_begin(&unix_file_inode_data(inode)->conv_seq);
+}
+
+static void stop_conversion(struct inode *inode)
+{
+	write_seqcount_end(&unix_file_inode_data(inode)->conv_seq);
+	reiser4_inode_clr_flag(inode, REISER4_PART_IN_CONV);
+}
+
 /* clear stat data's flag indicating that conversion is being converted */
 static int complete_conversion(struct inode *inode)
 {
@@ -351,7 +365,7 @@ int tail2extent(struct unix_file_info *uf_info)
 		first_iteration = 0;
 	}
 
-	reiser4_inode_set_flag(inode, REISER4_PART_IN_CONV);
+	start_conversion(inode);
 
 	/* get key of first byte of a file */
 	inode_file_plugin(inode)->key_by_inode(inode, offset, &key);
@@ -361,7 +375,7 @@ int tail2extent(struct unix_file_info *uf_info)
 		memset(pages, 0, sizeof(pages));
 		result = reserve_tail2extent_iteration(inode);
 		if (result != 0) {
-			reiser4_inode_clr_flag(inode, REISER4_PART_IN_CONV);
+			stop_conversion(inode);
 			goto out;
 		}
 		if (first_iteration) {
@@ -510,7 +524,7 @@ int tail2extent(struct unix_file_info *uf_info)
 	}
 	if (result == 0) {
 		/* file is converted to extent items */
-		reiser4_inode_clr_flag(inode, REISER4_PART_IN_CONV);
+		stop_conversion(inode);
 		assert("vs-1697", reiser4_inode_get_flag(inode,
 							 REISER4_PART_MIXED));
 
@@ -524,7 +538,7 @@ int tail2extent(struct unix_file_info *uf_info)
 		 */
 	error:
 		release_all_pages(pages, sizeof_array(pages));
-		reiser4_inode_clr_flag(inode, REISER4_PART_IN_CONV);
+		stop_conversion(inode);
 		warning("edward-1548", "Partial conversion of %llu: %i",
 			(unsigned long long)get_inode_oid(inode), result);
 	}
@@ -598,7 +612,7 @@ int extent2tail(struct file * file, struct unix_file_info *uf_info)
 			/* some other error */
 			return result;
 	}
-	reiser4_inode_set_flag(inode, REISER4_PART_IN_CONV);
+	start_conversion(inode);
 
 	/* number of pages in the file */
 	num_pages =
@@ -690,8 +704,7 @@ int extent2tail(struct file * file, struct unix_file_info *uf_info)
 			"Report the error code %i to developers. Run FSCK",
 					result);
 				put_page(page);
-				reiser4_inode_clr_flag(inode,
-						       REISER4_PART_IN_CONV);
+				stop_conversion(inode);
 				return result;
 			}
 			count -= result;
@@ -721,7 +734,7 @@ int extent2tail(struct file * file, struct unix_file_info *uf_info)
 		assert("", reiser4_inode_get_flag(inode, REISER4_PART_MIXED));
 	}
 
-	reiser4_inode_clr_flag(inode, REISER4_PART_IN_CONV);
+	stop_conversion(inode);
 
 	if (i == num_pages) {
 		/* file is converted to formatted items */
@@ -751,6 +764,249 @@ int extent2tail(struct file * file, struct unix_file_info *uf_info)
 	return result;
 }
 
+/*
+ * Deferred tail to extent conversion.
+ *
+ * When a file built of tail items outgrows its formatting policy, the write
+ * path does not convert it: that would take exclusive access to the file for
+ * the whole conversion. Instead the file is queued and writes keep appending
+ * tail items under non-exclusive access. A worker converts queued files in
+ * the background. Files are queued by stat data key, so that queue does not
+ * pin inodes: a file evicted from inode cache before the worker gets to it
+ * is converted on the next write. Files which grow past
+ * REISER4_CONV_SYNC_SIZE while queued are converted synchronously by the
+ * write path as before.
+ */
+
+/* delay of the worker after the first file is queued */
+#define REISER4_CONV_DELAY (HZ)
+/* queued files larger than that are converted by the write path */
+#define REISER4_CONV_SYNC_SIZE (1 << 20)
+
+struct conv_entry {
+	struct list_head link;
+	reiser4_key key;
+};
+
+/* conversions block for long, so they do not run on system workqueue */
+static struct workqueue_struct *reiser4_conv_wq;
+
+/**
+ * reiser4_queue_tail2extent - queue file for deferred conversion
+ * @inode: file built of tail items
+ *
+ * Returns 0 if the file is queued or is in the queue already, error code if
+ * it has to be converted by the caller.
+ */
+int reiser4_queue_tail2extent(struct inode *inode)
+{
+	struct reiser4_conv_queue *queue;
+	struct conv_entry *entry;
+	int ret = 0;
+
+	if (inode->i_size > REISER4_CONV_SYNC_SIZE ||
+	    reiser4_inode_get_flag(inode, REISER4_PART_MIXED) ||
+	    reiser4_inode_get_flag(inode, REISER4_PART_IN_CONV))
+		/* large or partially converted file */
+		return RETERR(-E2BIG);
+
+	queue = &get_super_private(inode->i_sb)->conv_queue;
+	if (reiser4_inode_get_flag(inode, REISER4_PART_CONV_QUEUED))
+		return 0;
+
+	entry = kmalloc(sizeof(*entry), reiser4_ctx_gfp_mask_get());
+	if (entry == NULL)
+		return RETERR(-ENOMEM);
+	build_sd_key(inode, &entry->key);
+
+	spin_lock(&queue->guard);
+	if (queue->stopped) {
+		ret = RETERR(-EBUSY);
+	} else if (!reiser4_inode_get_flag(inode, REISER4_PART_CONV_QUEUED)) {
+		reiser4_inode_set_flag(inode, REISER4_PART_CONV_QUEUED);
+		list_add_tail(&entry->link, &queue->files);
+		queue->nr_queued++;
+		queue_delayed_work(reiser4_conv_wq, &queue->work,
+				   REISER4_CONV_DELAY);
+		entry = NULL;
+	}
+	spin_unlock(&queue->guard);
+	kfree(entry);
+	return ret;
+}
+
+/* convert queued file to extents unless it is converted already. Returns
+   -EAGAIN if file system is frozen, the file stays queued then */
+static int convert_queued_file(struct reiser4_conv_queue *queue,
+			       struct inode *inode)
+{
+	reiser4_context *ctx;
+	struct unix_file_info *uf_info;
+	ktime_t start;
+	__u64 latency;
+	int result;
+
+	if (!sb_start_write_trylock(inode->i_sb))
+		return RETERR(-EAGAIN);
+	ctx = reiser4_init_context(inode->i_sb);
+	if (IS_ERR(ctx)) {
+		sb_end_write(inode->i_sb);
+		return 0;
+	}
+
+	inode_lock(inode);
+	spin_lock(&queue->guard);
+	reiser4_inode_clr_flag(inode, REISER4_PART_CONV_QUEUED);
+	spin_unlock(&queue->guard);
+
+	if (inode_file_plugin(inode)->h.id != UNIX_FILE_PLUGIN_ID ||
+	    inode->i_nlink == 0 || IS_RDONLY(inode))
+		goto out;
+	uf_info = unix_file_inode_data(inode);
+	get_exclusive_access(uf_info);
+	if (uf_info->container == UF_CONTAINER_TAILS &&
+	    !reiser4_inode_get_flag(inode, REISER4_PART_IN_CONV) &&
+	    should_have_notail(uf_info, inode->i_size)) {
+		start = ktime_get();
+		result = tail2extent(uf_info);
+		latency = ktime_us_delta(ktime_get(), start);
+		if (result == 0) {
+			spin_lock(&queue->guard);
+			queue->nr_converted++;
+			queue->total_latency += latency;
+			if (latency > queue->max_latency)
+				queue->max_latency = latency;
+			spin_unlock(&queue->guard);
+		} else
+			warning("jalex-39", "Deferred conversion of %llu: %i",
+				(unsigned long long)get_inode_oid(inode),
+				result);
+	}
+	drop_exclusive_access(uf_info);
+ out:
+	inode_unlock(inode);
+	context_set_commit_async(ctx);
+	reiser4_exit_context(ctx);
+	sb_end_write(inode->i_sb);
+	return 0;
+}
+
+static void conv_work(struct work_struct *work)
+{
+	struct reiser4_conv_queue *queue;
+	struct conv_entry *entry;
+	struct inode *inode;
+
+	queue = container_of(to_delayed_work(work),
+			     struct reiser4_conv_queue, work);
+	while (1) {
+		spin_lock(&queue->guard);
+		if (queue->stopped || list_empty(&queue->files)) {
+			spin_unlock(&queue->guard);
+			break;
+		}
+		entry = list_first_entry(&queue->files, struct conv_entry,
+					 link);
+		list_del(&entry->link);
+		queue->nr_queued--;
+		spin_unlock(&queue->guard);
+
+		inode = reiser4_ilookup(queue->super, &entry->key);
+		if (inode == NULL) {
+			/* file is evicted */
+			kfree(entry);
+			continue;
+		}
+		if (convert_queued_file(queue, inode) == -EAGAIN) {
+			/* file system is frozen. Put the file back and retry
+			   later */
+			spin_lock(&queue->guard);
+			if (!queue->stopped) {
+				list_add(&entry->link, &queue->files);
+				queue->nr_queued++;
+				queue_delayed_work(reiser4_conv_wq,
+						   &queue->work,
+						   REISER4_CONV_DELAY);
+				entry = NULL;
+			}
+			spin_unlock(&queue->guard);
+			kfree(entry);
+			iput(inode);
+			break;
+		}
+		kfree(entry);
+		/* the last reference may be dropped here, this is done out of
+		   reiser4 context */
+		iput(inode);
+		cond_resched();
+	}
+}
+
+/**
+ * reiser4_init_conv_wq - create workqueue of deferred conversion
+ *
+ * Initialization function to be called during reiser4 module
+ * initialization. The workqueue is shared by all mounted volumes.
+ */
+int reiser4_init_conv_wq(void)
+{
+	reiser4_conv_wq = alloc_workqueue("reiser4_conv", WQ_UNBOUND, 0);
+	if (reiser4_conv_wq == NULL)
+		return RETERR(-ENOMEM);
+	return 0;
+}
+
+/**
+ * reiser4_done_conv_wq - destroy workqueue of deferred conversion
+ *
+ * This is called on reiser4 module unloading or system shutdown.
+ */
+void reiser4_done_conv_wq(void)
+{
+	destroy_workqueue(reiser4_conv_wq);
+}
+
+void reiser4_init_conv_queue(struct super_block *super)
+{
+	struct reiser4_conv_queue *queue;
+
+	queue = &get_super_private(super)->conv_queue;
+	spin_lock_init(&queue->guard);
+	INIT_LIST_HEAD(&queue->files);
+	queue->nr_queued = 0;
+	queue->stopped = 0;
+	queue->nr_converted = 0;
+	queue->total_latency = 0;
+	queue->max_latency = 0;
+	queue->super = super;
+	INIT_DELAYED_WORK(&queue->work, conv_work);
+}
+
+/* stop the worker and forget queued files. Called on umount before inodes
+   are evicted, so that the worker does not hold any of them. Files left
+   unconverted are converted on the next write after mount */
+void reiser4_done_conv_queue(struct super_block *super)
+{
+	struct reiser4_conv_queue *queue;
+	struct conv_entry *entry;
+	struct conv_entry *next;
+
+	queue = &get_super_private(super)->conv_queue;
+
+	spin_lock(&queue->guard);
+	queue->stopped = 1;
+	spin_unlock(&queue->guard);
+
+	/* wait for the worker, which sees the queue stopped on its next
+	   pass */
+	cancel_delayed_work_sync(&queue->work);
+	list_for_each_entry_safe(entry, next, &queue->files, link) {
+		list_del(&entry->link);
+		kfree(entry);
+	}
+	queue->nr_queued = 0;
+}
+
 /*
  * Local variables:
  * c-indentation-style: "K&R"
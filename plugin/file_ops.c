@@ -6,8 +6,12 @@
 */
 
 #include "../inode.h"
+#include "../discard.h"
 #include "object.h"
 
+#include <linux/uaccess.h>
+#include <linux/compat.h>
+
 /* file operations */
 
 /* implementation of vfs's llseek method of struct file_operations for
@@ -40,6 +44,54 @@ int reiser4_release_dir_common(struct inode *inode, struct file *file)
 	return 0;
 }
 
+/**
+ * reiser4_ioctl_dir_common - ioctl of struct file_operations for directories
+ * @file: file ioctl is called for
+ * @cmd: ioctl command
+ * @arg: argument of ioctl command
+ *
+ * Supports FITRIM, which discards free space of the volume.
+ */
+long reiser4_ioctl_dir_common(struct file *file, unsigned int cmd,
+			      unsigned long arg)
+{
+	reiser4_context *ctx;
+	struct super_block *super = file_inode(file)->i_sb;
+	struct fstrim_range range;
+	long result;
+
+	if (cmd != FITRIM)
+		return RETERR(-ENOTTY);
+	if (!capable(CAP_SYS_ADMIN))
+		return RETERR(-EPERM);
+	if (copy_from_user(&range, (struct fstrim_range __user *)arg,
+			   sizeof(range)))
+		return RETERR(-EFAULT);
+
+	ctx = reiser4_init_context(super);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+	result = reiser4_trim_fs(super, &range);
+	reiser4_exit_context(ctx);
+
+	if (result == 0 &&
+	    copy_to_user((struct fstrim_range __user *)arg, &range,
+			 sizeof(range)))
+		result = RETERR(-EFAULT);
+	return result;
+}
+
+#ifdef CONFIG_COMPAT
+/* compat_ioctl of struct file_operations for directories. struct
+   fstrim_range has the same layout for 32-bit callers */
+long reiser4_compat_ioctl_dir_common(struct file *file, unsigned int cmd,
+				     unsigned long arg)
+{
+	return reiser4_ioctl_dir_common(file, cmd,
+					(unsigned long)compat_ptr(arg));
+}
+#endif
+
 /* this is common implementation of vfs's fsync method of struct
    file_operations
 */
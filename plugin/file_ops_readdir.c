@@ -283,6 +283,46 @@ static int dir_rewind(struct file *dir, loff_t *fpos, struct readdir_pos *pos, t
 	return result;
 }
 
+/* maximal number of stat data keys prefetched at once */
+#define SD_PREFETCH_MAX (64)
+
+/*
+ * Readers of directory usually stat every returned entry. When readdir enters
+ * a new node, keys of stat data of entries from that node are collected here,
+ * and reads of leaves holding them are started as soon as locks are released
+ * (see reiser4_keys_readahead()).
+ */
+struct sd_prefetch {
+	/* key of the last entry whose stat data key was collected */
+	reiser4_key last;
+	int valid;
+	int nr;
+	reiser4_key keys[SD_PREFETCH_MAX];
+};
+
+/* collect stat data keys of entries of @dir starting from @coord up to the
+   end of node */
+static void collect_sd_keys(struct inode *dir, const coord_t *coord,
+			    struct sd_prefetch *pf)
+{
+	coord_t scan;
+
+	coord_dup(&scan, coord);
+	pf->nr = 0;
+	do {
+		item_plugin *iplug;
+
+		if (!is_valid_dir_coord(dir, &scan))
+			break;
+		iplug = item_plugin_by_coord(&scan);
+		if (iplug->s.dir.extract_key(&scan, &pf->keys[pf->nr]) != 0)
+			break;
+		unit_key_by_coord(&scan, &pf->last);
+		pf->valid = 1;
+		pf->nr++;
+	} while (pf->nr < SD_PREFETCH_MAX && coord_next_unit(&scan) == 0);
+}
+
 /*
  * Function that is called by common_readdir() on each directory entry while
  * doing readdir. ->filldir callback may block, so we had to release long term
@@ -296,7 +336,8 @@ static int dir_rewind(struct file *dir, loff_t *fpos, struct readdir_pos *pos, t
  * unlocked.
  */
 static int
-feed_entry(tap_t *tap, struct dir_context *context)
+feed_entry(tap_t *tap, struct dir_context *context, struct inode *dir,
+	   struct sd_prefetch *pf)
 {
 	item_plugin *iplug;
 	char *name;
@@ -338,6 +379,9 @@ feed_entry(tap_t *tap, struct dir_context *context)
 	unit_key_by_coord(coord, &entry_key);
 	reiser4_seal_init(&seal, coord, &entry_key);
 
+	if (pf != NULL && (!pf->valid || keygt(&entry_key, &pf->last)))
+		collect_sd_keys(dir, coord, pf);
+
 	longterm_unlock_znode(tap->lh);
 
 	/*
@@ -351,6 +395,11 @@ feed_entry(tap_t *tap, struct dir_context *context)
 	assert("nikita-3436", lock_stack_isclean(get_current_lock_stack()));
 
 	reiser4_txn_restart_current();
+	if (pf != NULL && pf->nr != 0) {
+		reiser4_keys_readahead(reiser4_tree_by_inode(dir), pf->keys,
+				       pf->nr);
+		pf->nr = 0;
+	}
 	if (!dir_emit(context, name, (int)strlen(name),
 		      /* inode number of object bounden by this entry */
 		      oid_to_uino(get_key_objectid(&sd_key)), file_type))
@@ -568,6 +617,7 @@ int reiser4_iterate_common(struct file *f /* directory file being read */,
 	lock_handle lh;
 	tap_t tap;
 	struct readdir_pos *pos;
+	struct sd_prefetch *pf;
 
 	assert("nikita-1359", f != NULL);
 	inode = file_inode(f);
@@ -585,6 +635,10 @@ int reiser4_iterate_common(struct file *f /* directory file being read */,
 	reiser4_tap_init(&tap, &coord, &lh, ZNODE_READ_LOCK);
 
 	reiser4_readdir_readahead_init(inode, &tap);
+	/* prefetch is only an optimization, go without it if no memory */
+	pf = kmalloc(sizeof(*pf), reiser4_ctx_gfp_mask_get());
+	if (pf != NULL)
+		pf->valid = pf->nr = 0;
 
 repeat:
 	result = dir_readdir_init(f, &context->pos, &tap, &pos);
@@ -598,7 +652,7 @@ repeat:
 			assert("nikita-2572", coord_is_existing_unit(coord));
 			assert("nikita-3227", is_valid_dir_coord(inode, coord));
 
-			result = feed_entry(&tap, context);
+			result = feed_entry(&tap, context, inode, pf);
 			if (result > 0) {
 				break;
 			} else if (result == 0) {
@@ -632,6 +686,7 @@ repeat:
 		result = 0;
 	reiser4_tap_done(&tap);
 	reiser4_detach_fsdata(f);
+	kfree(pf);
 
 	/* try to update directory's atime */
 	if (reiser4_grab_space_force(inode_file_plugin(inode)->estimate.update(inode),
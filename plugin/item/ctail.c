@@ -900,6 +900,41 @@ reiser4_key *append_key_ctail(const coord_t * coord, reiser4_key * key)
 	return key;
 }
 
+/*
+   plugin->u.item.s.file.map
+   every item of a disk cluster reports the whole logical cluster as encoded
+   data, body_map_add() drops the duplicates. Physical address is the one of
+   the item body
+*/
+int body_map_ctail(const coord_t * coord, struct inode *inode,
+		   struct body_map *map)
+{
+	loff_t off;
+	loff_t len;
+	__u64 phys = 0;
+	__u32 flags = FIEMAP_EXTENT_ENCODED | FIEMAP_EXTENT_NOT_ALIGNED;
+
+	assert("jalex-37", item_id_by_coord(coord) == CTAIL_ID);
+
+	off = (loff_t)clust_by_coord(coord, inode) << inode_cluster_shift(inode);
+	len = inode_cluster_size(inode);
+	if (off >= i_size_read(inode))
+		return 0;
+	if (off + len > i_size_read(inode))
+		len = i_size_read(inode) - off;
+
+	if (coord_is_unprepped_ctail(coord) ||
+	    reiser4_blocknr_is_fake(znode_get_block(coord->node)))
+		/* cluster is not compressed or not allocated yet */
+		flags |= FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC;
+	else
+		phys = ((__u64)*znode_get_block(coord->node) <<
+			current_blocksize_bits) +
+			((char *)item_body_by_coord(coord) -
+			 zdata(coord->node));
+	return body_map_add(map, off, len, phys, flags);
+}
+
 static int insert_unprepped_ctail(struct cluster_handle * clust,
 				  struct inode *inode)
 {
@@ -78,6 +78,7 @@ int read_ctail(struct file *, flow_t *, hint_t *);
 int readpage_ctail(void *, struct page *);
 int readpages_ctail(struct file *, struct address_space *, struct list_head *);
 reiser4_key *append_key_ctail(const coord_t *, reiser4_key *);
+int body_map_ctail(const coord_t *, struct inode *, struct body_map *);
 int create_hook_ctail(const coord_t * coord, void *arg);
 int kill_hook_ctail(const coord_t *, pos_in_node_t, pos_in_node_t,
 		    carry_kill_data *);
@@ -43,6 +43,8 @@ reiser4_block_nr reiser4_extent_size(const coord_t * coord, pos_in_node_t nr)
 
 extent_state state_of_extent(reiser4_extent * ext)
 {
+	if (extent_is_unwritten(ext))
+		return UNWRITTEN_EXTENT;
 	switch ((int)extent_get_start(ext)) {
 	case 0:
 		return HOLE_EXTENT;
@@ -69,6 +71,31 @@ void reiser4_set_extent(reiser4_extent * ext, reiser4_block_nr start,
 	extent_set_width(ext, width);
 }
 
+/* set start and width of unwritten extent */
+void reiser4_set_unwritten_extent(reiser4_extent * ext, reiser4_block_nr start,
+				  reiser4_block_nr width)
+{
+	reiser4_set_extent(ext, start, width);
+	extent_set_unwritten(ext);
+}
+
+/* move start of allocated or unwritten extent @delta blocks forward, keeping
+   its state */
+void extent_move_start(reiser4_extent * ext, reiser4_block_nr delta)
+{
+	switch (state_of_extent(ext)) {
+	case ALLOCATED_EXTENT:
+		extent_set_start(ext, extent_get_start(ext) + delta);
+		break;
+	case UNWRITTEN_EXTENT:
+		extent_set_start(ext, extent_get_start(ext) + delta);
+		extent_set_unwritten(ext);
+		break;
+	default:
+		break;
+	}
+}
+
 /**
  * reiser4_replace_extent - replace extent and paste 1 or 2 after it
  * @un_extent: coordinate of extent to be overwritten
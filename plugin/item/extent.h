@@ -19,17 +19,22 @@ struct extent_stat {
 };
 
 /* extents in an extent item can be either holes, or unallocated or allocated
-   extents */
+   extents. Allocated extent which blocks were never written (preallocated by
+   fallocate) is unwritten one. It reads as a hole */
 typedef enum {
 	HOLE_EXTENT,
 	UNALLOCATED_EXTENT,
-	ALLOCATED_EXTENT
+	ALLOCATED_EXTENT,
+	UNWRITTEN_EXTENT
 } extent_state;
 
 #define HOLE_EXTENT_START 0
 #define UNALLOCATED_EXTENT_START 1
 #define UNALLOCATED_EXTENT_START2 2
 
+/* unwritten extents have this bit set in on-disk start */
+#define UNWRITTEN_EXTENT_FLAG 0x8000000000000000ULL
+
 struct extent_coord_extension {
 	reiser4_block_nr pos_in_unit;
 	reiser4_block_nr width;	/* width of current unit */
@@ -44,7 +49,12 @@ struct extent_coord_extension {
 /* macros to set/get fields of on-disk extent */
 static inline reiser4_block_nr extent_get_start(const reiser4_extent * ext)
 {
-	return le64_to_cpu(ext->start);
+	return le64_to_cpu(ext->start) & ~UNWRITTEN_EXTENT_FLAG;
+}
+
+static inline int extent_is_unwritten(const reiser4_extent * ext)
+{
+	return (le64_to_cpu(ext->start) & UNWRITTEN_EXTENT_FLAG) != 0;
 }
 
 static inline reiser4_block_nr extent_get_width(const reiser4_extent * ext)
@@ -63,6 +73,13 @@ extent_set_start(reiser4_extent * ext, reiser4_block_nr start)
 	put_unaligned(cpu_to_le64(start), &ext->start);
 }
 
+static inline void extent_set_unwritten(reiser4_extent * ext)
+{
+	assert("jalex-34", extent_get_start(ext) > UNALLOCATED_EXTENT_START);
+	put_unaligned(cpu_to_le64(le64_to_cpu(ext->start) |
+				  UNWRITTEN_EXTENT_FLAG), &ext->start);
+}
+
 static inline void
 extent_set_width(reiser4_extent * ext, reiser4_block_nr width)
 {
@@ -136,10 +153,27 @@ ssize_t reiser4_write_extent(struct file *, struct inode * inode,
 int reiser4_read_extent(struct file *, flow_t *, hint_t *);
 int reiser4_readpage_extent(void *, struct page *);
 int reiser4_do_readpage_extent(reiser4_extent*, reiser4_block_nr, struct page*);
+
+/* readahead state: pages of allocated extents which have no jnodes are
+   collected into bios of physically adjacent blocks */
+struct extent_read_bio {
+	struct bio *bio;
+	/* block following the last one added to @bio */
+	reiser4_block_nr next;
+	/* upper bound of number of pages to be read after the current one */
+	unsigned nr_pages;
+};
+
+int reiser4_readahead_extent(struct extent_read_bio *, reiser4_extent *,
+			     reiser4_block_nr pos, struct page *);
+void reiser4_submit_extent_read(struct extent_read_bio *);
+int reiser4_prealloc_extent(struct inode *, pgoff_t from, pgoff_t to);
+int reiser4_punch_extent(struct inode *, pgoff_t from, pgoff_t to);
 reiser4_key *append_key_extent(const coord_t *, reiser4_key *);
 void init_coord_extension_extent(uf_coord_t *, loff_t offset);
 int get_block_address_extent(const coord_t *, sector_t block,
 			     sector_t * result);
+int body_map_extent(const coord_t *, struct inode *, struct body_map *);
 
 /* these are used in flush.c
    FIXME-VS: should they be somewhere in item_plugin? */
@@ -161,8 +195,13 @@ reiser4_block_nr reiser4_extent_size(const coord_t * coord, pos_in_node_t nr);
 extent_state state_of_extent(reiser4_extent * ext);
 void reiser4_set_extent(reiser4_extent *, reiser4_block_nr start,
 			reiser4_block_nr width);
+void reiser4_set_unwritten_extent(reiser4_extent *, reiser4_block_nr start,
+				  reiser4_block_nr width);
+void extent_move_start(reiser4_extent *, reiser4_block_nr delta);
 int reiser4_update_extent(struct inode *, jnode *, loff_t pos,
 			  int *plugged_hole);
+int reiser4_update_extents(struct inode *, jnode **, int count,
+			   int *plugged_hole);
 
 #include "../../coord.h"
 #include "../../lock.h"
@@ -171,7 +171,8 @@ static int append_hole(coord_t *coord, lock_handle *lh,
 
 	/* append last item of the file with hole extent unit */
 	assert("vs-713", (state_of_extent(ext) == ALLOCATED_EXTENT ||
-			  state_of_extent(ext) == UNALLOCATED_EXTENT));
+			  state_of_extent(ext) == UNALLOCATED_EXTENT ||
+			  state_of_extent(ext) == UNWRITTEN_EXTENT));
 
 	reiser4_set_extent(&new_ext, HOLE_EXTENT_START, hole_width);
 	init_new_extent(&idata, &new_ext, 1);
@@ -278,6 +279,7 @@ static int append_last_extent(uf_coord_t *uf_coord, const reiser4_key *key,
 
 	case HOLE_EXTENT:
 	case ALLOCATED_EXTENT:
+	case UNWRITTEN_EXTENT:
 		/*
 		 * last extent unit of the file is either hole or allocated
 		 * one. Append one unallocated extent of width @count
@@ -584,6 +586,190 @@ static int plug_hole(uf_coord_t *uf_coord, const reiser4_key *key, int *how)
 	return reiser4_replace_extent(&rh, return_inserted_position);
 }
 
+/**
+ * write_unwritten - make block of unwritten extent allocated
+ * @uf_coord:
+ * @key:
+ *
+ * Block of unwritten extent which is about to be written can not be read as
+ * zeroes anymore. Glue it to allocated neighboring unit if their blocks are
+ * adjacent, which is the case for sequential writes to preallocated area,
+ * otherwise split the unwritten unit. In worst case two additional extents are
+ * created.
+ */
+static int write_unwritten(uf_coord_t *uf_coord, const reiser4_key *key)
+{
+	struct replace_handle rh;
+	reiser4_extent *ext;
+	reiser4_block_nr start, width, pos_in_unit;
+	coord_t *coord;
+	struct extent_coord_extension *ext_coord;
+	int return_inserted_position;
+
+	check_uf_coord(uf_coord, key);
+
+	rh.coord = coord_by_uf_coord(uf_coord);
+	rh.lh = uf_coord->lh;
+	rh.flags = 0;
+
+	coord = coord_by_uf_coord(uf_coord);
+	ext_coord = ext_coord_by_uf_coord(uf_coord);
+	ext = ext_by_ext_coord(uf_coord);
+
+	start = extent_get_start(ext);
+	width = ext_coord->width;
+	pos_in_unit = ext_coord->pos_in_unit;
+
+	if (width == 1) {
+		reiser4_set_extent(ext, start, 1);
+		znode_make_dirty(coord->node);
+		/* update uf_coord */
+		ON_DEBUG(ext_coord->extent = *ext);
+		return 0;
+	} else if (pos_in_unit == 0) {
+		if (coord->unit_pos &&
+		    state_of_extent(ext - 1) == ALLOCATED_EXTENT &&
+		    extent_get_start(ext - 1) +
+		    extent_get_width(ext - 1) == start) {
+			/*
+			 * left neighboring unit is allocated extent ending
+			 * right before this one. Increase its width and
+			 * decrease width of unwritten extent
+			 */
+			extent_set_width(ext - 1,
+					 extent_get_width(ext - 1) + 1);
+			reiser4_set_unwritten_extent(ext, start + 1, width - 1);
+			znode_make_dirty(coord->node);
+
+			/* update coord extension */
+			coord->unit_pos--;
+			ext_coord->width = extent_get_width(ext - 1);
+			ext_coord->pos_in_unit = ext_coord->width - 1;
+			ext_coord->ext_offset -= sizeof(reiser4_extent);
+			ON_DEBUG(ext_coord->extent =
+				 *extent_by_coord(coord));
+			return 0;
+		}
+		reiser4_set_extent(&rh.overwrite, start, 1);
+		reiser4_set_unwritten_extent(&rh.new_extents[0], start + 1,
+					     width - 1);
+		rh.nr_new_extents = 1;
+		return_inserted_position = 0;
+	} else if (pos_in_unit == width - 1) {
+		if (coord->unit_pos < nr_units_extent(coord) - 1 &&
+		    state_of_extent(ext + 1) == ALLOCATED_EXTENT &&
+		    extent_get_start(ext + 1) == start + width) {
+			/*
+			 * right neighboring unit is allocated extent starting
+			 * right after this one. Widen it to the left
+			 */
+			reiser4_set_extent(ext + 1, start + width - 1,
+					   extent_get_width(ext + 1) + 1);
+			extent_set_width(ext, width - 1);
+			znode_make_dirty(coord->node);
+
+			/* update coord extension */
+			coord->unit_pos++;
+			ext_coord->width = extent_get_width(ext + 1);
+			ext_coord->pos_in_unit = 0;
+			ext_coord->ext_offset += sizeof(reiser4_extent);
+			ON_DEBUG(ext_coord->extent =
+				 *extent_by_coord(coord));
+			return 0;
+		}
+		reiser4_set_unwritten_extent(&rh.overwrite, start, width - 1);
+		reiser4_set_extent(&rh.new_extents[0], start + width - 1, 1);
+		rh.nr_new_extents = 1;
+		return_inserted_position = 1;
+	} else {
+		reiser4_set_unwritten_extent(&rh.overwrite, start,
+					     pos_in_unit);
+		reiser4_set_extent(&rh.new_extents[0], start + pos_in_unit, 1);
+		reiser4_set_unwritten_extent(&rh.new_extents[1],
+					     start + pos_in_unit + 1,
+					     width - pos_in_unit - 1);
+		rh.nr_new_extents = 2;
+		return_inserted_position = 1;
+	}
+	unit_key_by_coord(coord, &rh.paste_key);
+	set_key_offset(&rh.paste_key, get_key_offset(&rh.paste_key) +
+		       extent_get_width(&rh.overwrite) * current_blocksize);
+
+	uf_coord->valid = 0;
+	return reiser4_replace_extent(&rh, return_inserted_position);
+}
+
+/* set @part to blocks [@pos, @pos + @width) of unit @ext */
+static void unit_part(reiser4_extent *part, reiser4_extent *ext,
+		      reiser4_block_nr pos, reiser4_block_nr width)
+{
+	switch (state_of_extent(ext)) {
+	case HOLE_EXTENT:
+		reiser4_set_extent(part, HOLE_EXTENT_START, width);
+		break;
+	case UNALLOCATED_EXTENT:
+		reiser4_set_extent(part, UNALLOCATED_EXTENT_START, width);
+		break;
+	case ALLOCATED_EXTENT:
+		reiser4_set_extent(part, extent_get_start(ext) + pos, width);
+		break;
+	case UNWRITTEN_EXTENT:
+		reiser4_set_unwritten_extent(part, extent_get_start(ext) + pos,
+					     width);
+		break;
+	}
+}
+
+/**
+ * replace_unit_part - replace part of extent unit
+ * @coord: unit to replace part of
+ * @lh: lock handle of @coord's node
+ * @pos: first block of the part within the unit
+ * @with: extent to put in place of the part
+ *
+ * Blocks [@pos, @pos + width of @with) of the unit are replaced with @with,
+ * parts of the unit before and after them remain. In worst case two
+ * additional extents are created. @coord and @lh are returned set to the
+ * first unit of the result.
+ */
+static int replace_unit_part(coord_t *coord, lock_handle *lh,
+			     reiser4_block_nr pos, const reiser4_extent *with)
+{
+	struct replace_handle rh;
+	reiser4_extent *ext;
+	reiser4_block_nr width, count;
+
+	ext = extent_by_coord(coord);
+	width = extent_get_width(ext);
+	count = extent_get_width(with);
+	assert("jalex-35", count != 0 && pos + count <= width);
+
+	if (pos == 0 && count == width) {
+		memcpy(ext, with, sizeof(reiser4_extent));
+		znode_make_dirty(coord->node);
+		return 0;
+	}
+
+	rh.coord = coord;
+	rh.lh = lh;
+	rh.flags = 0;
+	rh.nr_new_extents = 0;
+	if (pos == 0)
+		rh.overwrite = *with;
+	else {
+		unit_part(&rh.overwrite, ext, 0, pos);
+		rh.new_extents[rh.nr_new_extents++] = *with;
+	}
+	if (pos + count < width)
+		unit_part(&rh.new_extents[rh.nr_new_extents++], ext,
+			  pos + count, width - pos - count);
+
+	unit_key_by_coord(coord, &rh.paste_key);
+	set_key_offset(&rh.paste_key, get_key_offset(&rh.paste_key) +
+		       extent_get_width(&rh.overwrite) * current_blocksize);
+	return reiser4_replace_extent(&rh, 0);
+}
+
 /**
  * overwrite_one_block -
  * @uf_coord:
@@ -592,7 +778,7 @@ static int plug_hole(uf_coord_t *uf_coord, const reiser4_key *key, int *how)
  *
  * If @node corresponds to hole extent - create unallocated extent for it and
  * assign fake block number. If @node corresponds to allocated extent - assign
- * block number of jnode
+ * block number of jnode. Unwritten extent becomes allocated one
  */
 static int overwrite_one_block(uf_coord_t *uf_coord, const reiser4_key *key,
 			       jnode *node, int *hole_plugged)
@@ -616,6 +802,13 @@ static int overwrite_one_block(uf_coord_t *uf_coord, const reiser4_key *key,
 		block = extent_get_start(ext) + ext_coord->pos_in_unit;
 		break;
 
+	case UNWRITTEN_EXTENT:
+		block = extent_get_start(ext) + ext_coord->pos_in_unit;
+		result = write_unwritten(uf_coord, key);
+		if (result)
+			return result;
+		break;
+
 	case HOLE_EXTENT:
 		inode_add_blocks(mapping_jnode(node)->host, 1);
 		result = plug_hole(uf_coord, key, &how);
@@ -806,10 +999,12 @@ int reiser4_update_extent(struct inode *inode, jnode *node, loff_t pos,
  * @jnodes:
  * @count:
  * @off:
+ * @plugged_hole: set if a hole was filled, may be NULL
  *
  */
 static int update_extents(struct file *file, struct inode *inode,
-			  jnode **jnodes, int count, loff_t pos)
+			  jnode **jnodes, int count, loff_t pos,
+			  int *plugged_hole)
 {
 	struct hint hint;
 	reiser4_key key;
@@ -861,7 +1056,7 @@ static int update_extents(struct file *file, struct inode *inode,
 				init_coord_extension_extent(&hint.ext_coord,
 							    get_key_offset(&key));
 			result = overwrite_extent(&hint.ext_coord, &key,
-						  jnodes, count, NULL);
+						  jnodes, count, plugged_hole);
 		} else {
 			/*
 			 * there are no items of this file in the tree
@@ -894,20 +1089,42 @@ static int update_extents(struct file *file, struct inode *inode,
 	return result;
 }
 
+/**
+ * reiser4_update_extents - make extents of file point to jnodes
+ * @inode: file the jnodes belong to
+ * @jnodes: jnodes of consecutive pages of the file, without block numbers
+ * @count: number of jnodes
+ * @plugged_hole: set if a hole was filled
+ *
+ * Creates unallocated extents for @count jnodes, captures them and marks them
+ * dirty. Extent items are updated in one pass over the file range. Space has
+ * to be reserved by caller.
+ */
+int reiser4_update_extents(struct inode *inode, jnode **jnodes, int count,
+			   int *plugged_hole)
+{
+	int result;
+
+	assert("jalex-42", count > 0);
+	result = update_extents(NULL, inode, jnodes, count, 0, plugged_hole);
+	return result < 0 ? result : 0;
+}
+
 /**
  * write_extent_reserve_space - reserve space for extent write operation
  * @inode:
+ * @nr_pages: number of pages to be written
  *
- * Estimates and reserves space which may be required for writing
- * WRITE_GRANULARITY pages of file.
+ * Estimates and reserves space which may be required for writing @nr_pages
+ * pages of file.
  */
-static int write_extent_reserve_space(struct inode *inode)
+static int write_extent_reserve_space(struct inode *inode, int nr_pages)
 {
 	__u64 count;
 	reiser4_tree *tree;
 
 	/*
-	 * to write WRITE_GRANULARITY pages to a file by extents we have to
+	 * to write @nr_pages pages to a file by extents we have to
 	 * reserve disk space for:
 
 	 * 1. find_file_item may have to insert empty node to the tree (empty
@@ -923,7 +1140,7 @@ static int write_extent_reserve_space(struct inode *inode)
 	 */
 	tree = reiser4_tree_by_inode(inode);
 	count = estimate_one_insert_item(tree) +
-		WRITE_GRANULARITY * (1 + estimate_one_insert_into_item(tree)) +
+		nr_pages * (1 + estimate_one_insert_into_item(tree)) +
 		estimate_one_insert_item(tree);
 	grab_space_enable();
 	return reiser4_grab_space(count, 0 /* flags */);
@@ -961,6 +1178,12 @@ filemap_copy_from_user(struct page *page, unsigned long offset,
  * @count: number of bytes to write
  * @pos: position in file to write to
  *
+ * Writes up to WRITE_BATCH pages as one operation: space is reserved once,
+ * extent items are updated for all written pages in one pass, which keeps
+ * its position in the tree sealed from one twig node to another, and jnodes
+ * of all pages are captured together. If memory for the batch can not be
+ * allocated or space for it can not be reserved, WRITE_GRANULARITY pages are
+ * written.
  */
 ssize_t reiser4_write_extent(struct file *file, struct inode * inode,
 			     const char __user *buf, size_t count, loff_t *pos)
@@ -968,7 +1191,8 @@ ssize_t reiser4_write_extent(struct file *file, struct inode * inode,
 	int have_to_update_extent;
 	int nr_pages, nr_dirty;
 	struct page *page;
-	jnode *jnodes[WRITE_GRANULARITY + 1];
+	jnode *onstack[WRITE_GRANULARITY + 1];
+	jnode **jnodes;
 	unsigned long index;
 	unsigned long end;
 	int i;
@@ -976,24 +1200,43 @@ ssize_t reiser4_write_extent(struct file *file, struct inode * inode,
 	size_t left, written;
 	int result = 0;
 
-	if (write_extent_reserve_space(inode))
-		return RETERR(-ENOSPC);
-
 	if (count == 0) {
 		/* truncate case */
-		update_extents(file, inode, jnodes, 0, *pos);
+		if (write_extent_reserve_space(inode, WRITE_GRANULARITY))
+			return RETERR(-ENOSPC);
+		update_extents(file, inode, onstack, 0, *pos, NULL);
 		return 0;
 	}
 
 	BUG_ON(get_current_context()->trans->atom != NULL);
 
-	left = count;
 	index = *pos >> PAGE_SHIFT;
 	/* calculate number of pages which are to be written */
       	end = ((*pos + count - 1) >> PAGE_SHIFT);
 	nr_pages = end - index + 1;
 	nr_dirty = 0;
-	assert("", nr_pages <= WRITE_GRANULARITY + 1);
+	assert("", nr_pages <= WRITE_BATCH + 1);
+
+	jnodes = onstack;
+	if (nr_pages > WRITE_GRANULARITY + 1) {
+		jnodes = kmalloc(nr_pages * sizeof(jnode *),
+				 reiser4_ctx_gfp_mask_get());
+		if (jnodes != NULL &&
+		    write_extent_reserve_space(inode, nr_pages)) {
+			kfree(jnodes);
+			jnodes = NULL;
+		}
+		if (jnodes == NULL) {
+			/* write less */
+			jnodes = onstack;
+			nr_pages = WRITE_GRANULARITY;
+			end = index + nr_pages - 1;
+			count = ((loff_t)(end + 1) << PAGE_SHIFT) - *pos;
+		}
+	}
+	if (jnodes == onstack && write_extent_reserve_space(inode, nr_pages))
+		return RETERR(-ENOSPC);
+	left = count;
 
 	/* get pages and jnodes */
 	for (i = 0; i < nr_pages; i ++) {
@@ -1081,25 +1324,20 @@ ssize_t reiser4_write_extent(struct file *file, struct inode * inode,
 		BUG_ON(get_current_context()->trans->atom != NULL);
 	}
 
-	if (have_to_update_extent) {
-		update_extents(file, inode, jnodes, nr_dirty, *pos);
-	} else {
-		for (i = 0; i < nr_dirty; i ++) {
-			int ret;
-			spin_lock_jnode(jnodes[i]);
-			ret = reiser4_try_capture(jnodes[i],
-						     ZNODE_WRITE_LOCK, 0);
-			BUG_ON(ret != 0);
-			jnode_make_dirty_locked(jnodes[i]);
-			spin_unlock_jnode(jnodes[i]);
-		}
-	}
+	if (have_to_update_extent)
+		update_extents(file, inode, jnodes, nr_dirty, *pos, NULL);
+	else
+		/* overwrite of allocated blocks: capture all pages under one
+		   lock of the atom */
+		reiser4_capture_dirty_jnodes(jnodes, nr_dirty);
 out:
 	for (i = 0; i < nr_pages; i ++) {
 		put_page(jnode_page(jnodes[i]));
 		JF_CLR(jnodes[i], JNODE_WRITE_PREPARED);
 		jput(jnodes[i]);
 	}
+	if (jnodes != onstack)
+		kfree(jnodes);
 
 	/* the only errors handled so far is ENOMEM and
 	   EFAULT on copy_from_user  */
@@ -1107,6 +1345,258 @@ out:
 	return (count - left) ? (count - left) : result;
 }
 
+/*
+ * find extent unit which addresses page @index of file body, write lock and
+ * load its node
+ */
+static int find_unit_to_modify(struct inode *inode, pgoff_t index,
+			       coord_t *coord, lock_handle *lh)
+{
+	reiser4_key key;
+	int result;
+
+	key_by_inode_and_offset_common(inode, (loff_t)index << PAGE_SHIFT,
+				       &key);
+	coord_init_zero(coord);
+	init_lh(lh);
+	result = find_file_item_nohint(coord, lh, &key, ZNODE_WRITE_LOCK,
+				       inode);
+	if (IS_CBKERR(result)) {
+		done_lh(lh);
+		return result;
+	}
+	if (result != CBK_COORD_FOUND || coord->between != AT_UNIT) {
+		/* file body does not cover @index */
+		done_lh(lh);
+		return RETERR(-EIO);
+	}
+	result = zload(coord->node);
+	if (result) {
+		done_lh(lh);
+		return result;
+	}
+	if (!item_is_extent(coord)) {
+		zrelse(coord->node);
+		done_lh(lh);
+		return RETERR(-EIO);
+	}
+	return 0;
+}
+
+/*
+ * allocate blocks for hole unit addressing page @index. On entry @len is
+ * maximal number of blocks to allocate, on return it is the number of pages
+ * handled
+ */
+static int prealloc_unit(struct inode *inode, pgoff_t index,
+			 reiser4_block_nr *len)
+{
+	reiser4_blocknr_hint hint;
+	reiser4_ba_flags_t flags;
+	reiser4_block_nr start, pos, width;
+	reiser4_extent *ext, unwritten;
+	coord_t coord;
+	lock_handle lh;
+	znode *loaded;
+	int result;
+
+	result = find_unit_to_modify(inode, index, &coord, &lh);
+	if (result)
+		return result;
+	loaded = coord.node;
+
+	ext = extent_by_coord(&coord);
+	width = extent_get_width(ext);
+	pos = index - extent_unit_index(&coord);
+	if (*len > width - pos)
+		*len = width - pos;
+	if (state_of_extent(ext) != HOLE_EXTENT)
+		/* blocks are there already */
+		goto out;
+
+	/* try to continue the unit to the left */
+	reiser4_blocknr_hint_init(&hint);
+	hint.block_stage = BLOCK_GRABBED;
+	flags = BA_PERMANENT;
+	if (coord.unit_pos &&
+	    (state_of_extent(ext - 1) == ALLOCATED_EXTENT ||
+	     state_of_extent(ext - 1) == UNWRITTEN_EXTENT))
+		hint.blk = extent_get_start(ext - 1) + extent_get_width(ext - 1);
+	else
+		flags |= BA_USE_DEFAULT_SEARCH_START;
+	result = reiser4_alloc_blocks(&hint, &start, len, flags);
+	reiser4_blocknr_hint_done(&hint);
+	if (result)
+		goto out;
+	/* there are no jnodes to get these blocks into commit bitmap */
+	result = atom_aset_add_extent(&start, len);
+	if (result) {
+		reiser4_dealloc_blocks(&start, len, BLOCK_GRABBED,
+				       BA_PERMANENT);
+		goto out;
+	}
+	inode_add_blocks(inode, *len);
+
+	if (pos == 0 && *len < width && coord.unit_pos &&
+	    state_of_extent(ext - 1) == UNWRITTEN_EXTENT &&
+	    extent_get_start(ext - 1) + extent_get_width(ext - 1) == start) {
+		/*
+		 * left neighboring unit is unwritten extent ending right
+		 * before allocated blocks. Widen it and shrink the hole
+		 */
+		extent_set_width(ext - 1, extent_get_width(ext - 1) + *len);
+		extent_set_width(ext, width - *len);
+		znode_make_dirty(coord.node);
+		goto out;
+	}
+	reiser4_set_unwritten_extent(&unwritten, start, *len);
+	result = replace_unit_part(&coord, &lh, pos, &unwritten);
+	if (result) {
+		/* commit bitmap gets these blocks, deferred deallocation
+		   removes them from there */
+		reiser4_dealloc_blocks(&start, len, 0 /* not used */,
+				       BA_DEFER);
+		inode_sub_blocks(inode, *len);
+	}
+ out:
+	zrelse(loaded);
+	done_lh(&lh);
+	return result;
+}
+
+/* blocks preallocated per transaction */
+#define PREALLOC_GRANULARITY (8192)
+
+/**
+ * reiser4_prealloc_extent - preallocate blocks for file body
+ * @inode: file to preallocate blocks for
+ * @from: first page of range
+ * @to: page next to the last one of range
+ *
+ * Allocates disk blocks for hole units addressing pages [@from, @to) and
+ * turns them to unwritten extents. File body has to cover the range
+ * already. Each PREALLOC_GRANULARITY blocks are allocated in separate
+ * transaction.
+ */
+int reiser4_prealloc_extent(struct inode *inode, pgoff_t from, pgoff_t to)
+{
+	reiser4_tree *tree;
+	reiser4_block_nr len;
+	int result = 0;
+
+	tree = reiser4_tree_by_inode(inode);
+	while (from < to) {
+		len = min_t(reiser4_block_nr, to - from, PREALLOC_GRANULARITY);
+		grab_space_enable();
+		result = reiser4_grab_space(len +
+					    estimate_one_insert_into_item(tree),
+					    BA_CAN_COMMIT);
+		if (result)
+			break;
+		result = prealloc_unit(inode, from, &len);
+		all_grabbed2free();
+		reiser4_txn_restart_current();
+		if (result)
+			break;
+		from += len;
+		if (fatal_signal_pending(current)) {
+			result = RETERR(-EINTR);
+			break;
+		}
+	}
+	return result;
+}
+
+/*
+ * make part of unit addressing page @index a hole. On entry @len is maximal
+ * number of pages to punch, on return it is the number of pages handled
+ */
+static int punch_unit(struct inode *inode, pgoff_t index,
+		      reiser4_block_nr *len)
+{
+	reiser4_block_nr start, pos, width;
+	reiser4_extent *ext, hole;
+	extent_state state;
+	coord_t coord;
+	lock_handle lh;
+	znode *loaded;
+	int result;
+
+	result = find_unit_to_modify(inode, index, &coord, &lh);
+	if (result)
+		return result;
+	loaded = coord.node;
+
+	ext = extent_by_coord(&coord);
+	width = extent_get_width(ext);
+	pos = index - extent_unit_index(&coord);
+	if (*len > width - pos)
+		*len = width - pos;
+	state = state_of_extent(ext);
+	if (state == HOLE_EXTENT)
+		goto out;
+	start = extent_get_start(ext) + pos;
+
+	reiser4_set_extent(&hole, HOLE_EXTENT_START, *len);
+	result = replace_unit_part(&coord, &lh, pos, &hole);
+	if (result)
+		goto out;
+
+	/* take care of pages and jnodes of punched part */
+	reiser4_invalidate_pages(inode->i_mapping, index, *len, 0);
+	inode_sub_blocks(inode, *len);
+	if (state == UNALLOCATED_EXTENT)
+		fake_allocated2free(*len, 0 /* unformatted */);
+	else
+		/* blocks may not be reused before commit */
+		reiser4_dealloc_blocks(&start, len, 0 /* not used */,
+				       BA_DEFER);
+ out:
+	zrelse(loaded);
+	done_lh(&lh);
+	return result;
+}
+
+/**
+ * reiser4_punch_extent - make part of file body a hole
+ * @inode: file to punch hole in
+ * @from: first page of range
+ * @to: page next to the last one of range
+ *
+ * Frees blocks addressing pages [@from, @to) and replaces their extent units
+ * with holes in place. Unlike cut_file_items this does not shift keys of the
+ * rest of file body, so that it may punch range in the middle of the
+ * body. File body has to cover the range.
+ */
+int reiser4_punch_extent(struct inode *inode, pgoff_t from, pgoff_t to)
+{
+	reiser4_tree *tree;
+	reiser4_block_nr len;
+	int result = 0;
+
+	tree = reiser4_tree_by_inode(inode);
+	while (from < to) {
+		len = to - from;
+		grab_space_enable();
+		result = reiser4_grab_reserved(inode->i_sb,
+					estimate_one_insert_into_item(tree),
+					BA_CAN_COMMIT);
+		if (result == 0)
+			result = punch_unit(inode, from, &len);
+		/* the below does up(sbinfo->delete_mutex) */
+		reiser4_release_reserved(inode->i_sb);
+		reiser4_txn_restart_current();
+		if (result)
+			break;
+		from += len;
+		if (fatal_signal_pending(current)) {
+			result = RETERR(-EINTR);
+			break;
+		}
+	}
+	return result;
+}
+
 int reiser4_do_readpage_extent(reiser4_extent * ext, reiser4_block_nr pos,
 			       struct page *page)
 {
@@ -1122,9 +1612,10 @@ int reiser4_do_readpage_extent(reiser4_extent * ext, reiser4_block_nr pos,
 
 	switch (state_of_extent(ext)) {
 	case HOLE_EXTENT:
+	case UNWRITTEN_EXTENT:
 		/*
 		 * it is possible to have hole page with jnode, if page was
-		 * eflushed previously.
+		 * eflushed previously. Unwritten extent reads as a hole
 		 */
 		j = jfind(mapping, index);
 		if (j == NULL) {
@@ -1186,6 +1677,94 @@ int reiser4_do_readpage_extent(reiser4_extent * ext, reiser4_block_nr pos,
 	return 0;
 }
 
+/* completion handler for reads submitted by reiser4_readahead_extent() */
+static void end_bio_extent_read(struct bio *bio)
+{
+	struct bio_vec *bvec;
+	int i;
+
+	bio_for_each_segment_all(bvec, bio, i) {
+		struct page *page = bvec->bv_page;
+
+		if (!bio->bi_error)
+			SetPageUptodate(page);
+		else {
+			ClearPageUptodate(page);
+			SetPageError(page);
+		}
+		unlock_page(page);
+	}
+	bio_put(bio);
+}
+
+/* submit bio collected by reiser4_readahead_extent() */
+void reiser4_submit_extent_read(struct extent_read_bio *erb)
+{
+	if (erb->bio != NULL) {
+		submit_bio(erb->bio);
+		erb->bio = NULL;
+	}
+}
+
+/**
+ * reiser4_readahead_extent - add page to multi-page read
+ * @erb: readahead state
+ * @ext: extent unit @page belongs to
+ * @pos: position of @page within @ext
+ * @page: locked page to read
+ *
+ * Clean pages of allocated extents do not need jnodes: a jnode is created when
+ * page gets dirty. So, instead of going through reiser4_do_readpage_extent(),
+ * which creates jnode and submits single page bio, add the page to the bio
+ * being collected, or start new one if the page is not adjacent to the last
+ * one. Returns 1 if page has to be read by reiser4_do_readpage_extent().
+ */
+int reiser4_readahead_extent(struct extent_read_bio *erb, reiser4_extent *ext,
+			     reiser4_block_nr pos, struct page *page)
+{
+	struct super_block *super;
+	reiser4_block_nr block;
+	struct bio *bio;
+	jnode *j;
+
+	assert("jalex-28", PageLocked(page));
+
+	if (state_of_extent(ext) != ALLOCATED_EXTENT)
+		return 1;
+	j = jfind(page->mapping, page->index);
+	if (j != NULL) {
+		/* jnode may refer to a block other than in the extent */
+		jput(j);
+		return 1;
+	}
+
+	block = extent_get_start(ext) + pos;
+	if (erb->bio != NULL && block == erb->next &&
+	    bio_add_page(erb->bio, page, PAGE_SIZE, 0) == PAGE_SIZE) {
+		erb->next++;
+		return 0;
+	}
+	reiser4_submit_extent_read(erb);
+
+	bio = bio_alloc(reiser4_ctx_gfp_mask_get(),
+			min_t(unsigned, erb->nr_pages + 1, BIO_MAX_PAGES));
+	if (bio == NULL)
+		return RETERR(-ENOMEM);
+	super = page->mapping->host->i_sb;
+	assert("jalex-29", super->s_blocksize == PAGE_SIZE);
+	bio->bi_bdev = super->s_bdev;
+	bio->bi_iter.bi_sector = block * (super->s_blocksize >> 9);
+	bio->bi_end_io = end_bio_extent_read;
+	bio_set_op_attrs(bio, READ, 0);
+	if (bio_add_page(bio, page, PAGE_SIZE, 0) != PAGE_SIZE) {
+		bio_put(bio);
+		return 1;
+	}
+	erb->bio = bio;
+	erb->next = block + 1;
+	return 0;
+}
+
 /* Implements plugin->u.item.s.file.read operation for extent items. */
 int reiser4_read_extent(struct file *file, flow_t *flow, hint_t *hint)
 {
@@ -1360,6 +1939,57 @@ int get_block_address_extent(const coord_t *coord, sector_t block,
 	return 0;
 }
 
+/*
+  plugin->u.item.s.file.map
+  holes are not reported, unallocated extents are reported as delayed
+  allocation, unwritten extents are reported with their blocks
+*/
+int body_map_extent(const coord_t *coord, struct inode *inode UNUSED_ARG,
+		    struct body_map *map)
+{
+	reiser4_key key;
+	reiser4_extent *ext;
+	pos_in_node_t i, nr_units;
+	loff_t off, len;
+	int result;
+
+	item_key_by_coord(coord, &key);
+	off = get_key_offset(&key);
+	ext = extent_item(coord);
+	nr_units = nr_units_extent(coord);
+	for (i = 0; i < nr_units; i++, ext++) {
+		len = (loff_t)extent_get_width(ext) << current_blocksize_bits;
+		switch (state_of_extent(ext)) {
+		case HOLE_EXTENT:
+			result = 0;
+			break;
+		case UNALLOCATED_EXTENT:
+			result = body_map_add(map, off, len, 0,
+					      FIEMAP_EXTENT_UNKNOWN |
+					      FIEMAP_EXTENT_DELALLOC);
+			break;
+		case ALLOCATED_EXTENT:
+			result = body_map_add(map, off, len,
+					      (__u64)extent_get_start(ext) <<
+					      current_blocksize_bits, 0);
+			break;
+		case UNWRITTEN_EXTENT:
+			result = body_map_add(map, off, len,
+					      (__u64)extent_get_start(ext) <<
+					      current_blocksize_bits,
+					      FIEMAP_EXTENT_UNWRITTEN);
+			break;
+		default:
+			result = RETERR(-EIO);
+			break;
+		}
+		if (result)
+			return result;
+		off += len;
+	}
+	return 0;
+}
+
 /*
   plugin->u.item.s.file.append_key
   key of first byte which is the next to last byte by addressed by this extent
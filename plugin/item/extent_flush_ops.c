@@ -4,6 +4,7 @@
 #include "../../tree.h"
 #include "../../jnode.h"
 #include "../../super.h"
+#include "../../inode.h"
 #include "../../flush.h"
 #include "../../carry.h"
 #include "../object.h"
@@ -46,6 +47,7 @@ int utmost_child_extent(const coord_t * coord, sideof side, jnode ** childp)
 
 	switch (state_of_extent(ext)) {
 	case HOLE_EXTENT:
+	case UNWRITTEN_EXTENT:
 		*childp = NULL;
 		return 0;
 	case ALLOCATED_EXTENT:
@@ -97,6 +99,7 @@ utmost_child_real_block_extent(const coord_t * coord, sideof side,
 
 	switch (state_of_extent(ext)) {
 	case ALLOCATED_EXTENT:
+	case UNWRITTEN_EXTENT:
 		*block = extent_get_start(ext);
 		if (side == RIGHT_SIDE)
 			*block += extent_get_width(ext) - 1;
@@ -554,6 +557,46 @@ void assign_real_blocknrs(flush_pos_t *flush_pos, oid_t oid,
 	return;
 }
 
+/**
+ * unformatted_alloc_window - find window to allocate unformatted nodes from
+ * @oid: objectid of file
+ * @index: index of a dirty jnode of the file
+ *
+ * Returns allocation window of the regular file owning jnode @oid:@index, or
+ * NULL if the file has no window. The window is pinned: the file is not
+ * destroyed until reiser4_put_alloc_window() is called. The file itself is
+ * not referenced.
+ */
+struct reiser4_alloc_window *unformatted_alloc_window(oid_t oid,
+						      unsigned long index)
+{
+	reiser4_super_info_data *sbinfo = get_current_super_private();
+	struct reiser4_alloc_window *win = NULL;
+	struct inode *inode;
+	jnode *node;
+
+	/*
+	 * A file is destroyed only when it has no jnodes left, and unix files
+	 * take window_lock in destroy_inode. So the file of a jnode found
+	 * under window_lock is alive until the lock is released.
+	 */
+	spin_lock(&sbinfo->window_lock);
+	node = jlookup(current_tree, oid, index);
+	if (node != NULL) {
+		inode = jnode_get_mapping(node)->host;
+		/* unix files are never converted to other plugins */
+		if (inode_file_plugin(inode) ==
+		    file_plugin_by_id(UNIX_FILE_PLUGIN_ID)) {
+			win = &unix_file_inode_data(inode)->window;
+			win->users++;
+		}
+	}
+	spin_unlock(&sbinfo->window_lock);
+	if (node != NULL)
+		jput(node);
+	return win;
+}
+
 /**
  * allocated_extent_slum_size
  * @flush_pos:
@@ -647,7 +690,8 @@ int put_unit_to_end(znode *node,
 	} else {
 		/* try to glue with last unit */
 		last_ext = extent_by_coord(&coord);
-		if (state_of_extent(last_ext) &&
+		if (state_of_extent(last_ext) != HOLE_EXTENT &&
+		    state_of_extent(last_ext) == state_of_extent(copy_ext) &&
 		    extent_get_start(last_ext) + extent_get_width(last_ext) ==
 		    extent_get_start(copy_ext)) {
 			/* widen last unit of node */
@@ -478,7 +478,8 @@ kill_hook_extent(const coord_t * coord, pos_in_node_t from, pos_in_node_t count,
 			continue;
 		}
 
-		assert("vs-1218", state_of_extent(ext) == ALLOCATED_EXTENT);
+		assert("vs-1218", state_of_extent(ext) == ALLOCATED_EXTENT ||
+		       state_of_extent(ext) == UNWRITTEN_EXTENT);
 
 		if (length != 0) {
 			start = extent_get_start(ext) + skip;
@@ -611,11 +612,7 @@ kill_units_extent(coord_t * coord, pos_in_node_t from, pos_in_node_t to,
 
 			assert("", extent_get_width(ext) > rest);
 
-			if (state_of_extent(ext) == ALLOCATED_EXTENT)
-				extent_set_start(ext,
-						 extent_get_start(ext) +
-						 (extent_get_width(ext) -
-						  rest));
+			extent_move_start(ext, extent_get_width(ext) - rest);
 
 			extent_set_width(ext, rest);
 			count--;
@@ -737,11 +734,8 @@ cut_units_extent(coord_t * coord, pos_in_node_t from, pos_in_node_t to,
 		   and width decreased. */
 		assert("vs-1583", (off & (PAGE_SIZE - 1)) == 0);
 		ext = extent_item(coord) + to;
-		if (state_of_extent(ext) == ALLOCATED_EXTENT)
-			extent_set_start(ext,
-					 extent_get_start(ext) +
-					 (extent_get_width(ext) -
-					  (off >> PAGE_SHIFT)));
+		extent_move_start(ext,
+				  extent_get_width(ext) - (off >> PAGE_SHIFT));
 
 		extent_set_width(ext, (off >> PAGE_SHIFT));
 		count--;
@@ -854,7 +848,8 @@ int reiser4_check_extent(const coord_t * coord /* coord of item to check */,
 		/* make sure that this extent does not overlap with other
 		   allocated extents extents */
 		for (j = 0; j < i; j++) {
-			if (state_of_extent(first + j) != ALLOCATED_EXTENT)
+			if (state_of_extent(first + j) != ALLOCATED_EXTENT &&
+			    state_of_extent(first + j) != UNWRITTEN_EXTENT)
 				continue;
 			if (!
 			    ((extent_get_start(ext) >=
@@ -559,7 +559,8 @@ item_plugin item_plugins[LAST_ITEM_ID] = {
 				.get_block = get_block_address_extent,
 				.append_key = append_key_extent,
 				.init_coord_extension =
-				init_coord_extension_extent
+				init_coord_extension_extent,
+				.map = body_map_extent
 			}
 		}
 	},
@@ -612,7 +613,8 @@ item_plugin item_plugins[LAST_ITEM_ID] = {
 				.get_block = get_block_address_tail,
 				.append_key = append_key_tail,
 				.init_coord_extension =
-				init_coord_extension_tail
+				init_coord_extension_tail,
+				.map = body_map_tail
 			}
 		}
 	},
@@ -666,7 +668,8 @@ item_plugin item_plugins[LAST_ITEM_ID] = {
 				.get_block = get_block_address_tail,
 				.append_key = append_key_ctail,
 				.init_coord_extension =
-				init_coord_extension_tail
+				init_coord_extension_tail,
+				.map = body_map_ctail
 			}
 		}
 	},
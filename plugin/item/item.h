@@ -252,6 +252,12 @@ struct file_iops{
 	reiser4_key *(*append_key) (const coord_t *, reiser4_key *);
 
 	void (*init_coord_extension) (uf_coord_t *, loff_t);
+	/*
+	 * report ranges of file data the item @coord addresses to
+	 * body_map_add(). Returns 0 to continue the walk to the next item, a
+	 * positive value to stop it, or error code
+	 */
+	int (*map) (const coord_t *, struct inode *, struct body_map *);
 };
 
 /* operations specific to items of stat data type */
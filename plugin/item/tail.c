@@ -798,6 +798,32 @@ get_block_address_tail(const coord_t * coord, sector_t lblock, sector_t * block)
 	return 0;
 }
 
+/*
+  plugin->u.item.s.file.map
+  tail item is reported as one range of data packed into formatted node
+*/
+int body_map_tail(const coord_t *coord, struct inode *inode UNUSED_ARG,
+		  struct body_map *map)
+{
+	reiser4_key key;
+	__u64 phys = 0;
+	__u32 flags = FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_NOT_ALIGNED;
+
+	assert("jalex-36", znode_get_level(coord->node) == LEAF_LEVEL);
+
+	item_key_by_coord(coord, &key);
+	if (reiser4_blocknr_is_fake(znode_get_block(coord->node)))
+		/* node is not allocated yet */
+		flags |= FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC;
+	else
+		phys = ((__u64)*znode_get_block(coord->node) <<
+			current_blocksize_bits) +
+			((char *)item_body_by_coord(coord) -
+			 zdata(coord->node));
+	return body_map_add(map, get_key_offset(&key), nr_units_tail(coord),
+			    phys, flags);
+}
+
 /*
  * Local variables:
  * c-indentation-style: "K&R"
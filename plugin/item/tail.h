@@ -43,6 +43,7 @@ int readpage_tail(void *vp, struct page *page);
 reiser4_key *append_key_tail(const coord_t *, reiser4_key *);
 void init_coord_extension_tail(uf_coord_t *, loff_t offset);
 int get_block_address_tail(const coord_t *, sector_t, sector_t *);
+int body_map_tail(const coord_t *, struct inode *, struct body_map *);
 
 /* __REISER4_TAIL_H__ */
 #endif
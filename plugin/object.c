@@ -121,20 +121,22 @@ static struct address_space_operations null_a_ops = {.writepage = NULL};
 static struct inode_operations regular_file_i_ops = {
 	.permission = reiser4_permission_common,
 	.setattr = reiser4_setattr_dispatch,
-	.getattr = reiser4_getattr_common
+	.getattr = reiser4_getattr_common,
+	.fiemap = reiser4_fiemap_dispatch
 };
 static struct file_operations regular_file_f_ops = {
-	.llseek = generic_file_llseek,
+	.llseek = reiser4_llseek_dispatch,
 	.read = reiser4_read_dispatch,
 	.write = reiser4_write_dispatch,
 	.read_iter = generic_file_read_iter,
 	.unlocked_ioctl = reiser4_ioctl_dispatch,
 #ifdef CONFIG_COMPAT
-	.compat_ioctl = reiser4_ioctl_dispatch,
+	.compat_ioctl = reiser4_compat_ioctl_dispatch,
 #endif
 	.mmap = reiser4_mmap_dispatch,
 	.open = reiser4_open_dispatch,
 	.release = reiser4_release_dispatch,
+	.fallocate = reiser4_fallocate_dispatch,
 	.fsync = reiser4_sync_file_common,
 	.splice_read = generic_file_splice_read,
 };
@@ -148,6 +150,7 @@ static struct address_space_operations regular_file_a_ops = {
 	.write_begin = reiser4_write_begin_dispatch,
 	.write_end = reiser4_write_end_dispatch,
 	.bmap = reiser4_bmap_dispatch,
+	.direct_IO = reiser4_direct_IO_dispatch,
 	.invalidatepage = reiser4_invalidatepage,
 	.releasepage = reiser4_releasepage,
 	.migratepage = reiser4_migratepage
@@ -187,6 +190,10 @@ static struct file_operations directory_f_ops = {
 	.llseek = reiser4_llseek_dir_common,
 	.read = generic_read_dir,
 	.iterate = reiser4_iterate_common,
+	.unlocked_ioctl = reiser4_ioctl_dir_common,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = reiser4_compat_ioctl_dir_common,
+#endif
 	.release = reiser4_release_dir_common,
 	.fsync = reiser4_sync_common
 };
@@ -219,12 +226,15 @@ file_plugin file_plugins[LAST_FILE_PLUGIN_ID] = {
 		 * private i_ops
 		 */
 		.setattr = setattr_unix_file,
+		.fiemap = fiemap_unix_file,
 		.open = open_unix_file,
 		.read = read_unix_file,
 		.write = write_unix_file,
 		.ioctl = ioctl_unix_file,
 		.mmap = mmap_unix_file,
 		.release = release_unix_file,
+		.fallocate = fallocate_unix_file,
+		.llseek = llseek_unix_file,
 		/*
 		 * private f_ops
 		 */
@@ -237,6 +247,7 @@ file_plugin file_plugins[LAST_FILE_PLUGIN_ID] = {
 		 * private a_ops
 		 */
 		.bmap = bmap_unix_file,
+		.direct_IO = direct_IO_unix_file,
 		/*
 		 * other private methods
 		 */
@@ -261,6 +272,7 @@ file_plugin file_plugins[LAST_FILE_PLUGIN_ID] = {
 		},
 		.init_inode_data = init_inode_data_unix_file,
 		.cut_tree_worker = cut_tree_worker_common,
+		.destroy_inode = destroy_inode_unix_file,
 		.wire = {
 			.write = wire_write_common,
 			.read = wire_read_common,
@@ -415,12 +427,14 @@ file_plugin file_plugins[LAST_FILE_PLUGIN_ID] = {
 		.as_ops = &regular_file_a_ops,
 
 		.setattr = setattr_cryptcompress,
+		.fiemap = fiemap_cryptcompress,
 		.open = open_cryptcompress,
 		.read = read_cryptcompress,
 		.write = write_cryptcompress,
 		.ioctl = ioctl_cryptcompress,
 		.mmap = mmap_cryptcompress,
 		.release = release_cryptcompress,
+		.llseek = llseek_cryptcompress,
 
 		.readpage = readpage_cryptcompress,
 		.readpages = readpages_cryptcompress,
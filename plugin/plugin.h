@@ -157,7 +157,18 @@ typedef struct reiser4_object_on_wire reiser4_object_on_wire;
  * NOTE: Make sure that respective marco is also incremented in
  * the new release of reiser4progs.
  */
-#define PLUGIN_LIBRARY_VERSION 1
+#define PLUGIN_LIBRARY_VERSION 2
+
+/*
+ * Minor format version which introduced unwritten extents. Kernels which
+ * predate it read unwritten extents as allocated ones, so volumes are not
+ * upgraded to it on mount, but when the first unwritten extent is created.
+ * Kernels mount volumes of a minor version they do not know read-only.
+ * NOTE: reiser4progs have to learn the unwritten bit of extent start and
+ * bump their library version to 2 before fsck.reiser4 may check such
+ * volumes.
+ */
+#define UNWRITTEN_EXTENT_VERSION 2
 
  /* enumeration of fields within plugin_set */
 typedef enum {
@@ -216,6 +227,9 @@ typedef struct file_plugin {
 	 * private inode_ops
 	 */
 	int (*setattr)(struct dentry *, struct iattr *);
+	/* report extents of file body. NULL if fiemap is not supported */
+	int (*fiemap) (struct inode *, struct fiemap_extent_info *,
+		       __u64 start, __u64 len);
 	/*
 	 * private file_ops
 	 */
@@ -232,6 +246,13 @@ typedef struct file_plugin {
 	int (*ioctl) (struct file *filp, unsigned int cmd, unsigned long arg);
 	int (*mmap) (struct file *, struct vm_area_struct *);
 	int (*release) (struct inode *, struct file *);
+	/* preallocate space or punch hole. NULL if fallocate is not
+	   supported */
+	long (*fallocate) (struct file *, int mode, loff_t offset,
+			   loff_t len);
+	/* SEEK_DATA and SEEK_HOLE. Other origins are handled by
+	   generic_file_llseek() */
+	loff_t (*llseek) (struct file *, loff_t offset, int origin);
 	/*
 	 * private a_ops
 	 */
@@ -245,6 +266,9 @@ typedef struct file_plugin {
 	int (*write_end)(struct file *file, struct page *page,
 			 loff_t pos, unsigned copied, void *fsdata);
 	sector_t (*bmap) (struct address_space * mapping, sector_t lblock);
+	/* O_DIRECT read and write. NULL if direct i/o is not supported, in
+	   which case it is done through page cache */
+	ssize_t (*direct_IO) (struct kiocb *, struct iov_iter *);
 	/* other private methods */
 	/* save inode cached stat-data onto disk. It was called
 	   reiserfs_update_sd() in 3.x */
@@ -670,7 +694,7 @@ typedef struct disk_format_plugin {
 	int (*release) (struct super_block *);
 	jnode * (*log_super) (struct super_block *);
 	int (*check_open) (const struct inode *object);
-	int (*version_update) (struct super_block *);
+	int (*version_update) (struct super_block *, int version);
 } disk_format_plugin;
 
 struct jnode_plugin {
@@ -833,6 +857,7 @@ typedef enum {
 	HYBRID_TXMOD_ID,
 	JOURNAL_TXMOD_ID,
 	WA_TXMOD_ID,
+	ADAPTIVE_TXMOD_ID,
 	LAST_TXMOD_ID
 } reiser4_txmod_id;
 
@@ -916,6 +941,12 @@ static inline int get_release_number_minor(void)
 	return PLUGIN_LIBRARY_VERSION;
 }
 
+/* the highest minor format version volumes are upgraded to on mount */
+static inline int get_mount_number_minor(void)
+{
+	return min(PLUGIN_LIBRARY_VERSION, UNWRITTEN_EXTENT_VERSION - 1);
+}
+
 PLUGIN_BY_ID(item_plugin, REISER4_ITEM_PLUGIN_TYPE, item);
 PLUGIN_BY_ID(file_plugin, REISER4_FILE_PLUGIN_TYPE, file);
 PLUGIN_BY_ID(dir_plugin, REISER4_DIR_PLUGIN_TYPE, dir);
@@ -7,13 +7,19 @@
 #include "../../block_alloc.h"
 #include "../../tree.h"
 #include "../../super.h"
+#include "../../discard.h"
+#include "../../vfs_ops.h"
 #include "../plugin.h"
 #include "space_allocator.h"
 #include "bitmap.h"
+#include "extent_index.h"
 
 #include <linux/types.h>
 #include <linux/fs.h>		/* for struct super_block  */
 #include <linux/mutex.h>
+#include <linux/sort.h>
+#include <linux/blkdev.h>
+#include <linux/workqueue.h>
 #include <asm/div64.h>
 
 /* Proposed (but discarded) optimization: dynamic loading/unloading of bitmap
@@ -78,6 +84,15 @@ struct bitmap_node {
 
 	bmap_off_t first_zero_bit;	/* for skip_busy option implementation */
 
+	/* summary of working bitmap which allows to skip bitmaps without
+	   scanning them. Valid once bnode is loaded, updated under ->mutex */
+	bmap_off_t nr_free;	/* exact number of free blocks */
+	bmap_off_t longest_free;	/* upper bound of the longest free run */
+	int longest_stale;	/* longest free run may have been split since
+				 * ->longest_free was counted */
+
+	jnode *ra_cjnode;	/* COMMIT bitmap block read is started for */
+
 	atomic_t loaded;	/* a flag which shows that bnode is loaded
 				 * already */
 };
@@ -134,11 +149,49 @@ static inline void bnode_set_commit_crc(struct bitmap_node *bnode, __u32 crc)
 struct bitmap_allocator_data {
 	/* an array for bitmap blocks direct access */
 	struct bitmap_node *bitmap;
+	/* index of free extents, NULL unless "free_extent_index" mount option
+	   is specified */
+	struct free_extent_index *index;
+	/* background loaders of bitmap blocks started at mount */
+	struct bitmap_loader *loaders;
+	int nr_loaders;
+	/* number of loaders still running */
+	atomic_t nr_loading;
+	/* set on umount to stop loaders */
+	int stop_loading;
+	/* buffers COMMIT BITMAP changes are collected in at pre-commit, see
+	   reiser4_pre_commit_hook_bitmap() */
+	struct commit_bmap_range *commit_ranges;
+};
+
+/* Bitmap blocks are loaded at mount in background by up to
+   BITMAP_MAX_LOADERS works, each loading its own range of bitmap blocks.
+   Loaders start reads of BITMAP_LOAD_BATCH bitmap blocks ahead of the one
+   being loaded, so that the device has plenty of requests to serve, and
+   the file system is usable meanwhile. While loaders run, allocations prefer
+   already loaded bitmap blocks. When loading of a bitmap block is requested
+   by allocation, reads of BITMAP_PREFETCH next bitmap blocks are started
+   too. */
+struct bitmap_loader {
+	struct work_struct work;
+	struct super_block *super;
+	bmap_nr_t start;
+	bmap_nr_t end;
 };
 
+#define BITMAP_MAX_LOADERS (4)
+#define BITMAP_LOAD_BATCH (64)
+#define BITMAP_PREFETCH (8)
+
 #define get_barray(super) \
 (((struct bitmap_allocator_data *)(get_super_private(super)->space_allocator.u.generic)) -> bitmap)
 
+#define get_extent_index(super) \
+(((struct bitmap_allocator_data *)(get_super_private(super)->space_allocator.u.generic)) -> index)
+
+#define get_bitmap_data(super) \
+((struct bitmap_allocator_data *)(get_super_private(super)->space_allocator.u.generic))
+
 #define get_bnode(super, i) (get_barray(super) + i)
 
 /* allocate and initialize jnode with JNODE_BITMAP type */
@@ -159,16 +212,10 @@ static jnode *bnew(void)
 /* Audited by: green(2002.06.12) */
 static int find_next_zero_bit_in_word(ulong_t word, int start_bit)
 {
-	ulong_t mask = 1UL << start_bit;
-	int i = start_bit;
-
-	while ((word & mask) != 0) {
-		mask <<= 1;
-		if (++i >= BITS_PER_LONG)
-			break;
-	}
-
-	return i;
+	word = ~word & (~0UL << start_bit);
+	if (word == 0)
+		return BITS_PER_LONG;
+	return __ffs(word);
 }
 
 #include <linux/bitops.h>
@@ -270,21 +317,14 @@ static bmap_off_t reiser4_find_next_set_bit(void *addr, bmap_off_t max_offset,
 /* search for the first set bit in single word. */
 static int find_last_set_bit_in_word(ulong_t word, int start_bit)
 {
-	ulong_t bit_mask;
-	int nr = start_bit;
-
 	assert("zam-965", start_bit < BITS_PER_LONG);
 	assert("zam-966", start_bit >= 0);
 
-	bit_mask = (1UL << nr);
-
-	while (bit_mask != 0) {
-		if (bit_mask & word)
-			return nr;
-		bit_mask >>= 1;
-		nr--;
-	}
-	return BITS_PER_LONG;
+	if (start_bit < BITS_PER_LONG - 1)
+		word &= (1UL << (start_bit + 1)) - 1;
+	if (word == 0)
+		return BITS_PER_LONG;
+	return __fls(word);
 }
 
 /* Search bitmap for a set bit in backward direction from the end to the
@@ -528,28 +568,6 @@ static int bnode_check_crc(const struct bitmap_node *bnode)
 /* REISER4_CHECK_BMAP_CRC */
 #endif
 
-/* Recalculates the adler32 checksum for only 1 byte change.
-    adler - previous adler checksum
-    old_data, data - old, new byte values.
-    tail == (chunk - offset) : length, checksum was calculated for, - offset of
-    the changed byte within this chunk.
-    This function can be used for checksum calculation optimisation.
-*/
-
-static __u32
-adler32_recalc(__u32 adler, unsigned char old_data, unsigned char data,
-	       __u32 tail)
-{
-	__u32 delta = data - old_data + 2 * ADLER_BASE;
-	__u32 s1 = adler & 0xffff;
-	__u32 s2 = (adler >> 16) & 0xffff;
-
-	s1 = (delta + s1) % ADLER_BASE;
-	s2 = (delta * tail + s2) % ADLER_BASE;
-
-	return (s2 << 16) | s1;
-}
-
 #define LIMIT(val, boundary) ((val) > (boundary) ? (boundary) : (val))
 
 /**
@@ -712,6 +730,13 @@ static void release(jnode * node)
 	jput(node);
 }
 
+/* drop jnode read ahead of loading, it was never jload()-ed */
+static void drop_ra_jnode(jnode *node)
+{
+	JF_SET(node, JNODE_HEARD_BANSHEE);
+	jput(node);
+}
+
 /* This function is for internal bitmap.c use because it assumes that jnode is
    in under full control of this thread */
 static void done_bnode(struct bitmap_node *bnode)
@@ -723,9 +748,52 @@ static void done_bnode(struct bitmap_node *bnode)
 		if (bnode->cjnode != NULL)
 			release(bnode->cjnode);
 		bnode->wjnode = bnode->cjnode = NULL;
+		if (bnode->ra_cjnode != NULL) {
+			drop_ra_jnode(bnode->ra_cjnode);
+			bnode->ra_cjnode = NULL;
+		}
 	}
 }
 
+/* start read of COMMIT bitmap block @bmap unless it is loaded already. Page
+   of a bitmap block can be attached to one jnode only, so this is done under
+   bnode mutex. Bnode which is busy is skipped: it is being loaded or used */
+static void prefetch_bnode(struct super_block *super, bmap_nr_t bmap)
+{
+	struct bitmap_node *bnode;
+	jnode *cjnode;
+
+	if (bmap >= get_nr_bmap(super))
+		return;
+	bnode = get_bnode(super, bmap);
+	if (atomic_read(&bnode->loaded) || !mutex_trylock(&bnode->mutex))
+		return;
+
+	if (!atomic_read(&bnode->loaded) && bnode->ra_cjnode == NULL) {
+		cjnode = bnew();
+		if (cjnode != NULL) {
+			get_bitmap_blocknr(super, bmap, &cjnode->blocknr);
+			jref(cjnode);
+			/* errors are not fatal: read is retried on load */
+			jstartio(cjnode);
+			bnode->ra_cjnode = cjnode;
+		}
+	}
+	mutex_unlock(&bnode->mutex);
+}
+
+/* start reads of @count bitmap blocks starting from @bmap */
+static void prefetch_bnodes(struct super_block *super, bmap_nr_t bmap,
+			    bmap_nr_t count)
+{
+	struct blk_plug plug;
+
+	blk_start_plug(&plug);
+	for (; count != 0; bmap++, count--)
+		prefetch_bnode(super, bmap);
+	blk_finish_plug(&plug);
+}
+
 /* ZAM-FIXME-HANS: comment this.  Called only by load_and_lock_bnode()*/
 static int prepare_bnode(struct bitmap_node *bnode, jnode **cjnode_ret,
 			 jnode **wjnode_ret)
@@ -744,16 +812,21 @@ static int prepare_bnode(struct bitmap_node *bnode, jnode **cjnode_ret,
 		return RETERR(-ENOMEM);
 	}
 
-	*cjnode_ret = cjnode = bnew();
-	if (cjnode == NULL)
-		return RETERR(-ENOMEM);
-
 	bmap = bnode - get_bnode(super, 0);
 
+	/* take commit bitmap jnode read is started for, if any */
+	*cjnode_ret = cjnode = bnode->ra_cjnode;
+	bnode->ra_cjnode = NULL;
+	if (cjnode == NULL) {
+		*cjnode_ret = cjnode = bnew();
+		if (cjnode == NULL)
+			return RETERR(-ENOMEM);
+		get_bitmap_blocknr(super, bmap, &cjnode->blocknr);
+		jref(cjnode);
+	}
+
 	get_working_bitmap_blocknr(bmap, &wjnode->blocknr);
-	get_bitmap_blocknr(super, bmap, &cjnode->blocknr);
 
-	jref(cjnode);
 	jref(wjnode);
 
 	/* load commit bitmap */
@@ -808,10 +881,177 @@ static int check_struct_bnode(struct bitmap_node *bnode, __u32 blksize)
 	return 0;
 }
 
+/* number of bits of bitmap block @bmap which address existing blocks */
+static bmap_off_t bnode_limit(struct super_block *super, bmap_nr_t bmap)
+{
+	const bmap_off_t max_offset = bmap_bit_count(super->s_blocksize);
+	reiser4_block_nr base = bmap * max_offset;
+
+	return LIMIT(reiser4_block_count(super) - base,
+		     (reiser4_block_nr)max_offset);
+}
+
+/* extend region [@start, @end) over adjacent free blocks */
+static void extend_free_run(char *data, bmap_off_t limit, bmap_off_t *start,
+			    bmap_off_t *end)
+{
+	bmap_off_t last;
+
+	if (*start > 0 && !reiser4_test_bit(*start - 1, data)) {
+		if (reiser4_find_last_set_bit(&last, data, 0, *start - 1))
+			*start = 0;
+		else
+			*start = last + 1;
+	}
+	if (*end < limit)
+		*end = LIMIT(reiser4_find_next_set_bit(data, limit, *end),
+			     limit);
+}
+
+/* bring index of free extents in sync with working bitmap after bits [@start,
+   @end) of bitmap block @bmap were changed. Bitmap block must be locked */
+static void update_extent_index(struct super_block *super, bmap_nr_t bmap,
+				bmap_off_t start, bmap_off_t end)
+{
+	struct free_extent_index *xi = get_extent_index(super);
+	char *data;
+	reiser4_block_nr base;
+	reiser4_block_nr lo;
+	reiser4_block_nr hi;
+	bmap_off_t limit;
+	bmap_off_t last;
+
+	if (xi == NULL)
+		return;
+
+	data = bnode_working_data(get_bnode(super, bmap));
+	base = bmap * bmap_bit_count(super->s_blocksize);
+	limit = bnode_limit(super, bmap);
+
+	/* forget all indexed extents the change could affect */
+	lo = base + start;
+	hi = base + end;
+	reiser4_extent_index_cut(xi, base, base + limit, &lo, &hi);
+	start = lo - base;
+	end = hi - base;
+
+	/* freed blocks may join free runs which were too short to be
+	   indexed */
+	extend_free_run(data, limit, &start, &end);
+
+	/* and index free runs of the affected region again */
+	while (start < end) {
+		start = reiser4_find_next_zero_bit(data, end, start);
+		if (start >= end)
+			break;
+		last = LIMIT(reiser4_find_next_set_bit(data, end, start), end);
+		reiser4_extent_index_add(xi, base + start, last - start);
+		start = last;
+	}
+}
+
+/* true if bitmap block is loaded and its summary can be looked at without
+   the bnode mutex. Pairs with smp_wmb() in load_and_lock_bnode() */
+static inline int bnode_summary_valid(struct bitmap_node *bnode)
+{
+	if (!atomic_read(&bnode->loaded))
+		return 0;
+	smp_rmb();
+	return 1;
+}
+
+/* calculate summary of working bitmap. Searches may look at it without the
+   bnode mutex, so it is counted aside and then stored */
+static void init_bnode_summary(struct super_block *super, bmap_nr_t bmap)
+{
+	struct bitmap_node *bnode = get_bnode(super, bmap);
+	char *data = bnode_working_data(bnode);
+	bmap_off_t limit = bnode_limit(super, bmap);
+	bmap_off_t nr_free = 0;
+	bmap_off_t longest = 0;
+	bmap_off_t start;
+	bmap_off_t end;
+
+	start = reiser4_find_next_zero_bit(data, limit, 0);
+	while (start < limit) {
+		end = LIMIT(reiser4_find_next_set_bit(data, limit, start),
+			    limit);
+		nr_free += end - start;
+		if (end - start > longest)
+			longest = end - start;
+		if (end >= limit)
+			break;
+		start = reiser4_find_next_zero_bit(data, limit, end);
+	}
+	bnode->nr_free = nr_free;
+	WRITE_ONCE(bnode->longest_free, longest);
+	bnode->longest_stale = 0;
+}
+
+/* mark blocks [@start, @end) of bitmap block @bmap used in working bitmap.
+   Bitmap block must be locked */
+static void bnode_use_range(struct super_block *super, bmap_nr_t bmap,
+			    bmap_off_t start, bmap_off_t end)
+{
+	struct bitmap_node *bnode = get_bnode(super, bmap);
+	char *data = bnode_working_data(bnode);
+	bmap_off_t run_start = start;
+	bmap_off_t run_end = end;
+
+	if (!bnode->longest_stale) {
+		/* cutting the longest free run makes ->longest_free loose,
+		   it is counted again once a search fails on this bitmap */
+		extend_free_run(data, bnode_limit(super, bmap), &run_start,
+				&run_end);
+		if (run_end - run_start >= bnode->longest_free)
+			bnode->longest_stale = 1;
+	}
+	reiser4_set_bits(data, start, end);
+
+	assert("jalex-12", bnode->nr_free >= end - start);
+	bnode->nr_free -= end - start;
+	if (bnode->longest_free > bnode->nr_free)
+		bnode->longest_free = bnode->nr_free;
+
+	update_extent_index(super, bmap, start, end);
+}
+
+/* mark blocks [@start, @end) of bitmap block @bmap free in working bitmap.
+   Bitmap block must be locked */
+static void bnode_free_range(struct super_block *super, bmap_nr_t bmap,
+			     bmap_off_t start, bmap_off_t end)
+{
+	struct bitmap_node *bnode = get_bnode(super, bmap);
+	char *data = bnode_working_data(bnode);
+	bmap_off_t run_start = start;
+	bmap_off_t run_end = end;
+
+	reiser4_clear_bits(data, start, end);
+	adjust_first_zero_bit(bnode, start);
+
+	bnode->nr_free += end - start;
+	assert("jalex-13", bnode->nr_free <= bnode_limit(super, bmap));
+	extend_free_run(data, bnode_limit(super, bmap), &run_start, &run_end);
+	if (run_end - run_start > bnode->longest_free)
+		bnode->longest_free = run_end - run_start;
+
+	update_extent_index(super, bmap, start, end);
+}
+
+/* count the longest free run of locked bitmap block @bmap again if it could
+   have been split. Called after a search found no long enough run, so that
+   next searches skip the bitmap without locking and scanning it */
+static void bnode_tighten_longest(struct super_block *super, bmap_nr_t bmap)
+{
+	if (get_bnode(super, bmap)->longest_stale)
+		init_bnode_summary(super, bmap);
+}
+
 /* load bitmap blocks "on-demand" */
 static int load_and_lock_bnode(struct bitmap_node *bnode)
 {
 	int ret;
+	bmap_nr_t bmap;
 
 	jnode *cjnode;
 	jnode *wjnode;
@@ -829,13 +1069,22 @@ static int load_and_lock_bnode(struct bitmap_node *bnode)
 		return 0;
 	}
 
-	ret = prepare_bnode(bnode, &cjnode, &wjnode);
-	if (ret)
-		return ret;
+	/* read ahead of allocation cursor */
+	bmap = bnode - get_bnode(reiser4_get_current_sb(), 0);
+	prefetch_bnodes(reiser4_get_current_sb(), bmap + 1, BITMAP_PREFETCH);
 
 	mutex_lock(&bnode->mutex);
 
 	if (!atomic_read(&bnode->loaded)) {
+		/* bitmap blocks are loaded by background loaders concurrently
+		   with allocations, so jnodes are created under mutex: a page
+		   can not be attached to two jnodes */
+		ret = prepare_bnode(bnode, &cjnode, &wjnode);
+		if (ret) {
+			mutex_unlock(&bnode->mutex);
+			return ret;
+		}
+
 		assert("nikita-2822", cjnode != NULL);
 		assert("nikita-2823", wjnode != NULL);
 		assert("nikita-2824", jnode_is_loaded(cjnode));
@@ -848,16 +1097,22 @@ static int load_and_lock_bnode(struct bitmap_node *bnode)
 		if (unlikely(ret != 0))
 			goto error;
 
-		atomic_set(&bnode->loaded, 1);
 		/* working bitmap is initialized by on-disk
 		 * commit bitmap. This should be performed
 		 * under mutex. */
 		memcpy(bnode_working_data(bnode),
 		       bnode_commit_data(bnode),
 		       bmap_size(current_blocksize));
+		init_bnode_summary(reiser4_get_current_sb(), bmap);
+		update_extent_index(reiser4_get_current_sb(), bmap, 0,
+				    bnode_limit(reiser4_get_current_sb(), bmap));
+		/* searches look at the summary without the mutex once
+		   the bnode is marked loaded */
+		smp_wmb();
+		atomic_set(&bnode->loaded, 1);
 	} else
 		/* race: someone already loaded bitmap
-		 * while we were busy initializing data. */
+		 * while we were waiting for mutex. */
 		check_bnode_loaded(bnode);
 	return 0;
 
@@ -903,6 +1158,12 @@ search_one_bitmap_forward(bmap_nr_t bmap, bmap_off_t * offset,
 	assert("zam-365", max_len >= min_len);
 	assert("zam-366", *offset <= max_offset);
 
+	/* skip bitmaps which have no long enough free run without locking
+	   and scanning them */
+	if (bnode_summary_valid(bnode) &&
+	    READ_ONCE(bnode->longest_free) < min_len)
+		return 0;
+
 	ret = load_and_lock_bnode(bnode);
 
 	if (ret)
@@ -941,7 +1202,7 @@ search_one_bitmap_forward(bmap_nr_t bmap, bmap_off_t * offset,
 			ret = end - start;
 			*offset = start;
 
-			reiser4_set_bits(data, start, end);
+			bnode_use_range(super, bmap, start, end);
 
 			/* FIXME: we may advance first_zero_bit if [start,
 			   end] region overlaps the first_zero_bit point */
@@ -952,6 +1213,8 @@ search_one_bitmap_forward(bmap_nr_t bmap, bmap_off_t * offset,
 		start = end + 1;
 	}
 
+	if (ret == 0)
+		bnode_tighten_longest(super, bmap);
 	release_and_unlock_bnode(bnode);
 
 	return ret;
@@ -971,6 +1234,10 @@ search_one_bitmap_backward(bmap_nr_t bmap, bmap_off_t * start_offset,
 	assert("zam-959", max_len >= min_len);
 	assert("zam-960", *start_offset >= end_offset);
 
+	if (bnode_summary_valid(bnode) &&
+	    READ_ONCE(bnode->longest_free) < min_len)
+		return 0;
+
 	ret = load_and_lock_bnode(bnode);
 	if (ret)
 		return ret;
@@ -1009,7 +1276,7 @@ search_one_bitmap_backward(bmap_nr_t bmap, bmap_off_t * start_offset,
 			assert("zam-987",
 			       reiser4_find_next_set_bit(data, start + 1,
 							 end) >= start + 1);
-			reiser4_set_bits(data, end, start + 1);
+			bnode_use_range(super, bmap, end, start + 1);
 			break;
 		}
 
@@ -1019,6 +1286,8 @@ search_one_bitmap_backward(bmap_nr_t bmap, bmap_off_t * start_offset,
 		start = end - 1;
 	}
 
+	if (ret == 0)
+		bnode_tighten_longest(super, bmap);
 	release_and_unlock_bnode(bnode);
 	return ret;
 }
@@ -1026,7 +1295,7 @@ search_one_bitmap_backward(bmap_nr_t bmap, bmap_off_t * start_offset,
 /* allocate contiguous range of blocks in bitmap */
 static int bitmap_alloc_forward(reiser4_block_nr * start,
 				const reiser4_block_nr * end, int min_len,
-				int max_len)
+				int max_len, int loaded_only)
 {
 	bmap_nr_t bmap, end_bmap;
 	bmap_off_t offset, end_offset;
@@ -1047,6 +1316,10 @@ static int bitmap_alloc_forward(reiser4_block_nr * start,
 	assert("zam-359", ergo(end_bmap == bmap, end_offset >= offset));
 
 	for (; bmap < end_bmap; bmap++, offset = 0) {
+		/* do not wait for bitmap blocks loaders have not got to yet */
+		if (loaded_only &&
+		    !atomic_read(&get_bnode(super, bmap)->loaded))
+			continue;
 		len =
 		    search_one_bitmap_forward(bmap, &offset, max_offset,
 					      min_len, max_len);
@@ -1054,6 +1327,8 @@ static int bitmap_alloc_forward(reiser4_block_nr * start,
 			goto out;
 	}
 
+	if (loaded_only && !atomic_read(&get_bnode(super, bmap)->loaded))
+		return 0;
 	len =
 	    search_one_bitmap_forward(bmap, &offset, end_offset, min_len,
 				      max_len);
@@ -1096,12 +1371,88 @@ static int bitmap_alloc_backward(reiser4_block_nr * start,
 	return len;
 }
 
+#define EXTENT_INDEX_RETRIES (3)
+
+/* allocate @len blocks starting from @blk if they are still free. Returns
+   number of allocated blocks, i.e. either @len or 0 */
+static int claim_extent(reiser4_block_nr blk, reiser4_block_nr len)
+{
+	struct super_block *super = get_current_context()->super;
+	struct bitmap_node *bnode;
+	bmap_nr_t bmap;
+	bmap_off_t offset;
+	char *data;
+	int ret;
+
+	parse_blocknr(&blk, &bmap, &offset);
+	assert("jalex-11", offset + len <= bnode_limit(super, bmap));
+
+	bnode = get_bnode(super, bmap);
+	ret = load_and_lock_bnode(bnode);
+	if (ret)
+		return ret;
+
+	data = bnode_working_data(bnode);
+	ret = 0;
+	/* index is looked up without bitmap lock, so someone could grab the
+	   extent meanwhile */
+	if (reiser4_find_next_set_bit(data, offset + len, offset) >=
+	    offset + len) {
+		bnode_use_range(super, bmap, offset, offset + len);
+		ret = len;
+	}
+	release_and_unlock_bnode(bnode);
+	return ret;
+}
+
+/* try to allocate @needed contiguous blocks within [@search_start,
+   @search_end) using index of free extents. If @wrap is set, the whole disk
+   can be searched, and the longest free extent is allocated if there is no
+   long enough one. Returns number of allocated blocks, 0 if index did not
+   help */
+static int alloc_blocks_extent_index(reiser4_block_nr search_start,
+				     reiser4_block_nr search_end, int wrap,
+				     int needed, reiser4_block_nr *start)
+{
+	struct free_extent_index *xi;
+	reiser4_block_nr blk;
+	reiser4_block_nr len;
+	int tries;
+	int ret;
+
+	xi = get_extent_index(get_current_context()->super);
+	if (xi == NULL || needed < REISER4_EXTENT_INDEX_MIN_LEN)
+		return 0;
+
+	for (tries = 0; tries < EXTENT_INDEX_RETRIES; tries++) {
+		len = needed;
+		if (reiser4_extent_index_find(xi, search_start, search_end,
+					      needed, &blk)) {
+			if (!wrap)
+				return 0;
+			if (reiser4_extent_index_find(xi, 0, search_start,
+						      needed, &blk) &&
+			    reiser4_extent_index_largest(xi, &blk, &len))
+				return 0;
+			if (len > needed)
+				len = needed;
+		}
+		ret = claim_extent(blk, len);
+		if (ret > 0)
+			*start = blk;
+		if (ret != 0)
+			return ret;
+	}
+	return 0;
+}
+
 /* plugin->u.space_allocator.alloc_blocks() */
 static int alloc_blocks_forward(reiser4_blocknr_hint *hint, int needed,
 				reiser4_block_nr *start, reiser4_block_nr *len)
 {
 	struct super_block *super = get_current_context()->super;
 	int actual_len;
+	int loaded_only;
 
 	reiser4_block_nr search_start;
 	reiser4_block_nr search_end;
@@ -1121,8 +1472,21 @@ static int alloc_blocks_forward(reiser4_blocknr_hint *hint, int needed,
 	   of the disk or in given region if @hint -> max_dist is not zero */
 	search_start = hint->blk;
 
+	/* long extents are looked up in the index of free extents first */
+	actual_len = alloc_blocks_extent_index(search_start, search_end,
+					       hint->max_dist == 0, needed,
+					       &search_start);
+	if (actual_len != 0)
+		goto out;
+
+	/* while bitmap blocks are being loaded in background, unrestricted
+	   search looks at loaded ones first */
+	loaded_only = hint->max_dist == 0 &&
+		atomic_read(&get_bitmap_data(super)->nr_loading) != 0;
+ again:
 	actual_len =
-	    bitmap_alloc_forward(&search_start, &search_end, 1, needed);
+	    bitmap_alloc_forward(&search_start, &search_end, 1, needed,
+				 loaded_only);
 
 	/* There is only one bitmap search if max_dist was specified or first
 	   pass was from the beginning of the bitmap. We also do one pass for
@@ -1132,8 +1496,16 @@ static int alloc_blocks_forward(reiser4_blocknr_hint *hint, int needed,
 		search_end = search_start;
 		search_start = 0;
 		actual_len =
-		    bitmap_alloc_forward(&search_start, &search_end, 1, needed);
+		    bitmap_alloc_forward(&search_start, &search_end, 1, needed,
+					 loaded_only);
 	}
+	if (actual_len == 0 && loaded_only) {
+		loaded_only = 0;
+		search_start = hint->blk;
+		search_end = reiser4_block_count(super);
+		goto again;
+	}
+ out:
 	if (actual_len == 0)
 		return RETERR(-ENOSPC);
 	if (actual_len < 0)
@@ -1198,28 +1570,140 @@ void reiser4_dealloc_blocks_bitmap(reiser4_space_allocator * allocator,
 	bmap_off_t offset;
 
 	struct bitmap_node *bnode;
+	reiser4_block_nr chunk;
 	int ret;
 
 	assert("zam-468", len != 0);
 	check_block_range(&start, &len);
 
-	parse_blocknr(&start, &bmap, &offset);
+	/* extents joined by discard queue may span several bitmap blocks */
+	while (len != 0) {
+		parse_blocknr(&start, &bmap, &offset);
 
-	assert("zam-469", offset + len <= bmap_bit_count(super->s_blocksize));
+		chunk = LIMIT(len, (reiser4_block_nr)
+			      (bmap_bit_count(super->s_blocksize) - offset));
 
-	bnode = get_bnode(super, bmap);
+		bnode = get_bnode(super, bmap);
 
-	assert("zam-470", bnode != NULL);
+		assert("zam-470", bnode != NULL);
 
-	ret = load_and_lock_bnode(bnode);
-	assert("zam-481", ret == 0);
+		ret = load_and_lock_bnode(bnode);
+		assert("zam-481", ret == 0);
 
-	reiser4_clear_bits(bnode_working_data(bnode), offset,
-			   (bmap_off_t) (offset + len));
+		bnode_free_range(super, bmap, offset,
+				 (bmap_off_t) (offset + chunk));
 
-	adjust_first_zero_bit(bnode, offset);
+		release_and_unlock_bnode(bnode);
 
-	release_and_unlock_bnode(bnode);
+		start += chunk;
+		len -= chunk;
+	}
+}
+
+/* discard free extents of at least @minlen blocks within [@start, @end) of
+   bitmap block @bmap. Number of discarded bytes is added to @trimmed */
+static int trim_one_bitmap(bmap_nr_t bmap, bmap_off_t start, bmap_off_t end,
+			   reiser4_block_nr minlen, __u64 *trimmed)
+{
+	reiser4_context *ctx = get_current_context();
+	struct super_block *super = ctx->super;
+	struct bitmap_node *bnode = get_bnode(super, bmap);
+	reiser4_block_nr base = bmap * bmap_bit_count(super->s_blocksize);
+	char *data;
+	bmap_off_t run_end;
+	int ret;
+
+	while (start < end) {
+		if (bnode_summary_valid(bnode) &&
+		    READ_ONCE(bnode->longest_free) < minlen)
+			break;
+
+		ret = load_and_lock_bnode(bnode);
+		if (ret)
+			return ret;
+
+		/* find the next long enough free run */
+		data = bnode_working_data(bnode);
+		run_end = start;
+		while (start < end) {
+			start = reiser4_find_next_zero_bit(data, end, start);
+			if (start >= end)
+				break;
+			run_end = LIMIT(reiser4_find_next_set_bit(data, end,
+								  start), end);
+			if (run_end - start >= minlen)
+				break;
+			start = run_end;
+		}
+		release_and_unlock_bnode(bnode);
+		if (start >= end)
+			break;
+
+		/* keep the run allocated while it is being discarded. Space is
+		   grabbed for it to keep block counters consistent, skip the
+		   run if there is not enough free space. Grabbing may commit
+		   atoms, which lock bitmap blocks, so it is done before the
+		   bitmap block is locked again */
+		ret = reiser4_grab_space(run_end - start, BA_FORCE);
+		if (ret) {
+			start = run_end;
+			continue;
+		}
+		ret = load_and_lock_bnode(bnode);
+		assert("jalex-51", ret == 0);
+		if (reiser4_find_next_set_bit(data, run_end, start) < run_end) {
+			/* the run was allocated meanwhile, look again */
+			release_and_unlock_bnode(bnode);
+			grabbed2free(ctx, get_super_private(super),
+				     run_end - start);
+			continue;
+		}
+		bnode_use_range(super, bmap, start, run_end);
+		release_and_unlock_bnode(bnode);
+
+		reiser4_discard_blocks(super, base + start, run_end - start,
+				       trimmed);
+
+		ret = load_and_lock_bnode(bnode);
+		assert("jalex-19", ret == 0);
+		bnode_free_range(super, bmap, start, run_end);
+		release_and_unlock_bnode(bnode);
+		grabbed2free(ctx, get_super_private(super), run_end - start);
+
+		start = run_end;
+
+		if (fatal_signal_pending(current))
+			return RETERR(-EINTR);
+		cond_resched();
+	}
+	return 0;
+}
+
+/* plugin->u.space_allocator.trim_blocks(). */
+int reiser4_trim_blocks_bitmap(reiser4_space_allocator *allocator,
+			       reiser4_block_nr start, reiser4_block_nr end,
+			       reiser4_block_nr minlen, __u64 *trimmed)
+{
+	struct super_block *super = reiser4_get_current_sb();
+	bmap_nr_t bmap, end_bmap;
+	bmap_off_t offset, end_offset;
+	reiser4_block_nr tmp;
+	int ret = 0;
+
+	assert("jalex-20", start < end);
+	assert("jalex-21", end <= reiser4_block_count(super));
+
+	parse_blocknr(&start, &bmap, &offset);
+	tmp = end - 1;
+	parse_blocknr(&tmp, &end_bmap, &end_offset);
+	++end_offset;
+
+	for (; bmap <= end_bmap && ret == 0; bmap++, offset = 0)
+		ret = trim_one_bitmap(bmap, offset,
+				      bmap == end_bmap ? end_offset :
+				      bnode_limit(super, bmap),
+				      minlen, trimmed);
+	return ret;
 }
 
 static int check_blocks_one_bitmap(bmap_nr_t bmap, bmap_off_t start_offset,
@@ -1316,151 +1800,337 @@ static void cond_add_to_overwrite_set(txn_atom * atom, jnode * node)
 	spin_unlock_atom(atom);
 }
 
-/* an actor which applies delete set to COMMIT bitmap pages and link modified
-   pages in a single-linked list */
-static int
-apply_dset_to_commit_bmap(txn_atom * atom, const reiser4_block_nr * start,
-			  const reiser4_block_nr * len, void *data)
+/* Changes of COMMIT BITMAP made at transaction pre-commit.
+
+   An atom may have relocated and deleted hundreds of thousands of blocks,
+   and the atom is frozen while pre-commit hook runs. So block numbers are
+   collected first, sorted, and applied to COMMIT BITMAP blocks one bitmap
+   block at a time: each bitmap block is locked once per batch, its bits are
+   changed by ranges, and its checksum is calculated once per batch. */
+struct commit_bmap_range {
+	reiser4_block_nr start;
+	reiser4_block_nr len;
+};
+
+/* number of ranges COMMIT BITMAP changes are collected in before they are
+   applied. Changes of larger atoms are applied in several passes */
+#define COMMIT_BMAP_BATCH (4096)
+
+/* a set of block ranges to apply to COMMIT BITMAP */
+struct commit_bmap_batch {
+	struct commit_bmap_range *ranges;
+	unsigned long nr;
+	unsigned long size;
+};
+
+/* COMMIT BITMAP changes of the atom being pre-committed */
+struct commit_bmap_changes {
+	txn_atom *atom;
+	struct commit_bmap_batch used;
+	struct commit_bmap_batch freed;
+	/* number of blocks freed by the atom */
+	long long blocks_freed;
+};
+
+static int commit_bmap_range_cmp(const void *a, const void *b)
 {
+	const struct commit_bmap_range *r1 = a;
+	const struct commit_bmap_range *r2 = b;
 
-	bmap_nr_t bmap;
-	bmap_off_t offset;
-	int ret;
+	if (r1->start < r2->start)
+		return -1;
+	return r1->start > r2->start;
+}
 
-	long long *blocks_freed_p = data;
+static void init_commit_bmap_batch(struct commit_bmap_batch *batch,
+				   struct commit_bmap_range *ranges,
+				   unsigned long size)
+{
+	batch->ranges = ranges;
+	batch->nr = 0;
+	batch->size = size;
+}
 
-	struct bitmap_node *bnode;
+static void add_to_commit_bmap_batch(struct commit_bmap_batch *batch,
+				     reiser4_block_nr start,
+				     reiser4_block_nr len)
+{
+	struct commit_bmap_range *last;
 
-	struct super_block *sb = reiser4_get_current_sb();
+	assert("jalex-14", batch->nr < batch->size);
 
-	check_block_range(start, len);
+	/* merge with the previous range if possible. Ranges must not cross
+	   bitmap block boundaries */
+	if (batch->nr != 0) {
+		bmap_nr_t bmap;
+		bmap_off_t offset;
 
-	parse_blocknr(start, &bmap, &offset);
+		parse_blocknr(&start, &bmap, &offset);
+		last = batch->ranges + batch->nr - 1;
+		if (offset != 0 && last->start + last->len == start) {
+			last->len += len;
+			return;
+		}
+	}
+	batch->ranges[batch->nr].start = start;
+	batch->ranges[batch->nr].len = len;
+	batch->nr++;
+}
 
-	/* FIXME-ZAM: we assume that all block ranges are allocated by this
-	   bitmap-based allocator and each block range can't go over a zone of
-	   responsibility of one bitmap block; same assumption is used in
-	   other journal hooks in bitmap code. */
-	bnode = get_bnode(sb, bmap);
-	assert("zam-448", bnode != NULL);
+/* apply ranges of @batch starting from @*pos which belong to bitmap block
+   @bmap. Bitmap block must be locked */
+static void apply_batch_to_bnode(struct commit_bmap_batch *batch,
+				 unsigned long *pos, bmap_nr_t bmap,
+				 char *data, int set)
+{
+	while (*pos < batch->nr) {
+		struct commit_bmap_range *range = batch->ranges + *pos;
+		bmap_nr_t cur;
+		bmap_off_t offset;
+
+		check_block_range(&range->start, &range->len);
+		parse_blocknr(&range->start, &cur, &offset);
+		if (cur != bmap)
+			break;
+
+		/* FIXME-ZAM: we assume that all block ranges are allocated by
+		   this bitmap-based allocator and each block range can't go
+		   over a zone of responsibility of one bitmap block; same
+		   assumption is used in other journal hooks in bitmap code. */
+		assert("zam-443", offset + range->len <=
+		       bmap_bit_count(reiser4_get_current_sb()->s_blocksize));
+		if (set)
+			reiser4_set_bits(data, offset, offset + range->len);
+		else
+			/* FIXME-ZAM: a check that all bits are set should be
+			   there */
+			reiser4_clear_bits(data, offset, offset + range->len);
+		(*pos)++;
+	}
+}
+
+/* mark blocks of @used as used and blocks of @freed as free in COMMIT
+   BITMAP. Blocks freed by the atom are applied after blocks it allocated */
+static int apply_to_commit_bmap(txn_atom *atom, struct commit_bmap_batch *used,
+				struct commit_bmap_batch *freed)
+{
+	struct super_block *sb = reiser4_get_current_sb();
+	unsigned long upos = 0;
+	unsigned long fpos = 0;
+	int ret;
 
 	/* it is safe to unlock atom with is in ASTAGE_PRE_COMMIT */
 	assert("zam-767", atom->stage == ASTAGE_PRE_COMMIT);
-	ret = load_and_lock_bnode(bnode);
-	if (ret)
-		return ret;
 
-	/* put bnode into atom's overwrite set */
-	cond_add_to_overwrite_set(atom, bnode->cjnode);
+	sort(used->ranges, used->nr, sizeof(used->ranges[0]),
+	     commit_bmap_range_cmp, NULL);
+	sort(freed->ranges, freed->nr, sizeof(freed->ranges[0]),
+	     commit_bmap_range_cmp, NULL);
 
-	data = bnode_commit_data(bnode);
+	while (upos < used->nr || fpos < freed->nr) {
+		struct bitmap_node *bnode;
+		bmap_nr_t bmap;
+		bmap_nr_t fbmap;
+		bmap_off_t offset;
+
+		/* next bitmap block to update */
+		if (upos < used->nr) {
+			parse_blocknr(&used->ranges[upos].start, &bmap,
+				      &offset);
+			if (fpos < freed->nr) {
+				parse_blocknr(&freed->ranges[fpos].start,
+					      &fbmap, &offset);
+				if (fbmap < bmap)
+					bmap = fbmap;
+			}
+		} else
+			parse_blocknr(&freed->ranges[fpos].start, &bmap,
+				      &offset);
 
-	ret = bnode_check_crc(bnode);
-	if (ret != 0)
-		return ret;
+		bnode = get_bnode(sb, bmap);
+		assert("zam-448", bnode != NULL);
 
-	if (len != NULL) {
-		/* FIXME-ZAM: a check that all bits are set should be there */
-		assert("zam-443",
-		       offset + *len <= bmap_bit_count(sb->s_blocksize));
-		reiser4_clear_bits(data, offset, (bmap_off_t) (offset + *len));
+		ret = load_and_lock_bnode(bnode);
+		if (ret)
+			return ret;
 
-		(*blocks_freed_p) += *len;
-	} else {
-		reiser4_clear_bit(offset, data);
-		(*blocks_freed_p)++;
+		ret = bnode_check_crc(bnode);
+		if (ret != 0) {
+			release_and_unlock_bnode(bnode);
+			return ret;
+		}
+
+		apply_batch_to_bnode(used, &upos, bmap,
+				     bnode_commit_data(bnode), 1);
+		apply_batch_to_bnode(freed, &fpos, bmap,
+				     bnode_commit_data(bnode), 0);
+
+		bnode_set_commit_crc(bnode, bnode_calc_crc(bnode, sb->s_blocksize));
+
+		release_and_unlock_bnode(bnode);
+
+		/* put bnode into atom's overwrite set */
+		cond_add_to_overwrite_set(atom, bnode->cjnode);
+	}
+	return 0;
+}
+
+/* apply changes collected so far. All blocks allocated by the atom are
+   collected before blocks it freed, so the order of changes is kept */
+static int flush_commit_bmap_changes(struct commit_bmap_changes *ch)
+{
+	int ret;
+
+	ret = apply_to_commit_bmap(ch->atom, &ch->used, &ch->freed);
+	ch->used.nr = 0;
+	ch->freed.nr = 0;
+	return ret;
+}
+
+/* add range to @batch, applying collected changes first if it is full */
+static int add_commit_bmap_change(struct commit_bmap_changes *ch,
+				  struct commit_bmap_batch *batch,
+				  reiser4_block_nr start, reiser4_block_nr len)
+{
+	int ret;
+
+	if (batch->nr == batch->size) {
+		ret = flush_commit_bmap_changes(ch);
+		if (ret)
+			return ret;
 	}
+	add_to_commit_bmap_batch(batch, start, len);
+	return 0;
+}
 
-	bnode_set_commit_crc(bnode, bnode_calc_crc(bnode, sb->s_blocksize));
+/* scan atom's clean list and find all freshly allocated nodes, their bits in
+   COMMIT BITMAP are to be marked as used */
+static int collect_relocated(struct commit_bmap_changes *ch)
+{
+	txn_atom *atom = ch->atom;
+	struct list_head *head = ATOM_CLEAN_LIST(atom);
+	LIST_HEAD(scanned);
+	jnode *node;
+	int ret = 0;
+
+	/* the atom lock is dropped whenever collected changes are applied, and
+	   nodes may leave or join the clean list meanwhile. Scanned nodes are
+	   kept aside on a private list, so that the scan always continues from
+	   the head of the clean list and never follows a node which moved to
+	   another list. They are put back once the scan is over */
+	spin_lock_atom(atom);
+	while (!list_empty(head)) {
+		node = list_entry(head->next, jnode, capture_link);
+		/* we detect freshly allocated jnodes */
+		if (JF_ISSET(node, JNODE_RELOC)) {
+			assert("zam-559", !JF_ISSET(node, JNODE_OVRWR));
+			assert("zam-460",
+			       !reiser4_blocknr_is_fake(&node->blocknr));
+
+			if (ch->used.nr == ch->used.size) {
+				/* bitmap blocks can not be updated under atom
+				   lock */
+				spin_unlock_atom(atom);
+				ret = flush_commit_bmap_changes(ch);
+				spin_lock_atom(atom);
+				if (ret)
+					break;
+				continue;
+			}
+			add_to_commit_bmap_batch(&ch->used, node->blocknr, 1);
+		}
+		list_move_tail(&node->capture_link, &scanned);
+	}
+	list_splice(&scanned, head);
+	spin_unlock_atom(atom);
+	return ret;
+}
 
-	release_and_unlock_bnode(bnode);
+/* an actor which adds allocated set entries to the batch of used blocks */
+static int collect_aset(txn_atom *atom, const reiser4_block_nr *start,
+			const reiser4_block_nr *len, void *data)
+{
+	struct commit_bmap_changes *ch = data;
+	bmap_off_t max = bmap_bit_count(reiser4_get_current_sb()->s_blocksize);
+	reiser4_block_nr blk = *start;
+	reiser4_block_nr left = *len;
+	int ret;
 
+	while (left != 0) {
+		bmap_nr_t bmap;
+		bmap_off_t offset;
+		reiser4_block_nr count;
+
+		parse_blocknr(&blk, &bmap, &offset);
+		count = min_t(reiser4_block_nr, left, max - offset);
+		ret = add_commit_bmap_change(ch, &ch->used, blk, count);
+		if (ret)
+			return ret;
+		blk += count;
+		left -= count;
+	}
 	return 0;
 }
 
+/* an actor which adds delete set entries to the batch of freed blocks */
+static int collect_dset(txn_atom *atom, const reiser4_block_nr *start,
+			const reiser4_block_nr *len, void *data)
+{
+	struct commit_bmap_changes *ch = data;
+	reiser4_block_nr count = len ? *len : 1;
+
+	ch->blocks_freed += count;
+	return add_commit_bmap_change(ch, &ch->freed, *start, count);
+}
+
 /* plugin->u.space_allocator.pre_commit_hook(). */
 /* It just applies transaction changes to fs-wide COMMIT BITMAP, hoping the
    rest is done by transaction manager (allocate wandered locations for COMMIT
    BITMAP blocks, copy COMMIT BITMAP blocks data). */
 /* Only one instance of this function can be running at one given time, because
    only one transaction can be committed a time, therefore it is safe to access
-   some global variables without any locking */
+   some global variables without any locking. That includes buffers changes
+   are collected in: they are allocated at mount, so that pre-commit does not
+   fail on memory allocation. Errors of reading bitmap blocks are returned to
+   the committer */
 
 int reiser4_pre_commit_hook_bitmap(void)
 {
 	struct super_block *super = reiser4_get_current_sb();
+	struct bitmap_allocator_data *data = get_bitmap_data(super);
+	struct commit_bmap_changes ch;
 	txn_atom *atom;
+	int ret;
 
-	long long blocks_freed = 0;
+	long long blocks_freed;
 
 	atom = get_current_atom_locked();
 	assert("zam-876", atom->stage == ASTAGE_PRE_COMMIT);
 	spin_unlock_atom(atom);
 
-	{			/* scan atom's captured list and find all freshly allocated nodes,
-				 * mark corresponded bits in COMMIT BITMAP as used */
-		struct list_head *head = ATOM_CLEAN_LIST(atom);
-		jnode *node = list_entry(head->next, jnode, capture_link);
-
-		while (head != &node->capture_link) {
-			/* we detect freshly allocated jnodes */
-			if (JF_ISSET(node, JNODE_RELOC)) {
-				int ret;
-				bmap_nr_t bmap;
-
-				bmap_off_t offset;
-				bmap_off_t index;
-				struct bitmap_node *bn;
-				__u32 size = bmap_size(super->s_blocksize);
-				__u32 crc;
-				char byte;
-
-				assert("zam-559", !JF_ISSET(node, JNODE_OVRWR));
-				assert("zam-460",
-				       !reiser4_blocknr_is_fake(&node->blocknr));
-
-				parse_blocknr(&node->blocknr, &bmap, &offset);
-				bn = get_bnode(super, bmap);
-
-				index = offset >> 3;
-				assert("vpf-276", index < size);
-
-				ret = bnode_check_crc(bnode);
-				if (ret != 0)
-					return ret;
-
-				check_bnode_loaded(bn);
-				load_and_lock_bnode(bn);
-
-				byte = *(bnode_commit_data(bn) + index);
-				reiser4_set_bit(offset, bnode_commit_data(bn));
-
-				crc = adler32_recalc(bnode_commit_crc(bn), byte,
-						     *(bnode_commit_data(bn) +
-						       index),
-						     size - index),
-				    bnode_set_commit_crc(bn, crc);
-
-				release_and_unlock_bnode(bn);
-
-				ret = bnode_check_crc(bn);
-				if (ret != 0)
-					return ret;
-
-				/* working of this depends on how it inserts
-				   new j-node into clean list, because we are
-				   scanning the same list now. It is OK, if
-				   insertion is done to the list front */
-				cond_add_to_overwrite_set(atom, bn->cjnode);
-			}
-
-			node = list_entry(node->capture_link.next, jnode, capture_link);
-		}
+	ch.atom = atom;
+	init_commit_bmap_batch(&ch.used, data->commit_ranges,
+			       COMMIT_BMAP_BATCH);
+	init_commit_bmap_batch(&ch.freed,
+			       data->commit_ranges + COMMIT_BMAP_BATCH,
+			       COMMIT_BMAP_BATCH);
+	ch.blocks_freed = 0;
+
+	ret = collect_relocated(&ch);
+	/* blocks allocated without jnodes */
+	if (ret == 0)
+		ret = blocknr_list_iterator(atom, &atom->alloc_set,
+					    collect_aset, &ch, 0);
+	if (ret == 0)
+		ret = atom_dset_deferred_apply(atom, collect_dset, &ch, 0);
+	if (ret == 0)
+		ret = flush_commit_bmap_changes(&ch);
+	if (ret) {
+		warning("jalex-46", "failed to update commit bitmap: %d", ret);
+		return ret;
 	}
 
-	atom_dset_deferred_apply(atom, apply_dset_to_commit_bmap, &blocks_freed, 0);
-
-	blocks_freed -= atom->nr_blocks_allocated;
+	blocks_freed = ch.blocks_freed - atom->nr_blocks_allocated;
 
 	{
 		reiser4_super_info_data *sbinfo;
@@ -1475,6 +2145,102 @@ int reiser4_pre_commit_hook_bitmap(void)
 	return 0;
 }
 
+/* load bitmap blocks of loader's range, reading BITMAP_LOAD_BATCH bitmap
+   blocks ahead */
+static void bitmap_loader_work(struct work_struct *work)
+{
+	struct bitmap_loader *loader;
+	struct bitmap_allocator_data *data;
+	struct bitmap_node *bnode;
+	reiser4_context *ctx;
+	bmap_nr_t i;
+	int ret;
+
+	loader = container_of(work, struct bitmap_loader, work);
+	data = get_bitmap_data(loader->super);
+
+	ctx = reiser4_init_context(loader->super);
+	if (IS_ERR(ctx)) {
+		/* bitmap blocks will be loaded on demand */
+		atomic_dec(&data->nr_loading);
+		return;
+	}
+
+	for (i = loader->start; i < loader->end; i++) {
+		if (READ_ONCE(data->stop_loading))
+			break;
+		if ((i - loader->start) % BITMAP_LOAD_BATCH == 0)
+			prefetch_bnodes(loader->super, i,
+					min_t(bmap_nr_t, BITMAP_LOAD_BATCH,
+					      loader->end - i));
+		bnode = data->bitmap + i;
+		ret = load_and_lock_bnode(bnode);
+		if (ret == 0)
+			release_and_unlock_bnode(bnode);
+		else if (ret != -ENOMEM) {
+			/* bitmap block used to be checked at mount, which
+			   failed if it was corrupted or could not be read.
+			   Treat it as file system error now */
+			warning("jalex-47",
+				"failed to load bitmap block %llu: %d",
+				(unsigned long long)i, ret);
+			reiser4_handle_error();
+		}
+		/* otherwise the bitmap block will be loaded on demand */
+		cond_resched();
+	}
+	atomic_dec(&data->nr_loading);
+	reiser4_exit_context(ctx);
+}
+
+/* split bitmap blocks between loaders and start them */
+static int start_bitmap_loaders(struct bitmap_allocator_data *data,
+				struct super_block *super)
+{
+	bmap_nr_t bitmap_blocks_nr = get_nr_bmap(super);
+	bmap_nr_t per_loader;
+	bmap_nr_t start;
+	int i;
+
+	data->nr_loaders = min_t(int, num_online_cpus(), BITMAP_MAX_LOADERS);
+	if ((bmap_nr_t)data->nr_loaders > bitmap_blocks_nr)
+		data->nr_loaders = bitmap_blocks_nr;
+	data->loaders = kcalloc(data->nr_loaders, sizeof(struct bitmap_loader),
+				reiser4_ctx_gfp_mask_get());
+	if (data->loaders == NULL) {
+		data->nr_loaders = 0;
+		return RETERR(-ENOMEM);
+	}
+
+	per_loader = div_u64(bitmap_blocks_nr + data->nr_loaders - 1,
+			     data->nr_loaders);
+	atomic_set(&data->nr_loading, data->nr_loaders);
+	for (i = 0, start = 0; i < data->nr_loaders; i++) {
+		struct bitmap_loader *loader = data->loaders + i;
+
+		INIT_WORK(&loader->work, bitmap_loader_work);
+		loader->super = super;
+		loader->start = start;
+		loader->end = min(start + per_loader, bitmap_blocks_nr);
+		start = loader->end;
+		queue_work(system_unbound_wq, &loader->work);
+	}
+	return 0;
+}
+
+/* stop loaders and wait for them */
+static void stop_bitmap_loaders(struct bitmap_allocator_data *data)
+{
+	int i;
+
+	WRITE_ONCE(data->stop_loading, 1);
+	for (i = 0; i < data->nr_loaders; i++)
+		flush_work(&data->loaders[i].work);
+	kfree(data->loaders);
+	data->loaders = NULL;
+	data->nr_loaders = 0;
+}
+
 /* plugin->u.space_allocator.init_allocator
     constructor of reiser4_space_allocator object. It is called on fs mount */
 int reiser4_init_allocator_bitmap(reiser4_space_allocator * allocator,
@@ -1511,42 +2277,50 @@ int reiser4_init_allocator_bitmap(reiser4_space_allocator * allocator,
 		return RETERR(-ENOMEM);
 	}
 
+	data->commit_ranges =
+		reiser4_vmalloc(2 * COMMIT_BMAP_BATCH *
+				sizeof(struct commit_bmap_range));
+	if (data->commit_ranges == NULL) {
+		vfree(data->bitmap);
+		kfree(data);
+		return RETERR(-ENOMEM);
+	}
+
+	data->index = NULL;
+	if (test_bit(REISER4_FREE_EXTENT_INDEX,
+		     &get_super_private(super)->fs_flags)) {
+		data->index = kmalloc(sizeof(struct free_extent_index),
+				      reiser4_ctx_gfp_mask_get());
+		if (data->index == NULL) {
+			vfree(data->commit_ranges);
+			vfree(data->bitmap);
+			kfree(data);
+			return RETERR(-ENOMEM);
+		}
+		reiser4_init_extent_index(data->index);
+	}
+
 	for (i = 0; i < bitmap_blocks_nr; i++)
 		init_bnode(data->bitmap + i, super, i);
 
+	data->loaders = NULL;
+	data->nr_loaders = 0;
+	atomic_set(&data->nr_loading, 0);
+	data->stop_loading = 0;
+
 	allocator->u.generic = data;
 
 #if REISER4_DEBUG
 	get_super_private(super)->min_blocks_used += bitmap_blocks_nr;
 #endif
 
-	/* Load all bitmap blocks at mount time. */
+	/* Load all bitmap blocks in background. Mount does not wait for that:
+	   bitmap blocks needed before they are loaded are loaded on demand. If
+	   loaders can not be started, all bitmap blocks are loaded on
+	   demand. */
 	if (!test_bit
-	    (REISER4_DONT_LOAD_BITMAP, &get_super_private(super)->fs_flags)) {
-		__u64 start_time, elapsed_time;
-		struct bitmap_node *bnode;
-		int ret;
-
-		if (REISER4_DEBUG)
-			printk(KERN_INFO "loading reiser4 bitmap...");
-		start_time = jiffies;
-
-		for (i = 0; i < bitmap_blocks_nr; i++) {
-			bnode = data->bitmap + i;
-			ret = load_and_lock_bnode(bnode);
-			if (ret) {
-				reiser4_destroy_allocator_bitmap(allocator,
-								 super);
-				return ret;
-			}
-			release_and_unlock_bnode(bnode);
-		}
-
-		elapsed_time = jiffies - start_time;
-		if (REISER4_DEBUG)
-			printk("...done (%llu jiffies)\n",
-			       (unsigned long long)elapsed_time);
-	}
+	    (REISER4_DONT_LOAD_BITMAP, &get_super_private(super)->fs_flags))
+		start_bitmap_loaders(data, super);
 
 	return 0;
 }
@@ -1564,6 +2338,9 @@ int reiser4_destroy_allocator_bitmap(reiser4_space_allocator * allocator,
 	assert("zam-414", data != NULL);
 	assert("zam-376", data->bitmap != NULL);
 
+	stop_bitmap_loaders(data);
+	assert("jalex-22", atomic_read(&data->nr_loading) == 0);
+
 	bitmap_blocks_nr = get_nr_bmap(super);
 
 	for (i = 0; i < bitmap_blocks_nr; i++) {
@@ -1589,6 +2366,11 @@ int reiser4_destroy_allocator_bitmap(reiser4_space_allocator * allocator,
 		mutex_unlock(&bnode->mutex);
 	}
 
+	if (data->index != NULL) {
+		reiser4_done_extent_index(data->index);
+		kfree(data->index);
+	}
+	vfree(data->commit_ranges);
 	vfree(data->bitmap);
 	kfree(data);
 
@@ -25,6 +25,11 @@ extern void reiser4_dealloc_blocks_bitmap(reiser4_space_allocator *,
 					  reiser4_block_nr,
 					  reiser4_block_nr);
 extern int reiser4_pre_commit_hook_bitmap(void);
+extern int reiser4_trim_blocks_bitmap(reiser4_space_allocator *,
+				      reiser4_block_nr start,
+				      reiser4_block_nr end,
+				      reiser4_block_nr minlen,
+				      __u64 *trimmed);
 
 #define reiser4_post_commit_hook_bitmap() do{}while(0)
 #define reiser4_post_write_back_hook_bitmap() do{}while(0)
@@ -0,0 +1,274 @@
+/* Copyright 2002, 2003 by Hans Reiser, licensing governed by reiser4/README */
+
+/* Index of free extents for the bitmap space allocator.
+
+   Bitmap allocator finds free space by scanning bitmap blocks starting from
+   the hint. On a nearly full volume a request for a long extent has to skip
+   lots of short free runs, and ends up either scanning many bitmap blocks or
+   allocating many short extents.
+
+   The index keeps free extents which are not shorter than
+   REISER4_EXTENT_INDEX_MIN_LEN blocks in an rb-tree sorted by start block and
+   augmented by the longest extent length in each subtree. That allows to find
+   the first extent of the requested length after the hint, as well as the
+   longest free extent of the volume, in logarithmic time.
+
+   Extents are maximal free runs of a working bitmap block: they never cross
+   bitmap block boundaries. Bitmap code keeps the index in sync with working
+   bitmaps while holding bitmap block mutex, but lookups are done without it,
+   so allocator has to verify the extent it got from the index against the
+   bitmap. The index is only a hint: if memory for an extent can not be
+   allocated, the extent is not indexed and can be found by bitmap scan
+   only. */
+
+#include "../../debug.h"
+#include "extent_index.h"
+
+#include <linux/slab.h>
+#include <linux/rbtree_augmented.h>
+
+struct free_extent {
+	struct rb_node node;
+	reiser4_block_nr start;
+	reiser4_block_nr len;
+	/* the longest extent in the subtree rooted at this extent */
+	reiser4_block_nr subtree_max;
+};
+
+#define fext_entry(n) rb_entry((n), struct free_extent, node)
+
+static inline reiser4_block_nr fext_end(const struct free_extent *fext)
+{
+	return fext->start + fext->len;
+}
+
+static inline reiser4_block_nr subtree_max(struct rb_node *n)
+{
+	return n ? fext_entry(n)->subtree_max : 0;
+}
+
+static inline reiser4_block_nr compute_subtree_max(struct free_extent *fext)
+{
+	reiser4_block_nr max = fext->len;
+
+	if (subtree_max(fext->node.rb_left) > max)
+		max = subtree_max(fext->node.rb_left);
+	if (subtree_max(fext->node.rb_right) > max)
+		max = subtree_max(fext->node.rb_right);
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, fext_callbacks, struct free_extent, node,
+		     reiser4_block_nr, subtree_max, compute_subtree_max)
+
+void reiser4_init_extent_index(struct free_extent_index *xi)
+{
+	spin_lock_init(&xi->guard);
+	xi->root = RB_ROOT;
+	xi->nr_extents = 0;
+}
+
+void reiser4_done_extent_index(struct free_extent_index *xi)
+{
+	struct free_extent *fext;
+	struct free_extent *next;
+
+	rbtree_postorder_for_each_entry_safe(fext, next, &xi->root, node)
+		kfree(fext);
+	xi->root = RB_ROOT;
+	xi->nr_extents = 0;
+}
+
+/* find the last extent which starts not after @blk. Index must be locked */
+static struct free_extent *lookup_le(struct free_extent_index *xi,
+				     reiser4_block_nr blk)
+{
+	struct rb_node *n = xi->root.rb_node;
+	struct free_extent *result = NULL;
+
+	while (n != NULL) {
+		struct free_extent *fext = fext_entry(n);
+
+		if (fext->start <= blk) {
+			result = fext;
+			n = n->rb_right;
+		} else
+			n = n->rb_left;
+	}
+	return result;
+}
+
+/* add free extent [@start, @start + @len) to the index. Extent must not
+   overlap any indexed one */
+int reiser4_extent_index_add(struct free_extent_index *xi,
+			     reiser4_block_nr start, reiser4_block_nr len)
+{
+	struct free_extent *fext;
+	struct rb_node **link;
+	struct rb_node *parent = NULL;
+
+	if (len < REISER4_EXTENT_INDEX_MIN_LEN)
+		return 0;
+
+	fext = kmalloc(sizeof(*fext), GFP_NOFS);
+	if (fext == NULL)
+		return RETERR(-ENOMEM);
+	fext->start = start;
+	fext->len = len;
+	fext->subtree_max = len;
+
+	spin_lock(&xi->guard);
+	link = &xi->root.rb_node;
+	while (*link != NULL) {
+		struct free_extent *cur;
+
+		parent = *link;
+		cur = fext_entry(parent);
+		/* propagate new maximum down the path */
+		if (cur->subtree_max < len)
+			cur->subtree_max = len;
+		assert("jalex-10", start + len <= cur->start ||
+		       start >= fext_end(cur));
+		if (start < cur->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&fext->node, parent, link);
+	rb_insert_augmented(&fext->node, &xi->root, &fext_callbacks);
+	xi->nr_extents++;
+	spin_unlock(&xi->guard);
+	return 0;
+}
+
+/* remove all extents which lie within [@min, @max) and overlap or touch
+   [@lo, @hi). @lo and @hi are extended to cover removed extents */
+void reiser4_extent_index_cut(struct free_extent_index *xi,
+			      reiser4_block_nr min, reiser4_block_nr max,
+			      reiser4_block_nr *lo, reiser4_block_nr *hi)
+{
+	struct free_extent *fext;
+	struct rb_node *n;
+
+	spin_lock(&xi->guard);
+	fext = lookup_le(xi, *lo);
+	if (fext != NULL)
+		n = &fext->node;
+	else
+		n = rb_first(&xi->root);
+
+	while (n != NULL) {
+		struct rb_node *next = rb_next(n);
+
+		fext = fext_entry(n);
+		if (fext->start > *hi)
+			break;
+		if (fext_end(fext) >= *lo &&
+		    fext->start >= min && fext_end(fext) <= max) {
+			if (fext->start < *lo)
+				*lo = fext->start;
+			if (fext_end(fext) > *hi)
+				*hi = fext_end(fext);
+			rb_erase_augmented(n, &xi->root, &fext_callbacks);
+			xi->nr_extents--;
+			kfree(fext);
+		}
+		n = next;
+	}
+	spin_unlock(&xi->guard);
+}
+
+/* find the first extent which starts after @from and is not shorter than
+   @needed */
+static struct free_extent *first_fit(struct rb_node *n, reiser4_block_nr from,
+				     reiser4_block_nr needed)
+{
+	struct free_extent *fext;
+	struct free_extent *result;
+
+	if (subtree_max(n) < needed)
+		return NULL;
+	fext = fext_entry(n);
+	if (fext->start > from) {
+		result = first_fit(n->rb_left, from, needed);
+		if (result != NULL)
+			return result;
+		if (fext->len >= needed)
+			return fext;
+	}
+	return first_fit(n->rb_right, from, needed);
+}
+
+/**
+ * reiser4_extent_index_find - find free extent near the hint
+ * @xi: free extent index
+ * @from: search start (the hint)
+ * @to: search end
+ * @needed: length of extent to find
+ * @start: where to store start of found extent
+ *
+ * Looks for the first @needed free blocks within [@from, @to) which lie
+ * within one indexed extent. Returns 0 if such blocks are found, -ENOSPC
+ * otherwise.
+ */
+int reiser4_extent_index_find(struct free_extent_index *xi,
+			      reiser4_block_nr from, reiser4_block_nr to,
+			      reiser4_block_nr needed, reiser4_block_nr *start)
+{
+	struct free_extent *fext;
+	int ret = RETERR(-ENOSPC);
+
+	spin_lock(&xi->guard);
+	/* extent the hint points into */
+	fext = lookup_le(xi, from);
+	if (fext != NULL && fext_end(fext) >= from + needed &&
+	    from + needed <= to) {
+		*start = from;
+		ret = 0;
+	} else {
+		fext = first_fit(xi->root.rb_node, from, needed);
+		if (fext != NULL && fext->start + needed <= to) {
+			*start = fext->start;
+			ret = 0;
+		}
+	}
+	spin_unlock(&xi->guard);
+	return ret;
+}
+
+/* find the longest indexed extent. Returns -ENOSPC if index is empty */
+int reiser4_extent_index_largest(struct free_extent_index *xi,
+				 reiser4_block_nr *start, reiser4_block_nr *len)
+{
+	struct rb_node *n;
+	int ret = RETERR(-ENOSPC);
+
+	spin_lock(&xi->guard);
+	n = xi->root.rb_node;
+	while (n != NULL) {
+		struct free_extent *fext = fext_entry(n);
+
+		if (subtree_max(n->rb_left) == fext->subtree_max)
+			n = n->rb_left;
+		else if (fext->len == fext->subtree_max) {
+			*start = fext->start;
+			*len = fext->len;
+			ret = 0;
+			break;
+		} else
+			n = n->rb_right;
+	}
+	spin_unlock(&xi->guard);
+	return ret;
+}
+
+/*
+ * Local variables:
+ * c-indentation-style: "K&R"
+ * mode-name: "LC"
+ * c-basic-offset: 8
+ * tab-width: 8
+ * fill-column: 79
+ * scroll-step: 1
+ * End:
+ */
@@ -0,0 +1,59 @@
+/* Copyright 2002, 2003 by Hans Reiser, licensing governed by reiser4/README */
+
+#if !defined (__REISER4_PLUGIN_SPACE_EXTENT_INDEX_H__)
+#define __REISER4_PLUGIN_SPACE_EXTENT_INDEX_H__
+
+#include "../../dformat.h"
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/rbtree.h>
+
+/* In-memory index of free extents used by the bitmap allocator (see
+   extent_index.c). Working bitmaps remain the only source of truth: the index
+   may miss some free extents, and any extent found there is verified against
+   the bitmap before it is allocated. */
+
+/* shorter free extents are not indexed */
+#define REISER4_EXTENT_INDEX_MIN_LEN (16)
+
+struct free_extent_index {
+	spinlock_t guard;
+	/* free extents sorted by start, augmented by the longest extent
+	   length in a subtree */
+	struct rb_root root;
+	/* number of indexed extents */
+	__u64 nr_extents;
+};
+
+extern void reiser4_init_extent_index(struct free_extent_index *);
+extern void reiser4_done_extent_index(struct free_extent_index *);
+extern int reiser4_extent_index_add(struct free_extent_index *,
+				    reiser4_block_nr start,
+				    reiser4_block_nr len);
+extern void reiser4_extent_index_cut(struct free_extent_index *,
+				     reiser4_block_nr min,
+				     reiser4_block_nr max,
+				     reiser4_block_nr *lo,
+				     reiser4_block_nr *hi);
+extern int reiser4_extent_index_find(struct free_extent_index *,
+				     reiser4_block_nr from,
+				     reiser4_block_nr to,
+				     reiser4_block_nr needed,
+				     reiser4_block_nr *start);
+extern int reiser4_extent_index_largest(struct free_extent_index *,
+					reiser4_block_nr *start,
+					reiser4_block_nr *len);
+
+#endif				/* __REISER4_PLUGIN_SPACE_EXTENT_INDEX_H__ */
+
+/* Make Linus happy.
+   Local variables:
+   c-indentation-style: "K&R"
+   mode-name: "LC"
+   c-basic-offset: 8
+   tab-width: 8
+   fill-column: 120
+   scroll-step: 1
+   End:
+*/
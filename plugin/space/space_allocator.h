@@ -34,9 +34,15 @@ static inline int sa_check_blocks (const reiser4_block_nr * start, const reiser4
 	return reiser4_check_blocks_##allocator (start, end, desired);							        \
 }															\
 															\
-static inline void sa_pre_commit_hook (void)										\
+static inline int sa_trim_blocks (reiser4_space_allocator *al, reiser4_block_nr start, reiser4_block_nr end,	\
+				  reiser4_block_nr minlen, __u64 *trimmed)					\
+{															\
+	return reiser4_trim_blocks_##allocator (al, start, end, minlen, trimmed);					\
+}															\
+															\
+static inline int sa_pre_commit_hook (void)										\
 { 															\
-	reiser4_pre_commit_hook_##allocator ();										\
+	return reiser4_pre_commit_hook_##allocator ();									\
 }															\
 															\
 static inline void sa_post_commit_hook (void) 										\
@@ -7,6 +7,7 @@
 #include "../block_alloc.h"
 #include "../reiser4.h"
 #include "../flush.h"
+#include "../super.h"
 
 /*
  * This file contains implementation of different transaction models.
@@ -88,7 +89,10 @@ void allocate_blocks_unformatted(reiser4_blocknr_hint *preceder,
 				 reiser4_block_nr wanted_count,
 				 reiser4_block_nr *first_allocated,
 				 reiser4_block_nr *allocated,
-				 block_stage_t block_stage);
+				 block_stage_t block_stage,
+				 struct reiser4_alloc_window *win);
+struct reiser4_alloc_window *unformatted_alloc_window(oid_t oid,
+						      unsigned long index);
 void assign_real_blocknrs(flush_pos_t *flush_pos, oid_t oid,
 			  unsigned long index, reiser4_block_nr count,
 			  reiser4_block_nr first);
@@ -225,6 +229,7 @@ static int forward_relocate_unformatted(flush_pos_t *flush_pos,
 	reiser4_block_nr first_allocated;
 	__u64 allocated;
 	block_stage_t block_stage;
+	struct reiser4_alloc_window *win;
 
 	*exit = 0;
 	coord = &flush_pos->coord;
@@ -243,8 +248,13 @@ static int forward_relocate_unformatted(flush_pos_t *flush_pos,
 	/*
 	 * limit number of nodes to allocate
 	 */
-	if (flush_pos->nr_to_write < width)
-		width = flush_pos->nr_to_write;
+	if (reiser4_pos_left_to_write(flush_pos) <= 0) {
+		flush_pos->state = POS_INVALID;
+		*exit = 1;
+		return 0;
+	}
+	if (reiser4_pos_left_to_write(flush_pos) < width)
+		width = reiser4_pos_left_to_write(flush_pos);
 
 	if (state == ALLOCATED_EXTENT) {
 		/*
@@ -276,10 +286,13 @@ static int forward_relocate_unformatted(flush_pos_t *flush_pos,
 	/*
 	 * allocate new block numbers for protected nodes
 	 */
+	win = unformatted_alloc_window(oid, index);
 	allocate_blocks_unformatted(reiser4_pos_hint(flush_pos),
 				    protected,
 				    &first_allocated, &allocated,
-				    block_stage);
+				    block_stage, win);
+	if (win != NULL)
+		reiser4_put_alloc_window(win);
 
 	if (state == ALLOCATED_EXTENT)
 		/*
@@ -306,7 +319,7 @@ static int forward_relocate_unformatted(flush_pos_t *flush_pos,
 	 * break flush: we prepared for flushing as many blocks as we
 	 * were asked for
 	 */
-	if (flush_pos->nr_to_write == allocated)
+	if (reiser4_pos_left_to_write(flush_pos) <= 0)
 		flush_pos->state = POS_INVALID;
 	return 0;
 }
@@ -329,6 +342,7 @@ static squeeze_result squeeze_relocate_unformatted(znode *left,
 	__u64 protected;
 	reiser4_extent copy_extent;
 	block_stage_t block_stage;
+	struct reiser4_alloc_window *win;
 
 	assert("edward-1610", flush_pos->pos_in_unit == 0);
 	assert("edward-1611", coord_is_leftmost_unit(coord));
@@ -373,10 +387,13 @@ static squeeze_result squeeze_relocate_unformatted(znode *left,
 	/*
 	 * allocate new block numbers for protected nodes
 	 */
+	win = unformatted_alloc_window(oid, index);
 	allocate_blocks_unformatted(reiser4_pos_hint(flush_pos),
 				    protected,
 				    &first_allocated, &allocated,
-				    block_stage);
+				    block_stage, win);
+	if (win != NULL)
+		reiser4_put_alloc_window(win);
 	/*
 	 * prepare extent which will be copied to left
 	 */
@@ -477,7 +494,6 @@ static squeeze_result squeeze_overwrite_unformatted(znode *left,
 	reiser4_extent *ext;
 	__u64 index;
 	__u64 width;
-	reiser4_block_nr start;
 	extent_state state;
 	oid_t oid;
 	reiser4_extent copy_extent;
@@ -488,7 +504,6 @@ static squeeze_result squeeze_overwrite_unformatted(znode *left,
 
 	ext = extent_by_coord(coord);
 	index = extent_unit_index(coord);
-	start = extent_get_start(ext);
 	width = extent_get_width(ext);
 	state = state_of_extent(ext);
 	unit_key_by_coord(coord, key);
@@ -498,13 +513,13 @@ static squeeze_result squeeze_overwrite_unformatted(znode *left,
 	 * and make all first not flushprepped nodes
 	 * overwrite nodes
 	 */
-	reiser4_set_extent(&copy_extent, start, width);
+	copy_extent = *ext;
 
 	result = put_unit_to_end(left, key, &copy_extent);
 	if (result == -E_NODE_FULL)
 		return SQUEEZE_TARGET_FULL;
 
-	if (state != HOLE_EXTENT)
+	if (state != HOLE_EXTENT && state != UNWRITTEN_EXTENT)
 		forward_overwrite_unformatted(flush_pos, oid, index, width);
 
 	set_key_offset(key,
@@ -512,6 +527,31 @@ static squeeze_result squeeze_overwrite_unformatted(znode *left,
 	return SQUEEZE_CONTINUE;
 }
 
+/*
+ * true if the slum part of extent unit at @coord, which starts @pos_in_unit
+ * blocks into the unit, is to be repacked: either flush started at a node
+ * marked for repacking, or the first node of that part is marked. All pages
+ * of a range are marked by REISER4_IOC_DEFRAG, so the first one tells
+ */
+static int unit_repack(flush_pos_t *pos, const coord_t *coord,
+		       __u64 pos_in_unit)
+{
+	reiser4_key key;
+	jnode *node;
+	int repack;
+
+	if (pos->repack)
+		return 1;
+	item_key_by_coord(coord, &key);
+	node = jlookup(current_tree, get_key_objectid(&key),
+		       extent_unit_index(coord) + pos_in_unit);
+	if (node == NULL)
+		return 0;
+	repack = JF_ISSET(node, JNODE_REPACK);
+	jput(node);
+	return repack;
+}
+
 /************************ HYBRID TRANSACTION MODEL ****************************/
 
 /**
@@ -547,7 +587,8 @@ static int reverse_try_defragment_if_close(const reiser4_block_nr * pblk,
 
 	/* If the block is less than FLUSH_RELOCATE_DISTANCE blocks away from
 	   its preceder block, do not relocate. */
-	if (dist <= get_current_super_private()->flush.relocate_distance)
+	if (dist <=
+	    reiser4_flush_relocate_distance(get_current_super_private()))
 		return 0;
 
 	return 1;
@@ -578,7 +619,7 @@ static int reverse_alloc_formatted_hybrid(jnode * node,
 	 */
 
 	/* New nodes are treated as if they are being relocated. */
-	if (JF_ISSET(node, JNODE_CREATED) ||
+	if (JF_ISSET(node, JNODE_CREATED) || JF_ISSET(node, JNODE_REPACK) ||
 	    (pos->leaf_relocate && jnode_get_level(node) == LEAF_LEVEL))
 		return 1;
 
@@ -809,8 +850,8 @@ static int forward_alloc_formatted_hybrid(znode * node,
 			/* See if we can find a closer block
 			   (forward direction only). */
 			pos->preceder.max_dist =
-			    min((reiser4_block_nr) sbinfo->flush.
-				relocate_distance, dist);
+			    min((reiser4_block_nr)
+				reiser4_flush_relocate_distance(sbinfo), dist);
 			pos->preceder.level = znode_get_level(node);
 
 			ret = forward_try_defragment_locality(node,
@@ -824,7 +865,8 @@ static int forward_alloc_formatted_hybrid(znode * node,
 			if (ret == 0) {
 				/* Got a better allocation. */
 				znode_make_reloc(node, pos->fq);
-			} else if (dist < sbinfo->flush.relocate_distance) {
+			} else if (dist <
+				   reiser4_flush_relocate_distance(sbinfo)) {
 				/* The present allocation is good enough. */
 				jnode_make_wander(ZJNODE(node));
 			} else {
@@ -876,7 +918,7 @@ static int forward_alloc_unformatted_hybrid(flush_pos_t *flush_pos)
 
 	ext = extent_by_coord(coord);
 	state = state_of_extent(ext);
-	if (state == HOLE_EXTENT) {
+	if (state == HOLE_EXTENT || state == UNWRITTEN_EXTENT) {
 		flush_pos->state = POS_INVALID;
 		return 0;
 	}
@@ -887,7 +929,8 @@ static int forward_alloc_unformatted_hybrid(flush_pos_t *flush_pos)
 
 	assert("vs-1457", width > flush_pos->pos_in_unit);
 
-	if (flush_pos->leaf_relocate || state == UNALLOCATED_EXTENT) {
+	if (state == UNALLOCATED_EXTENT || flush_pos->leaf_relocate ||
+	    unit_repack(flush_pos, coord, flush_pos->pos_in_unit)) {
 		int exit;
 		int result;
 		result = forward_relocate_unformatted(flush_pos, ext, state,
@@ -915,7 +958,8 @@ static squeeze_result squeeze_alloc_unformatted_hybrid(znode *left,
 	ext = extent_by_coord(coord);
 	state = state_of_extent(ext);
 
-	if ((flush_pos->leaf_relocate && state == ALLOCATED_EXTENT) ||
+	if ((state == ALLOCATED_EXTENT &&
+	     (flush_pos->leaf_relocate || unit_repack(flush_pos, coord, 0))) ||
 	    (state == UNALLOCATED_EXTENT))
 		/*
 		 * relocate
@@ -998,7 +1042,7 @@ static int forward_alloc_unformatted_journal(flush_pos_t *flush_pos)
 
 	ext = extent_by_coord(coord);
 	state = state_of_extent(ext);
-	if (state == HOLE_EXTENT) {
+	if (state == HOLE_EXTENT || state == UNWRITTEN_EXTENT) {
 		flush_pos->state = POS_INVALID;
 		return 0;
 	}
@@ -1009,7 +1053,8 @@ static int forward_alloc_unformatted_journal(flush_pos_t *flush_pos)
 
 	assert("edward-1619", width > flush_pos->pos_in_unit);
 
-	if (state == UNALLOCATED_EXTENT) {
+	if (state == UNALLOCATED_EXTENT ||
+	    unit_repack(flush_pos, coord, flush_pos->pos_in_unit)) {
 		int exit;
 		int result;
 		result = forward_relocate_unformatted(flush_pos, ext, state,
@@ -1021,7 +1066,7 @@ static int forward_alloc_unformatted_journal(flush_pos_t *flush_pos)
 	else
 		/*
 		 * state == ALLOCATED_EXTENT
-		 * keep old allocation
+		 * keep old allocation unless file is being defragmented
 		 */
 		forward_overwrite_unformatted(flush_pos, oid, index, width);
 
@@ -1042,7 +1087,8 @@ static squeeze_result squeeze_alloc_unformatted_journal(znode *left,
 	ext = extent_by_coord(coord);
 	state = state_of_extent(ext);
 
-	if (state == UNALLOCATED_EXTENT)
+	if (state == UNALLOCATED_EXTENT ||
+	    (state == ALLOCATED_EXTENT && unit_repack(flush_pos, coord, 0)))
 		ret = squeeze_relocate_unformatted(left, coord,
 						   flush_pos, &key, stop_key);
 	else
@@ -1129,7 +1175,7 @@ static int forward_alloc_unformatted_wa(flush_pos_t *flush_pos)
 
 	ext = extent_by_coord(coord);
 	state = state_of_extent(ext);
-	if (state == HOLE_EXTENT) {
+	if (state == HOLE_EXTENT || state == UNWRITTEN_EXTENT) {
 		flush_pos->state = POS_INVALID;
 		return 0;
 	}
@@ -1166,9 +1212,9 @@ static squeeze_result squeeze_alloc_unformatted_wa(znode *left,
 	ext = extent_by_coord(coord);
 	state = state_of_extent(ext);
 
-	if (state == HOLE_EXTENT)
+	if (state == HOLE_EXTENT || state == UNWRITTEN_EXTENT)
 		/*
-		 * hole extents are handled in squeeze_overwrite
+		 * hole and unwritten extents are handled in squeeze_overwrite
 		 */
 		ret = squeeze_overwrite_unformatted(left, coord,
 						    flush_pos, &key, stop_key);
@@ -1180,6 +1226,199 @@ static squeeze_result squeeze_alloc_unformatted_wa(znode *left,
 	return ret;
 }
 
+/**********************  ADAPTIVE TRANSACTION MODEL  **************************/
+
+/*
+ * Relocate-or-overwrite decisions are made per node using live metrics
+ * instead of a fixed policy:
+ *
+ * . write frequency of a node (jnode heat). A frequently rewritten node
+ *   has its parent dirty most of the time, so relocating it costs one
+ *   write, while overwriting it costs two (wandered and in-place ones).
+ *   Cold nodes are overwritten: relocation would dirty parents which
+ *   otherwise would stay clean;
+ *
+ * . device type. On devices with seek penalty large slums are relocated
+ *   to be packed together after their preceder, like in hybrid model;
+ *
+ * . free space near the preceder. If there is no free block within the
+ *   relocate distance of the preceder, the node is overwritten rather than
+ *   scattered over the disk (new nodes have to be allocated anyway).
+ *
+ * Relocated nodes are allocated one after another starting from the
+ * preceder, and sorted by block number in the flush queue, so they go to
+ * disk in contiguous batches.
+ */
+
+static int adaptive_nonrot(void)
+{
+	return get_current_super_private()->flush_adapt.nonrot;
+}
+
+/* true if free space on the volume is too fragmented to relocate cold data */
+static int adaptive_low_space(void)
+{
+	reiser4_super_info_data *sbinfo = get_current_super_private();
+
+	return reiser4_free_blocks(sbinfo->tree.super) * 10 <
+		reiser4_block_count(sbinfo->tree.super);
+}
+
+/* should node @node with parent-first preceder in @pos be relocated? */
+static int adaptive_want_relocate(jnode *node, flush_pos_t *pos)
+{
+	if (jnode_is_hot(node) || JF_ISSET(node, JNODE_REPACK))
+		return 1;
+	return pos->leaf_relocate && !adaptive_nonrot() &&
+		jnode_get_level(node) == LEAF_LEVEL;
+}
+
+/* should allocated extent unit at @coord be relocated, starting
+   @pos_in_unit blocks into it? */
+static int adaptive_relocate_extent(flush_pos_t *pos, const coord_t *coord,
+				    __u64 pos_in_unit)
+{
+	if (pos->slum_hot || unit_repack(pos, coord, pos_in_unit))
+		return 1;
+	return pos->leaf_relocate && !adaptive_low_space();
+}
+
+static int reverse_alloc_formatted_adaptive(jnode * node,
+					    const coord_t *parent_coord,
+					    flush_pos_t *pos)
+{
+	if (JF_ISSET(node, JNODE_CREATED))
+		return 1;
+	if (!adaptive_want_relocate(node, pos))
+		/* don't dirty parent of a cold node */
+		return 0;
+	return reverse_alloc_formatted_hybrid(node, parent_coord, pos);
+}
+
+static int forward_alloc_formatted_adaptive(znode * node,
+					    const coord_t *parent_coord,
+					    flush_pos_t *pos)
+{
+	int ret;
+
+	assert("jalex-2", znode_is_loaded(node));
+	assert("jalex-3", !jnode_check_flushprepped(ZJNODE(node)));
+	assert("jalex-4", znode_is_write_locked(node));
+	assert("jalex-5", coord_is_invalid(parent_coord)
+	       || znode_is_write_locked(parent_coord->node));
+
+	if (ZF_ISSET(node, JNODE_REPACK) || ZF_ISSET(node, JNODE_CREATED) ||
+	    znode_is_root(node))
+		/* these are handled the same way as in hybrid model */
+		return forward_alloc_formatted_hybrid(node, parent_coord, pos);
+
+	if (pos->preceder.blk == 0 ||
+	    pos->preceder.blk == *znode_get_block(node) - 1 ||
+	    !adaptive_want_relocate(ZJNODE(node), pos)) {
+		/* preceder is unknown, node is in the ideal place already or
+		   node is cold: leave it where it is */
+		jnode_make_wander(ZJNODE(node));
+	} else {
+		/* look for a free block near the preceder. Adaptive flush
+		   shortens relocate distance on non-rotational devices, so
+		   the bound is kept there too */
+		pos->preceder.max_dist =
+		    reiser4_flush_relocate_distance(get_current_super_private());
+		pos->preceder.level = znode_get_level(node);
+
+		ret = forward_try_defragment_locality(node, parent_coord, pos);
+		pos->preceder.max_dist = 0;
+
+		if (ret && (ret != -ENOSPC))
+			return ret;
+		if (ret == 0)
+			znode_make_reloc(node, pos->fq);
+		else
+			/* no room near the preceder */
+			jnode_make_wander(ZJNODE(node));
+	}
+	/*
+	 * This is the new preceder
+	 */
+	pos->preceder.blk = *znode_get_block(node);
+	check_preceder(pos->preceder.blk);
+	pos->alloc_cnt += 1;
+
+	assert("jalex-6", !reiser4_blocknr_is_fake(&pos->preceder.blk));
+	return 0;
+}
+
+static int forward_alloc_unformatted_adaptive(flush_pos_t *flush_pos)
+{
+	coord_t *coord;
+	reiser4_extent *ext;
+	oid_t oid;
+	__u64 index;
+	__u64 width;
+	extent_state state;
+	reiser4_key key;
+
+	assert("jalex-7", flush_pos->state == POS_ON_EPOINT);
+	assert("jalex-8", coord_is_existing_unit(&flush_pos->coord)
+	       && item_is_extent(&flush_pos->coord));
+
+	coord = &flush_pos->coord;
+
+	ext = extent_by_coord(coord);
+	state = state_of_extent(ext);
+	if (state == HOLE_EXTENT || state == UNWRITTEN_EXTENT) {
+		flush_pos->state = POS_INVALID;
+		return 0;
+	}
+	item_key_by_coord(coord, &key);
+	oid = get_key_objectid(&key);
+	index = extent_unit_index(coord) + flush_pos->pos_in_unit;
+	width = extent_get_width(ext);
+
+	assert("jalex-9", width > flush_pos->pos_in_unit);
+
+	if (state == UNALLOCATED_EXTENT ||
+	    adaptive_relocate_extent(flush_pos, coord, flush_pos->pos_in_unit)) {
+		int exit;
+		int result;
+		result = forward_relocate_unformatted(flush_pos, ext, state,
+						      oid,
+						      index, width, &exit);
+		if (exit)
+			return result;
+	} else
+		forward_overwrite_unformatted(flush_pos, oid, index, width);
+
+	flush_pos->pos_in_unit = 0;
+	return 0;
+}
+
+static squeeze_result squeeze_alloc_unformatted_adaptive(znode *left,
+							 const coord_t *coord,
+							 flush_pos_t *flush_pos,
+							 reiser4_key *stop_key)
+{
+	squeeze_result ret;
+	reiser4_key key;
+	reiser4_extent *ext;
+	extent_state state;
+
+	ext = extent_by_coord(coord);
+	state = state_of_extent(ext);
+
+	if (state == UNALLOCATED_EXTENT ||
+	    (state == ALLOCATED_EXTENT &&
+	     adaptive_relocate_extent(flush_pos, coord, 0)))
+		ret = squeeze_relocate_unformatted(left, coord,
+						   flush_pos, &key, stop_key);
+	else
+		ret = squeeze_overwrite_unformatted(left, coord,
+						    flush_pos, &key, stop_key);
+	if (ret == SQUEEZE_CONTINUE)
+		*stop_key = key;
+	return ret;
+}
+
 /******************************************************************************/
 
 txmod_plugin txmod_plugins[LAST_TXMOD_ID] = {
@@ -1224,6 +1463,20 @@ txmod_plugin txmod_plugins[LAST_TXMOD_ID] = {
 		.reverse_alloc_formatted = NULL,
 		.forward_alloc_unformatted = forward_alloc_unformatted_wa,
 		.squeeze_alloc_unformatted = squeeze_alloc_unformatted_wa
+	},
+	[ADAPTIVE_TXMOD_ID] = {
+		.h = {
+			.type_id = REISER4_TXMOD_PLUGIN_TYPE,
+			.id = ADAPTIVE_TXMOD_ID,
+			.pops = NULL,
+			.label = "adaptive",
+			.desc =	"Device-Aware Adaptive Transaction Model",
+			.linkage = {NULL, NULL}
+		},
+		.forward_alloc_formatted = forward_alloc_formatted_adaptive,
+		.reverse_alloc_formatted = reverse_alloc_formatted_adaptive,
+		.forward_alloc_unformatted = forward_alloc_unformatted_adaptive,
+		.squeeze_alloc_unformatted = squeeze_alloc_unformatted_adaptive
 	}
 };
 
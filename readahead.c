@@ -8,8 +8,13 @@
 #include "inode.h"
 #include "key.h"
 #include "znode.h"
+#include "coord.h"
+#include "plugin/item/item.h"
+#include "plugin/node/node.h"
 
 #include <linux/swap.h>		/* for totalram_pages */
+#include <linux/blkdev.h>
+#include <linux/sort.h>
 
 void reiser4_init_ra_info(ra_info_t *rai)
 {
@@ -46,7 +51,315 @@ static int low_on_memory(void)
 	return freepages < (totalram_pages * LOW_MEM_PERCENTAGE / 100);
 }
 
-/* start read for @node and for a few of its right neighbors */
+/* maximal number of leaves read ahead from one twig in one batch */
+#define TWIG_RA_WINDOW (32)
+
+static int ra_block_cmp(const void *a, const void *b)
+{
+	const reiser4_block_nr *blk1 = znode_get_block(*(znode **)a);
+	const reiser4_block_nr *blk2 = znode_get_block(*(znode **)b);
+
+	if (*blk1 < *blk2)
+		return -1;
+	return *blk1 > *blk2;
+}
+
+/* submit reads of @nr nodes of @batch in one plugged batch sorted by block
+   number, so that adjacent nodes are merged into large requests. Drops
+   references to the nodes */
+static void ra_submit(reiser4_super_info_data *sbinfo, znode **batch, int nr)
+{
+	struct blk_plug plug;
+	int issued = 0;
+	int i;
+
+	sort(batch, nr, sizeof(batch[0]), ra_block_cmp, NULL);
+	blk_start_plug(&plug);
+	for (i = 0; i < nr; i++) {
+		JF_SET(ZJNODE(batch[i]), JNODE_READAHEAD);
+		if (jstartio(ZJNODE(batch[i])) == 0)
+			issued++;
+		else
+			JF_CLR(ZJNODE(batch[i]), JNODE_READAHEAD);
+	}
+	blk_finish_plug(&plug);
+	for (i = 0; i < nr; i++)
+		zput(batch[i]);
+
+	atomic64_add(issued, &sbinfo->ra_params.nr_issued);
+}
+
+/**
+ * twig_readahead - start read of leaves hanging off a twig
+ * @from: position in the twig to start from
+ * @stop: key of the last leaf to read
+ * @stop_at_cached: stop at the first child which is in memory already
+ *
+ * Collects up to TWIG_RA_WINDOW children of internal items of the twig, from
+ * @from onwards and with keys not greater than @stop, which are not in memory
+ * yet, and submits reads for all of them in one batch. The twig has to be
+ * locked and loaded.
+ */
+static void twig_readahead(const coord_t *from, const reiser4_key *stop,
+			   int stop_at_cached)
+{
+	struct formatted_ra_params *ra_params;
+	znode *batch[TWIG_RA_WINDOW];
+	reiser4_super_info_data *sbinfo;
+	reiser4_block_nr prev = 0;
+	reiser4_key key;
+	coord_t coord;
+	znode *twig;
+	int nr = 0;
+	int max;
+
+	twig = from->node;
+	assert("jalex-25", znode_is_any_locked(twig));
+	assert("jalex-26", znode_is_loaded(twig));
+	assert("jalex-27", znode_get_level(twig) == TWIG_LEVEL);
+
+	sbinfo = get_super_private(znode_get_tree(twig)->super);
+	ra_params = &sbinfo->ra_params;
+	max = min_t(unsigned long, ra_params->max, TWIG_RA_WINDOW);
+
+	coord_dup(&coord, from);
+	while (nr < max && coord_is_existing_unit(&coord)) {
+		znode *child;
+		reiser4_block_nr addr;
+
+		unit_key_by_coord(&coord, &key);
+		if (keygt(&key, stop))
+			break;
+		if (item_is_internal(&coord)) {
+			item_plugin_by_coord(&coord)->s.internal.down_link(&coord,
+									 NULL,
+									 &addr);
+			if (ra_adjacent_only(ra_params->flags) && prev != 0 &&
+			    addr != prev + 1)
+				break;
+			prev = addr;
+			if (!reiser4_blocknr_is_fake(&addr)) {
+				child = child_znode(&coord, twig, 0, 0);
+				if (IS_ERR(child))
+					break;
+				if (znode_page(child) == NULL)
+					batch[nr++] = child;
+				else {
+					zput(child);
+					/* the rest of the window is likely
+					   to be read already */
+					if (stop_at_cached)
+						break;
+				}
+			}
+		}
+		if (coord_next_unit(&coord))
+			break;
+	}
+	if (nr != 0)
+		ra_submit(sbinfo, batch, nr);
+}
+
+/* try to read lock and load the twig above @leaf. We hold lock on @leaf, so
+   only try-lock can be used to go upward. */
+static int lock_twig(znode *leaf, lock_handle *lh)
+{
+	int result;
+
+	result = reiser4_get_parent_flags(lh, leaf, ZNODE_READ_LOCK,
+					  GN_TRY_LOCK);
+	if (result != 0)
+		return result;
+	if (znode_get_level(lh->node) != TWIG_LEVEL) {
+		/* @leaf is the root */
+		done_lh(lh);
+		return RETERR(-E_NO_NEIGHBOR);
+	}
+	result = zload(lh->node);
+	if (result != 0)
+		done_lh(lh);
+	return result;
+}
+
+/* read ahead right neighbors of @leaf which hang off the same twig. Returns 0
+   if @leaf is not the last child of the twig and readahead was done */
+static int leaf_twig_readahead(znode *leaf, ra_info_t *info)
+{
+	lock_handle twig_lh;
+	coord_t coord;
+	int result;
+
+	init_lh(&twig_lh);
+	result = lock_twig(leaf, &twig_lh);
+	if (result != 0)
+		return result;
+	result = find_child_ptr(twig_lh.node, leaf, &coord);
+	if (result == NS_FOUND) {
+		result = coord_next_unit(&coord);
+		if (result == 0)
+			twig_readahead(&coord, &info->key_to_stop, 1);
+	}
+	zrelse(twig_lh.node);
+	done_lh(&twig_lh);
+	return result;
+}
+
+/**
+ * reiser4_cut_readahead - read ahead leaves to be removed by tree cut
+ * @leaf: locked rightmost leaf of the range
+ * @from: left end of the range
+ * @to: right end of the range
+ *
+ * Tree cut goes from right to left, so this reads leaves of the twig above
+ * @leaf which lie within [@from, @to], starting from the nearest to @leaf.
+ */
+void reiser4_cut_readahead(znode *leaf, const reiser4_key *from,
+			   const reiser4_key *to)
+{
+	lock_handle twig_lh;
+	coord_t coord;
+	coord_t leaf_coord;
+	znode *twig;
+
+	if (znode_get_level(leaf) != LEAF_LEVEL || low_on_memory())
+		return;
+
+	init_lh(&twig_lh);
+	if (lock_twig(leaf, &twig_lh))
+		return;
+	twig = twig_lh.node;
+	if (find_child_ptr(twig, leaf, &leaf_coord) == NS_FOUND &&
+	    node_plugin_by_node(twig)->lookup(twig, from,
+					      FIND_MAX_NOT_MORE_THAN,
+					      &coord) >= 0) {
+		/* start from the unit @from falls into */
+		if (coord_is_before_leftmost(&coord))
+			coord_init_first_unit(&coord, twig);
+		else
+			coord.between = AT_UNIT;
+		if (leaf_coord.item_pos > coord.item_pos + TWIG_RA_WINDOW) {
+			coord.item_pos = leaf_coord.item_pos - TWIG_RA_WINDOW;
+			coord.unit_pos = 0;
+			coord_clear_iplug(&coord);
+		}
+		twig_readahead(&coord, to, 0);
+	}
+	zrelse(twig);
+	done_lh(&twig_lh);
+}
+
+static int ra_key_cmp(const void *a, const void *b)
+{
+	return keycmp(a, b);
+}
+
+/**
+ * reiser4_keys_readahead - start read of leaves holding given keys
+ * @tree: tree to read from
+ * @keys: array of keys, sorted by this function
+ * @nr: number of keys
+ *
+ * Used by readdir to prefetch stat data of objects whose names it returns.
+ * Twigs are looked up synchronously (they are usually cached), leaves which
+ * are not in memory are read in batches sorted by block number. No long term
+ * locks may be held by the caller.
+ */
+void reiser4_keys_readahead(reiser4_tree *tree, reiser4_key *keys, int nr)
+{
+	znode *batch[TWIG_RA_WINDOW];
+	reiser4_super_info_data *sbinfo;
+	lock_handle lh;
+	coord_t coord;
+	znode *twig = NULL;
+	int nr_batch = 0;
+	int result;
+	int i;
+
+	assert("jalex-30", lock_stack_isclean(get_current_lock_stack()));
+
+	if (tree->height < TWIG_LEVEL || low_on_memory())
+		return;
+	sbinfo = get_super_private(tree->super);
+	sort(keys, nr, sizeof(keys[0]), ra_key_cmp, NULL);
+
+	init_lh(&lh);
+	for (i = 0; i < nr; i++) {
+		znode *child;
+
+		if (twig != NULL && !znode_contains_key_lock(twig, &keys[i])) {
+			zrelse(twig);
+			done_lh(&lh);
+			twig = NULL;
+		}
+		if (twig == NULL) {
+			result = coord_by_key(tree, &keys[i], &coord, &lh,
+					      ZNODE_READ_LOCK,
+					      FIND_MAX_NOT_MORE_THAN,
+					      TWIG_LEVEL, TWIG_LEVEL,
+					      CBK_UNIQUE, NULL);
+			if (result != CBK_COORD_FOUND &&
+			    result != CBK_COORD_NOTFOUND)
+				break;
+			if (zload(lh.node)) {
+				done_lh(&lh);
+				break;
+			}
+			twig = lh.node;
+		}
+		if (node_plugin_by_node(twig)->lookup(twig, &keys[i],
+						      FIND_MAX_NOT_MORE_THAN,
+						      &coord) < 0 ||
+		    !coord_is_existing_item(&coord) ||
+		    !item_is_internal(&coord))
+			continue;
+		child = child_znode(&coord, twig, 0, 0);
+		if (IS_ERR(child))
+			continue;
+		if (znode_page(child) != NULL ||
+		    reiser4_blocknr_is_fake(znode_get_block(child)) ||
+		    (nr_batch > 0 && batch[nr_batch - 1] == child)) {
+			zput(child);
+			continue;
+		}
+		batch[nr_batch++] = child;
+		if (nr_batch == TWIG_RA_WINDOW) {
+			ra_submit(sbinfo, batch, nr_batch);
+			nr_batch = 0;
+		}
+	}
+	if (twig != NULL) {
+		zrelse(twig);
+		done_lh(&lh);
+	}
+	if (nr_batch != 0)
+		ra_submit(sbinfo, batch, nr_batch);
+}
+
+/* account use of a node which was read by twig readahead */
+void reiser4_readahead_used(znode *node)
+{
+	reiser4_super_info_data *sbinfo;
+
+	sbinfo = get_super_private(znode_get_tree(node)->super);
+	atomic64_inc(&sbinfo->ra_params.nr_used);
+}
+
+/* true if right neighbor of @node is known and in memory. Checked before
+   locking the twig, so that readahead of cached leaves costs nothing */
+static int right_neighbor_cached(znode *node)
+{
+	reiser4_tree *tree = znode_get_tree(node);
+	int result;
+
+	read_lock_tree(tree);
+	result = znode_is_right_connected(node) && node->right != NULL &&
+		znode_page(node->right) != NULL;
+	read_unlock_tree(tree);
+	return result;
+}
+
+/* start read for @node and for a few of its right neighbors. Leaves which
+   hang off the same twig are read in one batch, see twig_readahead() */
 void formatted_readahead(znode * node, ra_info_t *info)
 {
 	struct formatted_ra_params *ra_params;
@@ -72,6 +385,20 @@ void formatted_readahead(znode * node, ra_info_t *info)
 	if (low_on_memory())
 		return;
 
+	if (!should_readahead_neighbor(node, info))
+		return;
+
+	/* as the neighbor walk below, stop at the first node which is in
+	   memory already */
+	if (right_neighbor_cached(node))
+		return;
+
+	/* read the rest of the twig in one go if possible. Neighbor by
+	   neighbor walk is a fallback for when twig is busy and for the last
+	   leaf of a twig */
+	if (leaf_twig_readahead(node, info) == 0)
+		return;
+
 	/* We can have locked nodes on upper tree levels, in this situation lock
 	   priorities do not help to resolve deadlocks, we have to use TRY_LOCK
 	   here. */
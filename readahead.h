@@ -6,6 +6,8 @@
 
 #include "key.h"
 
+#include <linux/atomic.h>
+
 typedef enum {
 	RA_ADJACENT_ONLY = 1,	/* only requests nodes which are adjacent.
 				   Default is NO (not only adjacent) */
@@ -17,6 +19,10 @@ struct formatted_ra_params {
 	unsigned long max;	/* request not more than this amount of nodes.
 				   Default is totalram_pages / 4 */
 	int flags;
+	/* number of leaves read by twig readahead and how many of them were
+	   actually used */
+	atomic64_t nr_issued;
+	atomic64_t nr_used;
 };
 
 typedef struct {
@@ -24,6 +30,9 @@ typedef struct {
 } ra_info_t;
 
 void formatted_readahead(znode * , ra_info_t *);
+void reiser4_cut_readahead(znode *, const reiser4_key *, const reiser4_key *);
+void reiser4_keys_readahead(reiser4_tree *, reiser4_key *, int nr);
+void reiser4_readahead_used(znode *);
 void reiser4_init_ra_info(ra_info_t *rai);
 
 extern void reiser4_readdir_readahead_init(struct inode *dir, tap_t *tap);
@@ -133,9 +133,15 @@ extern const int REISER4_MAGIC_OFFSET;	/* offset to magic string from the
    be overwritten by tmgr.atom_max_age mount option. */
 #define REISER4_ATOM_MAX_AGE          (600 * HZ)
 
-/* sleeping period for ktxnmrgd */
+/* the longest sleeping period for ktxnmrgd */
 #define REISER4_TXNMGR_TIMEOUT  (5 * HZ)
 
+/* period of gradual write back of atoms approaching their commit age */
+#define REISER4_TRICKLE_INTERVAL (HZ / 10)
+
+/* number of nodes written back by ktxnmgrd at a time */
+#define REISER4_TRICKLE_BATCH (256)
+
 /* timeout to wait for ent thread in writepage. Default: 3 milliseconds. */
 #define REISER4_ENTD_TIMEOUT (3 * HZ / 1000)
 
@@ -407,6 +407,9 @@ int reiser4_iterate_tree(reiser4_tree * tree /* tree to scan */ ,
 					      *	each unit */ )
 {
 	int result;
+	reiser4_key key;
+	ra_info_t ra_info;
+	ra_info_t *ra = NULL;
 
 	assert("nikita-1143", tree != NULL);
 	assert("nikita-1145", coord != NULL);
@@ -421,6 +424,11 @@ int reiser4_iterate_tree(reiser4_tree * tree /* tree to scan */ ,
 		zrelse(coord->node);
 		return -ENOENT;
 	}
+	/* once scan crosses node boundary more than once, read ahead nodes
+	   of the same locality */
+	item_key_by_coord(coord, &key);
+	ra_info.key_to_stop = *reiser4_max_key();
+	set_key_locality(&ra_info.key_to_stop, get_key_locality(&key));
 	while ((result = actor(tree, coord, lh, arg)) > 0) {
 		/* move further  */
 		if ((through_units_p && coord_next_unit(coord)) ||
@@ -438,7 +446,7 @@ int reiser4_iterate_tree(reiser4_tree * tree /* tree to scan */ ,
 				zrelse(coord->node);
 				if (result == 0) {
 
-					result = zload(couple.node);
+					result = zload_ra(couple.node, ra);
 					if (result != 0) {
 						done_lh(&couple);
 						return result;
@@ -448,6 +456,7 @@ int reiser4_iterate_tree(reiser4_tree * tree /* tree to scan */ ,
 							      couple.node);
 					done_lh(lh);
 					move_lh(lh, &couple);
+					ra = &ra_info;
 				} else
 					return result;
 			} while (node_is_empty(coord->node));
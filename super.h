@@ -7,6 +7,7 @@
 #define __REISER4_SUPER_H__
 
 #include <linux/exportfs.h>
+#include <linux/workqueue.h>
 
 #include "tree.h"
 #include "entd.h"
@@ -15,6 +16,79 @@
 #include "plugin/object.h"
 #include "plugin/space/space_allocator.h"
 
+/*
+ * Per-cpu cache of grabbed space, see block_alloc.c
+ */
+struct reiser4_grab_cache {
+	spinlock_t lock;
+	/* number of blocks grabbed in advance */
+	__u64 nr;
+};
+
+/*
+ * Allocation cursor of an allocation group, see block_alloc.c
+ */
+struct reiser4_alloc_cursor {
+	spinlock_t lock;
+	/* where the next allocation without preceder starts */
+	__u64 blk;
+	/* when the cursor is moved back to its allocation group */
+	unsigned long rehome;
+	/* cursor is set */
+	int valid;
+};
+
+/*
+ * Blocks freed by committed atoms and waiting for discard, see discard.c
+ */
+struct reiser4_discard_queue {
+	spinlock_t guard;
+	/* blocknr_list of queued extents */
+	struct list_head extents;
+	/* number of queued blocks */
+	__u64 nr_blocks;
+	/* serializes processing of the queue: extents being discarded are
+	   taken off the list */
+	struct mutex processing;
+	/* number of discarded blocks */
+	__u64 nr_discarded;
+	/* set on umount: extents are discarded synchronously */
+	int stopped;
+	struct delayed_work work;
+	struct super_block *super;
+};
+
+/*
+ * Unix files waiting for deferred tail to extent conversion, see
+ * tail_conversion.c
+ */
+struct reiser4_conv_queue {
+	spinlock_t guard;
+	/* stat data keys of queued files */
+	struct list_head files;
+	/* number of queued files */
+	__u32 nr_queued;
+	/* set on umount: nothing is queued anymore */
+	int stopped;
+	/* number of files converted by the worker */
+	__u64 nr_converted;
+	/* time the worker spent converting files (usec) */
+	__u64 total_latency;
+	__u64 max_latency;
+	struct delayed_work work;
+	struct super_block *super;
+};
+
+/*
+ * Statistics of flush queue write-out, see flush_queue.c
+ */
+struct fq_stats {
+	/* number of bios submitted through flush queues */
+	__u64 nr_bios;
+	/* number of blocks carried by those bios */
+	__u64 nr_blocks;
+};
+
 /*
  * Flush algorithms parameters.
  */
@@ -25,6 +99,29 @@ struct flush_params {
 	unsigned scan_maxnodes;
 };
 
+/*
+ * Run-time state of adaptive flush. Mount-time struct flush_params are
+ * the base values, effective values are recalculated after each flush
+ * scan. See flush.c
+ */
+struct flush_adapt {
+	/* device has no seek penalty */
+	int nonrot;
+	/* running average of slum sizes found by flush scans, scaled by 8 */
+	unsigned long avg_slum;
+	/* effective parameters */
+	unsigned scan_maxnodes;
+	unsigned relocate_threshold;
+	unsigned relocate_distance;
+	/* number of slums scanned */
+	atomic64_t nr_slums;
+	/* number of left scans stopped by the scan limit */
+	atomic64_t nr_scan_limited;
+	/* leaf level relocate-vs-overwrite decisions */
+	atomic64_t nr_leaf_relocate;
+	atomic64_t nr_leaf_overwrite;
+};
+
 typedef enum {
 	/*
 	 * True if this file system doesn't support hard-links (multiple names)
@@ -53,7 +150,11 @@ typedef enum {
 	/* enable issuing of discard requests */
 	REISER4_DISCARD = 8,
 	/* disable hole punching at flush time */
-	REISER4_DONT_PUNCH_HOLES = 9
+	REISER4_DONT_PUNCH_HOLES = 9,
+	/* use mount-time flush parameters as is */
+	REISER4_DONT_ADAPT_FLUSH = 10,
+	/* keep in-memory index of free extents */
+	REISER4_FREE_EXTENT_INDEX = 11
 } reiser4_fs_flag;
 
 /*
@@ -104,7 +205,8 @@ struct object_ops {
     ->blocks_fake_allocated
     ->blocks_flush_reserved
     ->eflushed
-    ->blocknr_hint_default
+    ->alloc_window_cursor
+    ->flush_adapt
 
    After journal replaying during mount,
 
@@ -192,6 +294,12 @@ struct reiser4_super_info_data {
 	/* number of blocks reserved for cluster operations. */
 	__u64 blocks_clustered;
 
+	/*
+	 * per-cpu caches of grabbed blocks not owned by any context yet. They
+	 * are counted in ->blocks_grabbed
+	 */
+	struct reiser4_grab_cache __percpu *grab_cache;
+
 	/* unique file-system identifier */
 	__u32 fsuid;
 
@@ -229,6 +337,8 @@ struct reiser4_super_info_data {
 
 	/* parameters for the flush algorithm */
 	struct flush_params flush;
+	/* run-time adjusted flush parameters, protected by ->guard */
+	struct flush_adapt flush_adapt;
 
 	/* pointers to jnodes for journal header and footer */
 	jnode *journal_header;
@@ -240,10 +350,18 @@ struct reiser4_super_info_data {
 	__u64 last_committed_tx;
 
 	/*
-	 * we remember last written location for using as a hint for new block
-	 * allocation
+	 * last written locations of allocation groups used as a hint for new
+	 * block allocation
 	 */
-	__u64 blocknr_hint_default;
+	struct reiser4_alloc_cursor *alloc_cursor;
+
+	/* where the next per-file allocation window is opened */
+	__u64 alloc_window_cursor;
+	/* taken by flush to find allocation window of a file and by
+	   destroy_inode of unix files, see unformatted_alloc_window() */
+	spinlock_t window_lock;
+	/* destroy_inode waits here for flushers using window of the file */
+	wait_queue_head_t window_wait;
 
 	/* committed number of files (oid allocator state variable ) */
 	__u64 nr_files_committed;
@@ -275,6 +393,11 @@ struct reiser4_super_info_data {
 	struct d_cursor_info d_info;
 	struct crypto_shash *csum_tfm;
 
+	/* flush queue write-out statistics, protected by ->guard */
+	struct fq_stats fq_stats;
+	struct reiser4_discard_queue discard_queue;
+	struct reiser4_conv_queue conv_queue;
+
 #ifdef CONFIG_REISER4_BADBLOCKS
 	/* Alternative master superblock offset (in bytes) */
 	unsigned long altsuper;
@@ -7,6 +7,7 @@
 #include "flush.h"
 #include "safe_link.h"
 #include "checksum.h"
+#include "discard.h"
 
 #include <linux/vfs.h>
 #include <linux/writeback.h>
@@ -237,7 +238,7 @@ static void reiser4_put_super(struct super_block *super)
 
 	debugfs_remove(sbinfo->tmgr.debugfs_atom_count);
 	debugfs_remove(sbinfo->tmgr.debugfs_id_count);
-	debugfs_remove(sbinfo->debugfs_root);
+	debugfs_remove_recursive(sbinfo->debugfs_root);
 
 	ctx = reiser4_init_context(super);
 	if (IS_ERR(ctx)) {
@@ -245,6 +246,11 @@ static void reiser4_put_super(struct super_block *super)
 		return;
 	}
 
+	/* discard and free blocks waiting for discard */
+	reiser4_done_discard_queue(super);
+	/* cached grabbed space is not owned by anybody */
+	reiser4_drain_grab_cache(sbinfo);
+
 	/* have disk format plugin to free its resources */
 	if (get_super_private(super)->df_plug->release)
 		get_super_private(super)->df_plug->release(super);
@@ -304,7 +310,8 @@ static int reiser4_statfs(struct dentry *dentry, struct kstatfs *statfs)
 	total = reiser4_block_count(super);
 	reserved = get_super_private(super)->blocks_reserved;
 	deleted = txnmgr_count_deleted_blocks();
-	free = reiser4_free_blocks(super) + deleted;
+	free = reiser4_free_blocks(super) + deleted +
+		reiser4_grab_cache_count(get_super_private(super));
 	forroot = reiser4_reserved_blocks(super, 0, 0);
 
 	/*
@@ -448,6 +455,13 @@ static int reiser4_sync_fs(struct super_block *super, int wait)
 
 static int reiser4_remount(struct super_block *s, int *mount_flags, char *arg)
 {
+	if (!(*mount_flags & MS_RDONLY) &&
+	    get_super_private(s)->version > get_release_number_minor()) {
+		/* see try_init_format40() */
+		warning("jalex-50", "%s: format version is too new, "
+			"can not remount read-write", s->s_id);
+		return RETERR(-EROFS);
+	}
 	sync_filesystem(s);
 	return 0;
 }
@@ -499,6 +513,14 @@ struct super_operations reiser4_super_operations = {
  *
  * This is to be called by reiser4_get_sb. Mounts filesystem.
  */
+/* debugfs file showing value of atomic64_t counter */
+static int atomic64_get(void *data, u64 *val)
+{
+	*val = atomic64_read((atomic64_t *)data);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(atomic64_ro_fops, atomic64_get, NULL, "%llu\n");
+
 static int fill_super(struct super_block *super, void *data, int silent)
 {
 	reiser4_context ctx;
@@ -559,7 +581,8 @@ static int fill_super(struct super_block *super, void *data, int silent)
 	if ((result = reiser4_init_root_inode(super)) != 0)
 		goto failed_init_root_inode;
 
-	if ((result = get_super_private(super)->df_plug->version_update(super)) != 0)
+	if ((result = get_super_private(super)->df_plug->version_update(super,
+					get_mount_number_minor())) != 0)
 		goto failed_update_format_version;
 
 	process_safelinks(super);
@@ -576,6 +599,85 @@ static int fill_super(struct super_block *super, void *data, int silent)
 			debugfs_create_u32("id_count", S_IFREG|S_IRUSR,
 					   sbinfo->debugfs_root,
 					   &sbinfo->tmgr.id_count);
+		/* average bio size is fq_bio_blocks / fq_bios */
+		debugfs_create_u64("fq_bios", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->fq_stats.nr_bios);
+		debugfs_create_u64("fq_bio_blocks", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->fq_stats.nr_blocks);
+		/* adaptive flush state and decisions */
+		debugfs_create_u32("flush_scan_maxnodes", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->flush_adapt.scan_maxnodes);
+		debugfs_create_u32("flush_relocate_threshold", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->flush_adapt.relocate_threshold);
+		debugfs_create_u32("flush_relocate_distance", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->flush_adapt.relocate_distance);
+		debugfs_create_file("flush_slums", S_IFREG|S_IRUSR,
+				    sbinfo->debugfs_root,
+				    &sbinfo->flush_adapt.nr_slums,
+				    &atomic64_ro_fops);
+		debugfs_create_file("flush_scan_limited", S_IFREG|S_IRUSR,
+				    sbinfo->debugfs_root,
+				    &sbinfo->flush_adapt.nr_scan_limited,
+				    &atomic64_ro_fops);
+		debugfs_create_file("flush_leaf_relocate", S_IFREG|S_IRUSR,
+				    sbinfo->debugfs_root,
+				    &sbinfo->flush_adapt.nr_leaf_relocate,
+				    &atomic64_ro_fops);
+		debugfs_create_file("flush_leaf_overwrite", S_IFREG|S_IRUSR,
+				    sbinfo->debugfs_root,
+				    &sbinfo->flush_adapt.nr_leaf_overwrite,
+				    &atomic64_ro_fops);
+		debugfs_create_u64("discard_queued", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->discard_queue.nr_blocks);
+		debugfs_create_u64("discarded", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->discard_queue.nr_discarded);
+		/* ent threads: queue depth and request latency (usec).
+		   Average latency is entd_latency_total / entd_served */
+		debugfs_create_u32("entd_queued", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->entd.nr_todo_reqs);
+		debugfs_create_u32("entd_queued_max", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->entd.max_todo_reqs);
+		debugfs_create_u64("entd_served", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->entd.nr_served);
+		debugfs_create_u64("entd_latency_total", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->entd.total_latency);
+		debugfs_create_u64("entd_latency_max", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->entd.max_latency);
+		/* deferred tail conversion: queue depth and conversion
+		   time (usec) */
+		debugfs_create_u32("conv_queued", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->conv_queue.nr_queued);
+		debugfs_create_u64("conv_converted", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->conv_queue.nr_converted);
+		debugfs_create_u64("conv_latency_total", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->conv_queue.total_latency);
+		debugfs_create_u64("conv_latency_max", S_IFREG|S_IRUSR,
+				   sbinfo->debugfs_root,
+				   &sbinfo->conv_queue.max_latency);
+		/* formatted readahead efficiency: ra_used / ra_issued */
+		debugfs_create_file("ra_issued", S_IFREG|S_IRUSR,
+				    sbinfo->debugfs_root,
+				    &sbinfo->ra_params.nr_issued,
+				    &atomic64_ro_fops);
+		debugfs_create_file("ra_used", S_IFREG|S_IRUSR,
+				    sbinfo->debugfs_root,
+				    &sbinfo->ra_params.nr_used,
+				    &atomic64_ro_fops);
 	}
 	printk("reiser4: %s: using %s.\n", super->s_id,
 	       txmod_plugin_by_id(sbinfo->txmod)->h.desc);
@@ -583,6 +685,7 @@ static int fill_super(struct super_block *super, void *data, int silent)
 
  failed_update_format_version:
  failed_init_root_inode:
+	reiser4_done_discard_queue(super);
 	if (sbinfo->df_plug->release)
 		sbinfo->df_plug->release(super);
  failed_init_disk_format:
@@ -617,13 +720,26 @@ static struct dentry *reiser4_mount(struct file_system_type *fs_type, int flags,
 	return mount_bdev(fs_type, flags, dev_name, data, fill_super);
 }
 
+/**
+ * reiser4_kill_sb - kill_sb of file_system_type operations
+ * @super: super block to kill
+ *
+ * Stops the tail conversion worker before inodes are evicted.
+ */
+static void reiser4_kill_sb(struct super_block *super)
+{
+	if (super->s_fs_info != NULL)
+		reiser4_done_conv_queue(super);
+	kill_block_super(super);
+}
+
 /* structure describing the reiser4 filesystem implementation */
 static struct file_system_type reiser4_fs_type = {
 	.owner = THIS_MODULE,
 	.name = "reiser4",
 	.fs_flags = FS_REQUIRES_DEV,
 	.mount = reiser4_mount,
-	.kill_sb = kill_block_super,
+	.kill_sb = reiser4_kill_sb,
 	.next = NULL
 };
 
@@ -701,11 +817,17 @@ static int __init init_reiser4(void)
 	if ((result = blocknr_list_init_static()) != 0)
 		goto failed_init_blocknr_list;
 
+	/* create workqueue of deferred tail conversion */
+	if ((result = reiser4_init_conv_wq()) != 0)
+		goto failed_init_conv_wq;
+
 	if ((result = register_filesystem(&reiser4_fs_type)) == 0) {
 		reiser4_debugfs_root = debugfs_create_dir("reiser4", NULL);
 		return 0;
 	}
 
+	reiser4_done_conv_wq();
+ failed_init_conv_wq:
 	blocknr_list_done_static();
  failed_init_blocknr_list:
 	blocknr_set_done_static();
@@ -745,6 +867,7 @@ static void __exit done_reiser4(void)
 	debugfs_remove(reiser4_debugfs_root);
 	result = unregister_filesystem(&reiser4_fs_type);
 	BUG_ON(result != 0);
+	reiser4_done_conv_wq();
 	blocknr_list_done_static();
 	blocknr_set_done_static();
 	reiser4_done_d_cursor();
@@ -0,0 +1,248 @@
+/* Copyright 2001, 2002, 2003 by Hans Reiser, licensing governed by
+ * reiser4/README */
+
+/* Userspace microbenchmark of the word kernels of plugin/space/bitmap.c:
+   find_next_zero_bit_in_word() and find_last_set_bit_in_word(), as they were
+   (bit by bit loops) and as they are (masking plus __ffs()/__fls()).
+
+   Each kernel is driven by a copy of the bitmap scanner which uses it in
+   the allocator, __reiser4_find_next_set_bit() and
+   reiser4_find_last_set_bit(). For every free run of a 4K block bitmap
+   block the scanners look for its end (forward) and for its beginning
+   (backward), as the allocator does when it measures a free run.
+
+   Build and run:
+
+	cc -O2 -o bitmap-bench tools/bitmap-bench.c && ./bitmap-bench
+
+   Results of the old and new kernels are compared before timing. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned long ulong_t;
+
+#define BITS_PER_LONG (sizeof(ulong_t) * 8)
+#define LONG_INT_SHIFT (BITS_PER_LONG == 64 ? 6 : 5)
+#define LONG_INT_MASK (BITS_PER_LONG - 1)
+
+#define BMAP_BITS (4096 * 8)
+#define BMAP_WORDS (BMAP_BITS / BITS_PER_LONG)
+
+#define __ffs(w) ((int)__builtin_ctzl(w))
+#define __fls(w) ((int)(BITS_PER_LONG - 1 - __builtin_clzl(w)))
+
+/* the kernels before the change */
+static int old_find_next_zero_bit_in_word(ulong_t word, int start_bit)
+{
+	ulong_t mask = 1UL << start_bit;
+	int i = start_bit;
+
+	while ((word & mask) != 0) {
+		mask <<= 1;
+		if (++i >= (int)BITS_PER_LONG)
+			break;
+	}
+
+	return i;
+}
+
+static int old_find_last_set_bit_in_word(ulong_t word, int start_bit)
+{
+	ulong_t bit_mask;
+	int nr = start_bit;
+
+	bit_mask = (1UL << nr);
+
+	while (bit_mask != 0) {
+		if (bit_mask & word)
+			return nr;
+		bit_mask >>= 1;
+		nr--;
+	}
+	return BITS_PER_LONG;
+}
+
+/* the kernels after the change */
+static int new_find_next_zero_bit_in_word(ulong_t word, int start_bit)
+{
+	word = ~word & (~0UL << start_bit);
+	if (word == 0)
+		return BITS_PER_LONG;
+	return __ffs(word);
+}
+
+static int new_find_last_set_bit_in_word(ulong_t word, int start_bit)
+{
+	if (start_bit < (int)BITS_PER_LONG - 1)
+		word &= (1UL << (start_bit + 1)) - 1;
+	if (word == 0)
+		return BITS_PER_LONG;
+	return __fls(word);
+}
+
+static int run_first[BMAP_BITS];
+static int run_last[BMAP_BITS];
+static int nr_runs;
+
+/* scanners of plugin/space/bitmap.c, instantiated for either kernel */
+#define DEFINE_SCANNERS(pfx)						\
+static int pfx##_find_next_set_bit(ulong_t *base, int max_offset,	\
+				   int start_offset)			\
+{									\
+	int word_nr = start_offset >> LONG_INT_SHIFT;			\
+	int bit_nr = start_offset & LONG_INT_MASK;			\
+	int max_word_nr = (max_offset - 1) >> LONG_INT_SHIFT;		\
+									\
+	if (bit_nr != 0) {						\
+		int nr;							\
+									\
+		nr = pfx##_find_next_zero_bit_in_word(~(base[word_nr]),	\
+						      bit_nr);		\
+		if (nr < (int)BITS_PER_LONG)				\
+			return (word_nr << LONG_INT_SHIFT) + nr;	\
+		++word_nr;						\
+	}								\
+	while (word_nr <= max_word_nr) {				\
+		if (base[word_nr] != 0)					\
+			return (word_nr << LONG_INT_SHIFT) +		\
+				pfx##_find_next_zero_bit_in_word(	\
+					~(base[word_nr]), 0);		\
+		++word_nr;						\
+	}								\
+	return max_offset;						\
+}									\
+									\
+static int pfx##_find_last_set_bit(int *result, ulong_t *base,		\
+				   int low_off, int high_off)		\
+{									\
+	int last_word = high_off >> LONG_INT_SHIFT;			\
+	int last_bit = high_off & LONG_INT_MASK;			\
+	int first_word = low_off >> LONG_INT_SHIFT;			\
+	int nr;								\
+									\
+	nr = pfx##_find_last_set_bit_in_word(base[last_word], last_bit);	\
+	if (nr < (int)BITS_PER_LONG) {					\
+		*result = (last_word << LONG_INT_SHIFT) + nr;		\
+		return 0;						\
+	}								\
+	--last_word;							\
+	while (last_word >= first_word) {				\
+		if (base[last_word] != 0) {				\
+			*result = (last_word << LONG_INT_SHIFT) +	\
+				pfx##_find_last_set_bit_in_word(	\
+					base[last_word],		\
+					BITS_PER_LONG - 1);		\
+			return 0;					\
+		}							\
+		--last_word;						\
+	}								\
+	return -1;							\
+}									\
+									\
+/* find the end of each free run, as forward allocation does */	\
+static unsigned long pfx##_scan_forward(ulong_t *base)			\
+{									\
+	unsigned long sum = 0;						\
+	int i;								\
+									\
+	for (i = 0; i < nr_runs; i++)					\
+		sum += pfx##_find_next_set_bit(base, BMAP_BITS,		\
+					       run_first[i]);		\
+	return sum;							\
+}									\
+									\
+/* find the beginning of each free run, as backward allocation does */	\
+static unsigned long pfx##_scan_backward(ulong_t *base)			\
+{									\
+	unsigned long sum = 0;						\
+	int found;							\
+	int i;								\
+									\
+	for (i = 0; i < nr_runs; i++)					\
+		if (!pfx##_find_last_set_bit(&found, base, 0,		\
+					     run_last[i]))		\
+			sum += found;					\
+	return sum;							\
+}
+
+DEFINE_SCANNERS(old)
+DEFINE_SCANNERS(new)
+
+/* bitmap with runs of set bits of random length up to @run, each followed
+   by a free run of random length up to @run. The first and the last bit of
+   each free run are recorded */
+static void fill(ulong_t *base, int run)
+{
+	int off = 0;
+	int len;
+
+	memset(base, 0, BMAP_WORDS * sizeof(ulong_t));
+	nr_runs = 0;
+	while (off < BMAP_BITS) {
+		len = 1 + rand() % run;
+		for (; len > 0 && off < BMAP_BITS; len--, off++)
+			base[off >> LONG_INT_SHIFT] |=
+				1UL << (off & LONG_INT_MASK);
+		len = 1 + rand() % run;
+		if (off + len >= BMAP_BITS)
+			break;
+		run_first[nr_runs] = off;
+		run_last[nr_runs] = off + len - 1;
+		nr_runs++;
+		off += len;
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define LOOPS 20000
+
+static volatile unsigned long sink;
+
+#define TIME(expr)							\
+({									\
+	double __t = now();						\
+	int __i;							\
+									\
+	for (__i = 0; __i < LOOPS; __i++)				\
+		sink += (expr);						\
+	(now() - __t) * 1e6 / LOOPS;					\
+})
+
+int main(void)
+{
+	static ulong_t base[BMAP_WORDS];
+	static const int runs[] = { 1, 8, 64, 512, 4096 };
+	unsigned int i;
+
+	srand(1);
+	printf("%-10s %12s %12s %12s %12s\n", "max run", "fwd old us",
+	       "fwd new us", "bwd old us", "bwd new us");
+	for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+		double fo, fn, bo, bn;
+
+		fill(base, runs[i]);
+		if (old_scan_forward(base) != new_scan_forward(base) ||
+		    old_scan_backward(base) != new_scan_backward(base)) {
+			fprintf(stderr, "results differ, max run %d\n",
+				runs[i]);
+			return 1;
+		}
+		fo = TIME(old_scan_forward(base));
+		fn = TIME(new_scan_forward(base));
+		bo = TIME(old_scan_backward(base));
+		bn = TIME(new_scan_backward(base));
+		printf("%-10d %12.2f %12.2f %12.2f %12.2f\n", runs[i], fo, fn,
+		       bo, bn);
+	}
+	return 0;
+}
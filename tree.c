@@ -1757,6 +1757,8 @@ int reiser4_cut_tree_object(reiser4_tree * tree, const reiser4_key * from_key,
 					       CBK_UNIQUE, NULL /*ra_info */);
 		if (result != CBK_COORD_FOUND)
 			break;
+		/* start read of leaves to be cut in one batch */
+		reiser4_cut_readahead(lock.node, from_key, to_key);
 		if (object == NULL
 		    || inode_file_plugin(object)->cut_tree_worker == NULL)
 			cut_tree_worker = cut_tree_worker_common;
@@ -406,6 +406,7 @@ static void atom_init(txn_atom * atom)
 	INIT_LIST_HEAD(&atom->fwaitfor_list);
 	INIT_LIST_HEAD(&atom->fwaiting_list);
 	blocknr_set_init(&atom->wandered_map);
+	blocknr_list_init(&atom->alloc_set);
 
 	atom_dset_init(atom);
 
@@ -801,6 +802,7 @@ static void atom_free(txn_atom * atom)
 	atom->stage = ASTAGE_FREE;
 
 	blocknr_set_destroy(&atom->wandered_map);
+	blocknr_list_destroy(&atom->alloc_set);
 
 	atom_dset_destroy(atom);
 
@@ -1238,6 +1240,68 @@ static int atom_is_committable(txn_atom * atom)
 	    atom->txnh_count == atom->nr_waiters && atom_should_commit(atom);
 }
 
+/* commit the oldest atom when atoms pin more than 1/REISER4_ATOMS_MEM_LIMIT of
+ * memory */
+#define REISER4_ATOMS_MEM_LIMIT (16)
+
+/**
+ * txnmgr_schedule - find when ktxnmgrd has to do something next
+ * @mgr: transaction manager
+ * @max_timeout: the longest ktxnmgrd may sleep
+ * @trickle: set if some atom is old enough to be written back gradually
+ * @trickle_atom: id of that atom
+ *
+ * Returns number of jiffies until the oldest atom reaches its commit age.
+ * If atoms pin too much memory, marks the oldest one for commit.
+ */
+long txnmgr_schedule(txn_mgr *mgr, long max_timeout, int *trickle,
+		     __u32 *trickle_atom)
+{
+	txn_atom *atom;
+	txn_atom *oldest = NULL;
+	unsigned long captured = 0;
+	unsigned long deadline;
+	long timeout = max_timeout;
+
+	*trickle = 0;
+	spin_lock_txnmgr(mgr);
+	list_for_each_entry(atom, &mgr->atoms_list, atom_link) {
+		/* test without taking atom spin lock, as in
+		 * commit_some_atoms() */
+		if (atom->stage >= ASTAGE_PRE_COMMIT)
+			continue;
+		captured += atom->capture_count;
+		if (oldest == NULL ||
+		    time_before(atom->start_time, oldest->start_time))
+			oldest = atom;
+	}
+	if (oldest != NULL) {
+		deadline = oldest->start_time + mgr->atom_max_age;
+		if (time_before(jiffies, deadline))
+			timeout = min_t(long, timeout, deadline - jiffies);
+		else
+			/* overdue atom, but it has open handles */
+			timeout = min_t(long, timeout, REISER4_TRICKLE_INTERVAL);
+		/* start writing the atom back when it is half way to its
+		 * commit, so that commit does not come as a burst */
+		if (time_after(jiffies,
+			       oldest->start_time + mgr->atom_max_age / 2)) {
+			*trickle = 1;
+			*trickle_atom = oldest->atom_id;
+			timeout = min_t(long, timeout, REISER4_TRICKLE_INTERVAL);
+		}
+		if (captured > totalram_pages / REISER4_ATOMS_MEM_LIMIT) {
+			spin_lock_atom(oldest);
+			if (oldest->stage < ASTAGE_PRE_COMMIT)
+				oldest->flags |= ATOM_FORCE_COMMIT;
+			spin_unlock_atom(oldest);
+			timeout = min_t(long, timeout, REISER4_TRICKLE_INTERVAL);
+		}
+	}
+	spin_unlock_txnmgr(mgr);
+	return timeout;
+}
+
 /* called periodically from ktxnmgrd to commit old atoms. Releases ktxnmgrd spin
  * lock at exit */
 int commit_some_atoms(txn_mgr * mgr)
@@ -1447,6 +1511,13 @@ repeat:
 
 	BUG_ON(atom->super != ctx->super);
 	assert("vs-35", atom->super == ctx->super);
+	if (ctx->entd && entd_claim_atom(ctx->super, atom)) {
+		/* another ent thread flushes this atom, it will take care
+		 * of requested page as well */
+		spin_unlock_atom(atom);
+		reiser4_txn_restart(ctx);
+		return 0;
+	}
 	if (start) {
 		spin_lock_jnode(start);
 		ret = (atom == start->atom) ? 1 : 0;
@@ -1455,6 +1526,8 @@ repeat:
 			start = NULL;
 	}
 	ret = flush_current_atom(flags, wbc->nr_to_write, nr_submitted, &atom, start);
+	if (ctx->entd)
+		entd_release_atom(ctx->super);
 	if (ret == 0) {
 		/* flush_current_atom returns 0 only if it submitted for write
 		   nothing */
@@ -1496,6 +1569,54 @@ repeat:
 	return ret;
 }
 
+/**
+ * reiser4_trickle_atom - write some nodes of an atom back
+ * @atom_id: id of the atom selected by txnmgr_schedule()
+ * @nr_to_write: how many nodes to write
+ *
+ * Unlike flush_some_atom(), neither forces commit of the atom when it has
+ * nothing to flush nor waits for anything: the atom is committed by
+ * commit_some_atoms() when it gets old enough. Does nothing if the atom has
+ * gone, has been fused or is being flushed by somebody else.
+ */
+void reiser4_trickle_atom(__u32 atom_id, long nr_to_write)
+{
+	reiser4_context *ctx = get_current_context();
+	txn_mgr *tmgr = &get_super_private(ctx->super)->tmgr;
+	txn_handle *txnh = ctx->trans;
+	txn_atom *atom;
+	long nr_submitted = 0;
+	int found = 0;
+
+	assert("jalex-48", txnh != NULL && txnh->atom == NULL);
+
+	spin_lock_txnmgr(tmgr);
+	list_for_each_entry(atom, &tmgr->atoms_list, atom_link) {
+		if (atom->atom_id != atom_id)
+			continue;
+		spin_lock_atom(atom);
+		if (atom->stage < ASTAGE_PRE_COMMIT &&
+		    atom->nr_flushers == 0) {
+			spin_lock_txnh(txnh);
+			capture_assign_txnh_nolock(atom, txnh);
+			spin_unlock_txnh(txnh);
+			found = 1;
+		} else
+			spin_unlock_atom(atom);
+		break;
+	}
+	spin_unlock_txnmgr(tmgr);
+	if (!found)
+		return;
+
+	/* -E_REPEAT means there is more to flush, it is left for the next
+	   round. Atom stays locked only if nothing was left to flush */
+	if (flush_current_atom(JNODE_FLUSH_WRITE_BLOCKS | JNODE_FLUSH_LIMITED,
+			       nr_to_write, &nr_submitted, &atom, NULL) == 0)
+		spin_unlock_atom(atom);
+	reiser4_txn_restart(ctx);
+}
+
 /* Remove processed nodes from atom's clean list (thereby remove them from transaction). */
 void reiser4_invalidate_list(struct list_head *head)
 {
@@ -2317,6 +2438,12 @@ static void capture_assign_block_nolock(txn_atom *atom, jnode *node)
 	/* reference to jnode is acquired by atom. */
 	jref(node);
 
+	if (atom->capture_count ==
+	    get_super_private(atom->super)->tmgr.atom_max_size + 1 &&
+	    get_super_private(atom->super)->tmgr.daemon != NULL)
+		/* atom has grown large enough to be committed */
+		ktxnmgrd_kick(&get_super_private(atom->super)->tmgr);
+
 	ON_DEBUG(count_jnode(atom, node, NOT_CAPTURED, CLEAN_LIST, 1));
 
 	LOCK_CNT_INC(t_refs);
@@ -2330,6 +2457,7 @@ static void do_jnode_make_dirty(jnode * node, txn_atom * atom)
 	assert("jmacd-3981", !JF_ISSET(node, JNODE_DIRTY));
 
 	JF_SET(node, JNODE_DIRTY);
+	jnode_update_heat(node);
 
 	if (!JF_ISSET(node, JNODE_CLUSTER_PAGE))
 		get_current_context()->nr_marked_dirty++;
@@ -2395,6 +2523,56 @@ void jnode_make_dirty_locked(jnode * node)
 	}
 }
 
+/**
+ * reiser4_capture_dirty_jnodes - capture jnodes and mark them dirty
+ * @nodes: jnodes to capture
+ * @count: number of jnodes
+ *
+ * Does what reiser4_try_capture() in write mode followed by
+ * jnode_make_dirty_locked() does for each of @nodes, but takes the current
+ * atom's lock once for all jnodes which are either not captured yet or are
+ * captured by the current atom already. A jnode of another atom, which has to
+ * be fused with the current one, goes through reiser4_try_capture().
+ *
+ * Jnodes are pinned by the caller, so capture can not fail.
+ */
+void reiser4_capture_dirty_jnodes(jnode **nodes, int count)
+{
+	txn_atom *atom;
+	jnode *node;
+	int ret;
+	int i;
+
+	i = 0;
+	while (i < count) {
+		/* this assigns an atom to the transaction handle if it has
+		   none yet, and fuses atoms if necessary */
+		node = nodes[i++];
+		spin_lock_jnode(node);
+		ret = reiser4_try_capture(node, ZNODE_WRITE_LOCK, 0);
+		BUG_ON(ret != 0);
+		jnode_make_dirty_locked(node);
+		spin_unlock_jnode(node);
+
+		atom = get_current_atom_locked();
+		for (; i < count; i++) {
+			node = nodes[i];
+			spin_lock_jnode(node);
+			if (JF_ISSET(node, JNODE_IS_DYING) ||
+			    (node->atom != NULL && node->atom != atom)) {
+				spin_unlock_jnode(node);
+				break;
+			}
+			if (node->atom == NULL)
+				capture_assign_block_nolock(atom, node);
+			if (!JF_ISSET(node, JNODE_DIRTY))
+				do_jnode_make_dirty(node, atom);
+			spin_unlock_jnode(node);
+		}
+		spin_unlock_atom(atom);
+	}
+}
+
 /* Set the dirty status for this znode. */
 void znode_make_dirty(znode * z)
 {
@@ -2945,6 +3123,7 @@ static void capture_fuse_into(txn_atom * small, txn_atom * large)
 
 	/* Merge delete sets. */
 	atom_dset_merge(small, large);
+	blocknr_list_merge(&small->alloc_set, &large->alloc_set);
 
 	/* Merge allocated/deleted file counts */
 	large->nr_objects_deleted += small->nr_objects_deleted;
@@ -3152,6 +3331,35 @@ extern int atom_dset_deferred_add_extent(txn_atom *atom,
 	return ret;
 }
 
+/**
+ * atom_aset_add_extent - add extent to allocated set of current atom
+ * @start: first block of extent
+ * @len: extent length
+ *
+ * Blocks of relocated jnodes are marked used in COMMIT BITMAP at commit.
+ * Blocks which are allocated with no jnodes have to be recorded in the atom
+ * to get there.
+ */
+int atom_aset_add_extent(const reiser4_block_nr *start,
+			 const reiser4_block_nr *len)
+{
+	txn_atom *atom;
+	blocknr_list_entry *new_entry = NULL;
+	int ret;
+
+	do {
+		atom = get_current_atom_locked();
+		ret = blocknr_list_add_extent(atom, &atom->alloc_set,
+					      &new_entry, start, len);
+		if (ret == -ENOMEM)
+			return ret;
+		/* This loop might spin at most two times */
+	} while (ret == -E_REPEAT);
+
+	spin_unlock_atom(atom);
+	return 0;
+}
+
 /*
  * Local variables:
  * c-indentation-style: "K&R"
@@ -267,6 +267,11 @@ struct txn_atom {
 	/* The atom's wandered_block mapping. */
 	struct list_head wandered_map;
 
+	/* The atom's allocated set. It collects extents allocated during the
+	   transaction which no jnodes are relocated to (blocks preallocated
+	   for unwritten extents of files). It is a blocknr_list instance */
+	struct list_head alloc_set;
+
 	/* The transaction's list of dirty captured nodes--per level.  Index
 	   by (level). dirty_nodes[0] is for znode-above-root */
 	struct list_head dirty_nodes[REAL_MAX_ZTREE_HEIGHT + 1];
@@ -420,6 +425,9 @@ extern int force_commit_atom(txn_handle *);
 extern int flush_current_atom(int, long, long *, txn_atom **, jnode *);
 
 extern int flush_some_atom(jnode *, long *, const struct writeback_control *, int);
+extern long txnmgr_schedule(txn_mgr *, long max_timeout, int *trickle,
+			    __u32 *trickle_atom);
+extern void reiser4_trickle_atom(__u32 atom_id, long nr_to_write);
 
 extern void reiser4_atom_set_stage(txn_atom * atom, txn_stage stage);
 
@@ -517,6 +525,9 @@ extern int blocknr_list_add_extent(txn_atom *atom,
                                    blocknr_list_entry **new_entry,
                                    const reiser4_block_nr *start,
                                    const reiser4_block_nr *len);
+extern int blocknr_list_pop(struct list_head *blist,
+                            reiser4_block_nr *start,
+                            reiser4_block_nr *len);
 extern int blocknr_list_iterator(txn_atom *atom,
                                  struct list_head *blist,
                                  blocknr_set_actor_f actor,
@@ -538,6 +549,8 @@ extern int atom_dset_deferred_add_extent(txn_atom *atom,
                                          void **new_entry,
                                          const reiser4_block_nr *start,
                                          const reiser4_block_nr *len);
+extern int atom_aset_add_extent(const reiser4_block_nr *start,
+				const reiser4_block_nr *len);
 
 /* flush code takes care about how to fuse flush queues */
 extern void flush_init_atom(txn_atom * atom);
@@ -701,6 +714,8 @@ struct flush_queue {
 	/* A list which contains queued nodes, queued nodes are removed from any
 	 * atom's list and put on this ->prepped one. */
 	struct list_head prepped;
+	/* number of nodes ever queued to this fq */
+	unsigned long nr_queued;
 	/* number of submitted i/o requests */
 	atomic_t nr_submitted;
 	/* number of i/o errors */
@@ -709,6 +724,11 @@ struct flush_queue {
 	txn_atom *atom;
 	/* A wait queue head to wait on i/o completion */
 	wait_queue_head_t wait;
+	/* number of bios submitted through this flush queue and the number of
+	   blocks they carried. Updated by the fq owner only, folded into
+	   per-super block totals when the fq is destroyed. */
+	unsigned long nr_bios;
+	unsigned long nr_bio_blocks;
 #if REISER4_DEBUG
 	/* A thread which took this fq in exclusive use, NULL if fq is free,
 	 * used for debugging. */
@@ -730,6 +750,7 @@ extern reiser4_block_nr txnmgr_count_deleted_blocks(void);
 
 extern void znode_make_dirty(znode * node);
 extern void jnode_make_dirty_locked(jnode * node);
+extern void reiser4_capture_dirty_jnodes(jnode **nodes, int count);
 
 extern int reiser4_sync_atom(txn_atom * atom);
 
@@ -171,15 +171,15 @@ void reiser4_writeout(struct super_block *sb, struct writeback_control *wbc)
 		BUG_ON(wbc->nr_to_write <= 0);
 
 		if (get_current_context()->entd) {
-			entd_context *ent = get_entd_context(sb);
+			struct wbq *rq = entd_current_request();
 
-			if (ent->cur_request->node)
+			if (rq->node)
 				/*
 				 * this is ent thread and it managed to capture
 				 * requested page itself - start flush from
 				 * that page
 				 */
-				node = ent->cur_request->node;
+				node = rq->node;
 		}
 
 		result = flush_some_atom(node, &nr_submitted, wbc,
@@ -785,12 +785,12 @@ static int write_jnodes_to_disk_extent(
 
 				spin_lock(&ent->guard);
 
-				if (pg == ent->cur_request->page) {
+				if (pg == entd_current_request()->page) {
 					/*
 					 * entd is called for this page. This
 					 * request is not in th etodo list
 					 */
-					ent->cur_request->written = 1;
+					entd_current_request()->written = 1;
 				} else {
 					/*
 					 * if we have written a page for which writepage
@@ -629,6 +629,10 @@ int zload_ra(znode * node /* znode to load */ , ra_info_t * info)
 	if (info)
 		formatted_readahead(node, info);
 
+	if (unlikely(ZF_ISSET(node, JNODE_READAHEAD)) &&
+	    JF_TEST_AND_CLEAR(ZJNODE(node), JNODE_READAHEAD))
+		reiser4_readahead_used(node);
+
 	result = jload(ZJNODE(node));
 	assert("nikita-1378", znode_invariant(node));
 	return result;